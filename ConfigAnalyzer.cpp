@@ -0,0 +1,202 @@
+/*
+    Copyright (C) 2023  Csaba K Molnár
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#include "ConfigAnalyzer.h"
+#include "x52HID.h"
+#ifndef EASYLOGGINGPP_H
+#include "easylogging++.h"
+#endif
+
+namespace {
+	/// <summary>
+	/// A SimVar which changes a little on almost every simulation frame in flight, and the smallest delta at which
+	/// WASim sends notifications at a sensible rate. An empty unit matches every unit, but then only a missing delta is reported.
+	/// </summary>
+	struct NoisySimVar {
+		const char* dataref;
+		const char* unit;
+		float minimumDelta;
+	};
+	const NoisySimVar NOISY_SIMVARS[] = {
+		{ "GENERAL ENG RPM",             "rpm",             10.0f },
+		{ "PROP RPM",                    "rpm",             10.0f },
+		{ "AIRSPEED INDICATED",          "knots",           0.5f },
+		{ "AIRSPEED TRUE",               "knots",           0.5f },
+		{ "GROUND VELOCITY",             "knots",           0.5f },
+		{ "VERTICAL SPEED",              "feet per minute", 10.0f },
+		{ "VERTICAL SPEED",              "feet per second", 0.2f },
+		{ "INDICATED ALTITUDE",          "feet",            5.0f },
+		{ "PLANE ALTITUDE",              "feet",            5.0f },
+		{ "PLANE ALT ABOVE GROUND",      "feet",            5.0f },
+		{ "PLANE PITCH DEGREES",         "radians",         0.005f },
+		{ "PLANE BANK DEGREES",          "radians",         0.005f },
+		{ "PLANE HEADING DEGREES",       "radians",         0.005f },
+		{ "HEADING INDICATOR",           "radians",         0.005f },
+		{ "GENERAL ENG OIL TEMPERATURE", "",                0.0f },
+		{ "GENERAL ENG OIL PRESSURE",    "",                0.0f },
+		{ "GENERAL ENG FUEL PRESSURE",   "",                0.0f },
+		{ "ENG MANIFOLD PRESSURE",       "",                0.0f },
+		{ "ELECTRICAL MAIN BUS VOLTAGE", "volts",           0.1f },
+		{ "ELECTRICAL BATTERY LOAD",     "",                0.0f },
+		{ "FUEL TOTAL QUANTITY",         "gallons",         0.1f },
+		{ "SUCTION PRESSURE",            "inHg",            0.05f },
+	};
+
+	bool equals_ignoring_case(const std::string& a, const char* b) {
+		size_t length = std::char_traits<char>::length(b);
+		return a.size() == length && std::equal(a.begin(), a.end(), b, [](char x, char y) {
+			return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+		});
+	}
+
+	/// <summary>
+	/// The light LedBlinker shows for a character of a sequence pattern, or nullptr if the character keeps the previous light.
+	/// </summary>
+	const char* sequence_light(char c) {
+		switch (c) {
+		case ' ': return "off";
+		case 'a': return "amber";
+		case 'g': return "green";
+		case 'r': return "red";
+		case 'o': return "on";
+		default:  return nullptr;
+		}
+	}
+}
+
+ConfigAnalyzer::ConfigAnalyzer(const X52Config& config, const IndicatorRequests& requests) {
+	for (const X52Config::IndicatorState& state : config.indicatorStates)
+	{
+		if (state.simresult == 0 && state.instructionCount == 0) {
+			stateSimVars++;
+		}
+	}
+	for (const X52Config::ConditionTerm& term : config.conditionTerms)
+	{
+		if (term.requestid != 0) {
+			stateSimVars++;
+		}
+	}
+
+	requests.for_each([this](int, const IndicatorRequests::Request& request) {
+		if (request.calculatorcode.empty()) {
+			valueRequests++;
+			if (request.delta == 0.0f) {
+				valueRequestsWithoutDelta++;
+			}
+			for (const NoisySimVar& noisy : NOISY_SIMVARS)
+			{
+				if (!equals_ignoring_case(request.dataref, noisy.dataref)) {
+					continue;
+				}
+				bool anyUnit = noisy.unit[0] == '\0';
+				if ((anyUnit && request.delta == 0.0f) || (!anyUnit && equals_ignoring_case(request.unit, noisy.unit) && request.delta < noisy.minimumDelta)) {
+					noisyRequests.push_back({ request.dataref, request.unit, request.delta, noisy.minimumDelta });
+				}
+			}
+		} else if (request.dataref.rfind("LED ", 0) == 0) {
+			ledRequests++;
+		} else {
+			bucketRequests++;
+		}
+	});
+	double checksPerRequest = 1000.0 / IndicatorRequests::INTERVAL_MS;
+	checksPerSecond = requests.size() * checksPerRequest;
+	calculatorChecksPerSecond = (bucketRequests + ledRequests) * checksPerRequest;
+	noisyNotificationsPerSecond = noisyRequests.size() * checksPerRequest;
+
+	for (const X52Config::IndicatorLed& led : config.indicatorLeds)
+	{
+		LedTraffic busiest{ led.id, "", 0.0 };
+		for (size_t i = led.firstState; i < led.firstState + led.stateCount; i++)
+		{
+			int sequence = config.indicatorStates[i].sequence;
+			if (sequence < 0) {
+				continue;
+			}
+			double packets = color_changes_per_second(config.sequences[sequence]) * x52HID::ledPacketCount(led.id);
+			if (packets > busiest.packetsPerSecond) {
+				busiest.sequence = config.sequences[sequence].name;
+				busiest.packetsPerSecond = packets;
+			}
+		}
+		if (busiest.packetsPerSecond > 0) {
+			hidPacketsPerSecond += busiest.packetsPerSecond;
+			ledTraffic.push_back(busiest);
+		}
+	}
+}
+
+double ConfigAnalyzer::color_changes_per_second(const X52Config::Sequence& sequence) {
+	const std::string& pattern = sequence.pattern;
+	if (pattern.empty() || sequence.speed <= 0) {
+		return 0;
+	}
+	// The light of the last character which sets one, because a pattern can start with characters which keep it
+	const char* light = nullptr;
+	for (char c : pattern)
+	{
+		if (sequence_light(c)) {
+			light = sequence_light(c);
+		}
+	}
+	if (!light) {
+		return 0;
+	}
+	size_t changes = 0;
+	for (char c : pattern)
+	{
+		const char* next = sequence_light(c);
+		if (next && std::strcmp(next, light) != 0) {
+			changes++;
+			light = next;
+		}
+	}
+	return static_cast<double>(changes) / pattern.size() * sequence.speed;
+}
+
+void ConfigAnalyzer::log_report(const std::string& filename) const {
+	CLOG(INFO,"toconsole", "tofile") << "Analysis of " << filename << ":";
+	CLOG(INFO,"toconsole", "tofile") << "  " << stateSimVars << " SimVars are read by states and conditions. After sharing, WASim is asked for "
+		<< valueRequests + bucketRequests + ledRequests << " data requests: " << valueRequests << " by value (" << valueRequestsWithoutDelta << " without delta), "
+		<< bucketRequests << " threshold buckets and " << ledRequests << " leds evaluated in MSFS.";
+	CLOG(INFO,"toconsole", "tofile") << "  WASim checks them every " << IndicatorRequests::INTERVAL_MS << " ms, " << checksPerSecond << " checks per second, of which "
+		<< calculatorChecksPerSecond << " run calculator code. At most " << checksPerSecond << " notifications per second can arrive.";
+	if (noisyRequests.empty()) {
+		CLOG(INFO,"toconsole", "tofile") << "  No SimVar which changes constantly in flight is requested with a too small delta.";
+	} else {
+		CLOG(WARNING,"toconsole", "tofile") << "  " << noisyRequests.size() << " SimVars which change constantly in flight can cause " << noisyNotificationsPerSecond << " notifications per second:";
+		for (const NoisyRequest& noisy : noisyRequests)
+		{
+			if (noisy.recommendedDelta > 0) {
+				CLOG(WARNING,"toconsole", "tofile") << "    " << noisy.dataref << " in " << noisy.unit << " has delta " << noisy.delta << ", consider a delta of at least " << noisy.recommendedDelta << ".";
+			} else {
+				CLOG(WARNING,"toconsole", "tofile") << "    " << noisy.dataref << " in " << noisy.unit << " has no delta, consider setting one.";
+			}
+		}
+	}
+	CLOG(INFO,"toconsole", "tofile") << "  Sequences: " << ledTraffic.size() << " leds can blink. If all of them show their busiest sequence at the same time, "
+		<< hidPacketsPerSecond << " HID packets per second are sent to the joystick.";
+	for (const LedTraffic& traffic : ledTraffic)
+	{
+		CLOG(INFO,"toconsole", "tofile") << "    Led " << traffic.led << ": sequence " << traffic.sequence << ", " << traffic.packetsPerSecond << " packets per second.";
+	}
+}
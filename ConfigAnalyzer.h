@@ -0,0 +1,82 @@
+/*
+    Copyright (C) 2023  Csaba K Molnár
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <vector>
+
+#include "X52Config.h"
+#include "IndicatorRequests.h"
+
+#ifndef CLASS_CONFIGANALYZER_H
+#define CLASS_CONFIGANALYZER_H
+
+/// <summary>
+/// Estimates what a compiled configuration costs at runtime: how many SimVars WASim has to watch, how many
+/// notifications it can send, and how many HID packets the led sequences can cause. Works on the same compiled
+/// configuration and data requests as a running x52msfsout, but needs neither MSFS nor the joystick.
+/// </summary>
+class ConfigAnalyzer
+{
+// VARIABLES
+public:
+	/// <summary>
+	/// A request for a SimVar which changes constantly in flight, with a delta which lets almost every change through.
+	/// </summary>
+	struct NoisyRequest {
+		std::string dataref;
+		std::string unit;
+		float delta;
+		float recommendedDelta;
+	};
+	/// <summary>
+	/// The busiest sequence a led can show.
+	/// </summary>
+	struct LedTraffic {
+		std::string led;
+		std::string sequence;
+		double packetsPerSecond;
+	};
+	size_t stateSimVars = 0;      // SimVars read by states and condition terms, before requests were shared
+	size_t valueRequests = 0;     // Requests which send the SimVar's value
+	size_t valueRequestsWithoutDelta = 0;
+	size_t bucketRequests = 0;    // Requests which send the result of the ops on a SimVar
+	size_t ledRequests = 0;       // Requests which send the winning state of a sim_evaluate led
+	double checksPerSecond = 0;   // How often WASim reads a SimVar or runs calculator code
+	double calculatorChecksPerSecond = 0;
+	double noisyNotificationsPerSecond = 0; // Notifications which the noisy requests alone can cause
+	std::vector<NoisyRequest> noisyRequests;
+	std::vector<LedTraffic> ledTraffic;
+	double hidPacketsPerSecond = 0; // If every led shows its busiest sequence at the same time
+
+// FUNCTIONS
+public:
+	/// <summary>
+	/// Analyzes a configuration whose data requests were already assigned.
+	/// </summary>
+	ConfigAnalyzer(const X52Config& config, const IndicatorRequests& requests);
+	/// <summary>
+	/// Logs the results.
+	/// </summary>
+	void log_report(const std::string& filename) const;
+	/// <summary>
+	/// How often the color of a led changes per second while it shows the sequence, including the step from the
+	/// end of the pattern back to its start.
+	/// </summary>
+	static double color_changes_per_second(const X52Config::Sequence& sequence);
+};
+
+#endif
@@ -0,0 +1,634 @@
+/*
+    Copyright (C) 2023  Csaba K Molnár
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <malloc.h>
+#include <map>
+#include <new>
+#include <random>
+#include <sstream>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/xml_parser.hpp>
+
+#include "ConfigBenchmark.h"
+#include "ConfigCache.h"
+#ifndef EASYLOGGINGPP_H
+#include "easylogging++.h"
+#endif
+
+namespace {
+	const char* const LED_IDS[] = { "fire", "a", "b", "d", "e", "t1", "t2", "t3", "pov", "clutch", "throttle" };
+	/// <summary>
+	/// Length of the scripted value streams, sampled every IndicatorRequests::INTERVAL_MS like WASim checks a request.
+	/// </summary>
+	constexpr std::chrono::minutes STREAM_DURATION{ 10 };
+	/// <summary>
+	/// Number of data notifications processed by each run of the led evaluation measurements.
+	/// </summary>
+	constexpr size_t NOTIFICATIONS_PER_RUN = 200;
+	/// <summary>
+	/// Number of RequestID lookups in each run of the lookup measurement.
+	/// </summary>
+	constexpr size_t LOOKUPS_PER_RUN = 100000;
+
+	// The results of the measured code are added here, so the compiler cannot leave the code out
+	volatile double sink = 0;
+
+	// Heap use counted by operator new and operator delete below while countingAllocations is set
+	std::atomic<bool> countingAllocations{ false };
+	std::atomic<long long> allocatedBytes{ 0 };
+	std::atomic<long long> peakAllocatedBytes{ 0 };
+
+	size_t usable_size(void* p) {
+#ifdef _MSC_VER
+		return _msize(p);
+#else
+		return malloc_usable_size(p);
+#endif
+	}
+
+	/// <summary>
+	/// Runs function once and returns the largest amount of heap memory it held at any time, in bytes.
+	/// Memory allocated before and freed during the run is not subtracted below 0.
+	/// </summary>
+	size_t peak_heap_bytes(const std::function<void()>& function) {
+		allocatedBytes = 0;
+		peakAllocatedBytes = 0;
+		countingAllocations = true;
+		function();
+		countingAllocations = false;
+		return static_cast<size_t>(peakAllocatedBytes.load());
+	}
+
+	/// <summary>
+	/// evaluate_xml_op() of version 0.5.0, which split and converted the op attribute on every call.
+	/// </summary>
+	bool evaluate_xml_op_ptree(double simvarvalue, const std::string& op) {
+		std::string oper = op.substr(0, 2);
+		std::string value = op.substr(2);
+		if (oper == "==") {
+			return std::stod(value) == simvarvalue;
+		} else if (oper == "--") {
+			return simvarvalue < std::stod(value);
+		} else if (oper == "++") {
+			return simvarvalue > std::stod(value);
+		}
+		return false;
+	}
+
+	/// <summary>
+	/// The sequence lookup of update_led() in version 0.5.0, which searched the sequences tag for the light of every true state.
+	/// </summary>
+	bool is_sequence_ptree(const boost::property_tree::ptree& xml, const std::string& light) {
+		if (xml.count("sequences") != 0) {
+			for (const auto& [first, second] : xml.get_child("sequences"))
+			{
+				if (first == "sequence" && light == second.get<std::string>("<xmlattr>.name")) {
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	/// <summary>
+	/// dataref_ind_action() of version 0.5.0 without the writes to the joystick. Walks the whole indicators tag on every
+	/// notification, innermost states first, and stores the light of each led in the tree.
+	/// </summary>
+	std::string evaluate_indicators_ptree(std::string_view tagname, boost::property_tree::ptree& xmltree, const boost::property_tree::ptree& xml, const std::map<int, double>& values) {
+		std::string r;
+		try
+		{
+			for (boost::property_tree::ptree::value_type& v : xmltree)
+			{
+				if (v.first == "led") {
+					if (v.second.count("state") != 0) {
+						r = evaluate_indicators_ptree(v.first, v.second, xml, values);
+						v.second.put("<xmlattr>.current_light", r.empty() ? "off" : r);
+					}
+				} else if (v.first == "state") {
+					r = evaluate_indicators_ptree(v.first, v.second, xml, values);
+					if (!r.empty()) {
+						return r;
+					}
+				}
+			}
+			if (tagname == "state") {
+				if (evaluate_xml_op_ptree(values.at(xmltree.get<int>("<xmlattr>.requestid")), xmltree.get<std::string>("<xmlattr>.op"))) {
+					std::string light = xmltree.get<std::string>("<xmlattr>.light");
+					sink = sink + is_sequence_ptree(xml, light);
+					return light;
+				}
+				return "";
+			}
+		}
+		catch (const std::exception&)
+		{
+			// States with a condition or a new op were not supported
+			return "";
+		}
+		return "";
+	}
+
+	/// <summary>
+	/// Stores the RequestID of each state in the tree, like DataRequestsForIndicators() of version 0.5.0 did.
+	/// </summary>
+	void put_request_ids(boost::property_tree::ptree& xmltree, const IndicatorRequests& requests) {
+		for (boost::property_tree::ptree::value_type& v : xmltree)
+		{
+			if (v.first == "led" || v.first == "state") {
+				put_request_ids(v.second, requests);
+			}
+			if (v.first == "state" && v.second.count("<xmlattr>") != 0 && v.second.get_child("<xmlattr>").count("dataref") != 0) {
+				std::string attr = v.second.get<std::string>("<xmlattr>.dataref");
+				size_t separatorpos = attr.find("%");
+				int simvarindex = v.second.get<int>("<xmlattr>.index", 0);
+				v.second.put("<xmlattr>.requestid", requests.find(attr.substr(0, separatorpos), attr.substr(separatorpos + 1), static_cast<uint8_t>(simvarindex)));
+			}
+		}
+	}
+
+	/// <summary>
+	/// The state loop of X52::evaluate_led() without hysteresis, dwell time and the writes to the joystick.
+	/// Conditions and trend ops are skipped, because the old code did not support them either.
+	/// </summary>
+	/// <returns>The index of the winning state, or -1.</returns>
+	int evaluate_led_table(const X52Config& config, const IndicatorRequests& requests, size_t ledIndex) {
+		const X52Config::IndicatorLed& led = config.indicatorLeds[ledIndex];
+		for (size_t i = led.firstState; i < led.firstState + led.stateCount; i++)
+		{
+			const X52Config::IndicatorState& state = config.indicatorStates[i];
+			if (state.instructionCount > 0 || state.op.is_trend()) {
+				continue;
+			}
+			const IndicatorRequests::Request* data = requests.find(state.requestid);
+			if (data && X52Config::state_matches(state, data->value)) {
+				return static_cast<int>(i);
+			}
+		}
+		return -1;
+	}
+
+	/// <summary>
+	/// DataRequestsForIndicators() of version 0.5.0 without the property tree: every state searches all requests
+	/// stored so far, comparing the dataref, unit and SimVar index.
+	/// </summary>
+	/// <returns>The number of requests.</returns>
+	size_t assign_requests_linear(const X52Config& config) {
+		struct Request {
+			std::string dataref;
+			std::string unit;
+			uint8_t simvarindex;
+			float delta;
+			double value;
+		};
+		std::map<int, Request> requests;
+		int nextId = IndicatorRequests::FIRST_REQUEST_ID;
+		for (const X52Config::IndicatorState& state : config.indicatorStates)
+		{
+			if (state.instructionCount > 0 || state.simresult > 0) {
+				continue;
+			}
+			bool foundsamedataref = false;
+			for (auto it = requests.begin(); it != requests.end(); ++it)
+			{
+				if (it->second.dataref == state.dataref && it->second.unit == state.unit && it->second.simvarindex == state.simvarindex) {
+					foundsamedataref = true;
+					break;
+				}
+			}
+			if (!foundsamedataref) {
+				requests.emplace(nextId++, Request{ state.dataref, state.unit, state.simvarindex, state.delta, 0 });
+			}
+		}
+		return requests.size();
+	}
+
+	/// <summary>
+	/// A scripted stream of one SimVar, sampled every IndicatorRequests::INTERVAL_MS for STREAM_DURATION: a sine wave with a
+	/// period of one minute which sweeps across all thresholds of ops, with noise of 0.5% of the range. SimVars which are
+	/// only compared with integers, like Bool SimVars, move in whole steps.
+	/// </summary>
+	std::vector<double> scripted_stream(const std::vector<X52Config::XmlOp>& ops, unsigned seed) {
+		double lo = 0;
+		double hi = 0;
+		bool first = true;
+		bool integers = true;
+		for (const X52Config::XmlOp& op : ops)
+		{
+			if (op.is_trend()) {
+				continue;
+			}
+			double a = op.operand;
+			double b = op.type == X52Config::XmlOp::Type::Range ? op.operand2 : op.operand;
+			if (op.type == X52Config::XmlOp::Type::BitsSet) {
+				a = 0;
+				b = 2 * op.operand;
+			}
+			lo = first ? a : std::min(lo, a);
+			hi = first ? b : std::max(hi, b);
+			first = false;
+			bool integerOp = op.type == X52Config::XmlOp::Type::Equal || op.type == X52Config::XmlOp::Type::NotEqual || op.type == X52Config::XmlOp::Type::BitsSet;
+			integers = integers && integerOp && std::floor(op.operand) == op.operand;
+		}
+		if (first) {
+			lo = 0;
+			hi = 100;
+			integers = false;
+		}
+		double span = std::max(hi - lo, 1.0);
+		double middle = (lo + hi) / 2;
+		double amplitude = span * 0.6;
+		std::minstd_rand random(seed);
+		size_t count = static_cast<size_t>(std::chrono::milliseconds(STREAM_DURATION).count() / IndicatorRequests::INTERVAL_MS);
+		std::vector<double> stream;
+		stream.reserve(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			double seconds = i * IndicatorRequests::INTERVAL_MS / 1000.0;
+			double noise = (static_cast<double>(random() - random.min()) / (random.max() - random.min()) - 0.5) * span * 0.01;
+			double value = middle + amplitude * std::sin(2 * 3.14159265358979 * seconds / 60 + seed) + noise;
+			stream.push_back(integers ? std::round(value) : value);
+		}
+		return stream;
+	}
+
+	/// <summary>
+	/// Number of notifications WASim sends for a request by value: the first value, then every change larger than delta.
+	/// </summary>
+	size_t value_notifications(const std::vector<double>& stream, float delta) {
+		size_t notifications = 0;
+		double sent = 0;
+		for (size_t i = 0; i < stream.size(); i++)
+		{
+			if (i == 0 || std::fabs(stream[i] - sent) > delta || (delta == 0 && stream[i] != sent)) {
+				sent = stream[i];
+				notifications++;
+			}
+		}
+		return notifications;
+	}
+
+	/// <summary>
+	/// Number of notifications WASim sends for a threshold bucket request: the first result, then every change of the bit mask.
+	/// </summary>
+	size_t bucket_notifications(const std::vector<double>& stream, const X52Config& config, int requestid) {
+		size_t notifications = 0;
+		uint64_t sent = 0;
+		for (size_t i = 0; i < stream.size(); i++)
+		{
+			uint64_t mask = 0;
+			for (const X52Config::IndicatorState& state : config.indicatorStates)
+			{
+				if (state.requestid == requestid && state.bucketbit >= 0 && state.op.matches(stream[i])) {
+					mask |= uint64_t(1) << state.bucketbit;
+				}
+			}
+			if (i == 0 || mask != sent) {
+				sent = mask;
+				notifications++;
+			}
+		}
+		return notifications;
+	}
+}
+
+// Replaced for the whole program, but only count while ConfigBenchmark measures the heap use of a loader
+void* operator new(size_t size) {
+	void* p = std::malloc(size > 0 ? size : 1);
+	if (!p) {
+		throw std::bad_alloc();
+	}
+	if (countingAllocations.load(std::memory_order_relaxed)) {
+		long long allocated = allocatedBytes += static_cast<long long>(usable_size(p));
+		long long peak = peakAllocatedBytes.load(std::memory_order_relaxed);
+		while (allocated > peak && !peakAllocatedBytes.compare_exchange_weak(peak, allocated))
+		{
+		}
+	}
+	return p;
+}
+
+void operator delete(void* p) noexcept {
+	if (p && countingAllocations.load(std::memory_order_relaxed)) {
+		allocatedBytes -= static_cast<long long>(usable_size(p));
+	}
+	std::free(p);
+}
+
+ConfigBenchmark::ConfigBenchmark(AssignRequests assign, int runs) : assignRequests(std::move(assign)), repetitions(runs) {
+}
+
+double ConfigBenchmark::median_us(const std::function<void()>& function) const {
+	std::vector<double> times;
+	for (int i = 0; i < repetitions; i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		function();
+		times.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+	}
+	std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+	return times[times.size() / 2];
+}
+
+std::string ConfigBenchmark::synthetic_xml(size_t statesPerLed, size_t simvars) {
+	constexpr size_t CHAIN_DEPTH = 10;
+	const char* const lights[] = { "green", "amber", "red", "blink" };
+	std::ostringstream xml;
+	xml << "<indicators>\n";
+	size_t n = 0;
+	for (const char* id : LED_IDS)
+	{
+		xml << "  <led id=\"" << id << "\">\n";
+		for (size_t chain = 0; chain < statesPerLed; chain += CHAIN_DEPTH)
+		{
+			size_t depth = std::min(CHAIN_DEPTH, statesPerLed - chain);
+			for (size_t d = 0; d < depth; d++, n++)
+			{
+				xml << std::string(4 + 2 * d, ' ') << "<state light=\"" << lights[n % 4] << "\" dataref=\"BENCHMARK VAR " << n % simvars
+					<< "%number\" op=\"++" << (n % 97) + d * 10 << "\" delta=\"0.5\">\n";
+			}
+			for (size_t d = depth; d-- > 0; )
+			{
+				xml << std::string(4 + 2 * d, ' ') << "</state>\n";
+			}
+		}
+		xml << "  </led>\n";
+	}
+	xml << "</indicators>\n";
+	xml << "<sequences>\n  <sequence name=\"blink\" pattern=\"r r \" speed=\"4\"></sequence>\n</sequences>\n";
+	return xml.str();
+}
+
+bool ConfigBenchmark::run(const std::string& xmlfilename) {
+	return measure(xmlfilename, xmlfilename);
+}
+
+bool ConfigBenchmark::run_synthetic() {
+	std::filesystem::path filename = std::filesystem::temp_directory_path() / "x52msfsout_synthetic.xml";
+	{
+		std::ofstream file(filename, std::ios::binary);
+		file << synthetic_xml(SYNTHETIC_STATES_PER_LED, SYNTHETIC_SIMVARS);
+		if (!file) {
+			CLOG(ERROR, "toconsole", "tofile") << "Cannot write " << filename.string() << ".";
+			return false;
+		}
+	}
+	bool measured = measure("a generated configuration of 11 leds with " + std::to_string(SYNTHETIC_STATES_PER_LED) + " states each", filename.string());
+	std::error_code ec;
+	std::filesystem::remove(filename, ec);
+	return measured;
+}
+
+/// <summary>
+/// The configuration being measured, and its data requests assigned like at runtime without bucket requests.
+/// </summary>
+struct ConfigBenchmark::Subject {
+	std::string file;
+	X52Config config;
+	X52Config raw;
+	IndicatorRequests requests;
+	std::vector<int> requestIds;
+};
+
+bool ConfigBenchmark::measure(const std::string& label, const std::string& xmlfilename) {
+	// The copy gets its own cache file
+	std::filesystem::path copy = std::filesystem::temp_directory_path() / ("x52msfsout_benchmark_" + std::filesystem::path(xmlfilename).filename().string());
+	std::error_code ec;
+	if (!std::filesystem::copy_file(xmlfilename, copy, std::filesystem::copy_options::overwrite_existing, ec)) {
+		CLOG(ERROR, "toconsole", "tofile") << "Cannot copy " << xmlfilename << " to " << copy.string() << ".";
+		return false;
+	}
+	Subject subject;
+	subject.file = copy.string();
+	if (!subject.config.load(subject.file)) {
+		std::filesystem::remove(copy, ec);
+		return false;
+	}
+	subject.raw = subject.config;
+	subject.raw.bucketRequests = false;
+	assignRequests(subject.raw, subject.requests);
+	subject.requests.for_each([&subject](int requestid, const IndicatorRequests::Request&) {
+		subject.requestIds.push_back(requestid);
+	});
+	CLOG(INFO, "toconsole", "tofile") << "Benchmark of " << label << ", median of " << repetitions << " runs:";
+	CLOG(INFO, "toconsole", "tofile") << "  " << subject.config.indicatorLeds.size() << " leds, " << subject.config.indicatorStates.size() << " states, "
+		<< subject.config.assignmentButtons.size() << " button tags, " << std::filesystem::file_size(copy, ec) << " bytes of XML.";
+	measure_loading(subject);
+	measure_requests(subject);
+	measure_evaluation(subject);
+	measure_notifications(subject);
+	std::filesystem::remove(copy, ec);
+	std::filesystem::remove(ConfigCache(subject.file).get_cache_filename(), ec);
+	return true;
+}
+
+void ConfigBenchmark::measure_loading(const Subject& subject) {
+	const std::string& file = subject.file;
+	// The property tree of version 0.5.0 against the streaming loader
+	auto ptreeLoader = [&]() {
+		X52Config c;
+		boost::property_tree::ptree tree;
+		boost::property_tree::read_xml(file, tree, boost::property_tree::xml_parser::no_comments + boost::property_tree::xml_parser::trim_whitespace);
+		sink = sink + c.compile(tree);
+	};
+	auto streamingLoader = [&]() {
+		X52Config c;
+		sink = sink + c.load(file);
+	};
+	double ptreeUs = median_us(ptreeLoader);
+	double streamingUs = median_us(streamingLoader);
+	size_t ptreePeak = peak_heap_bytes(ptreeLoader);
+	size_t streamingPeak = peak_heap_bytes(streamingLoader);
+	std::ostringstream loads;
+	loads << "  Load: property tree " << ptreeUs << " us, streaming loader " << streamingUs << " us (" << ptreeUs / streamingUs << "x)";
+	// The cache file, including hashing the XML file
+	ConfigCache cache(file);
+	X52Config cached;
+	if (cache.save(subject.config) && ConfigCache(file).load(cached)) {
+		double cacheUs = median_us([&]() {
+			X52Config c;
+			sink = sink + ConfigCache(file).load(c);
+		});
+		loads << ", cache file " << cacheUs << " us (" << ptreeUs / cacheUs << "x)";
+	} else {
+		CLOG(ERROR, "toconsole", "tofile") << "Cannot write and read the cache file " << cache.get_cache_filename() << ".";
+	}
+	CLOG(INFO, "toconsole", "tofile") << loads.str() << ".";
+	CLOG(INFO, "toconsole", "tofile") << "  Peak heap use while loading: property tree " << ptreePeak / 1024.0 << " KB, streaming loader " << streamingPeak / 1024.0 << " KB ("
+		<< 100.0 * streamingPeak / ptreePeak << "%).";
+}
+
+void ConfigBenchmark::measure_requests(const Subject& subject) {
+	// A linear search per state against the hashed registry
+	std::vector<X52Config> copies(repetitions, subject.config);
+	size_t next = 0;
+	double linearUs = median_us([&]() {
+		sink = sink + assign_requests_linear(subject.config);
+	});
+	double hashedUs = median_us([&]() {
+		IndicatorRequests r;
+		assignRequests(copies[next++], r);
+		sink = sink + r.size();
+	});
+	// Storing the value of a notification
+	std::map<int, IndicatorRequests::Request> requestMap;
+	IndicatorRequests requests = subject.requests;
+	for (int requestid : subject.requestIds)
+	{
+		requestMap[requestid];
+	}
+	double mapLookupNs = 0;
+	double registryLookupNs = 0;
+	const std::vector<int>& requestIds = subject.requestIds;
+	if (!requestIds.empty()) {
+		mapLookupNs = median_us([&]() {
+			for (size_t i = 0; i < LOOKUPS_PER_RUN; i++)
+			{
+				requestMap.at(requestIds[i % requestIds.size()]).value = static_cast<double>(i);
+			}
+		}) * 1000 / LOOKUPS_PER_RUN;
+		registryLookupNs = median_us([&]() {
+			for (size_t i = 0; i < LOOKUPS_PER_RUN; i++)
+			{
+				requests.find(requestIds[i % requestIds.size()])->value = static_cast<double>(i);
+			}
+		}) * 1000 / LOOKUPS_PER_RUN;
+	}
+	CLOG(INFO, "toconsole", "tofile") << "  Requests: " << subject.requests.size() << " requests assigned by a linear search in " << linearUs << " us, by AssignIndicatorRequests() in "
+		<< hashedUs << " us (" << linearUs / hashedUs << "x). Storing a value: std::map::at() " << mapLookupNs << " ns, IndicatorRequests::find() " << registryLookupNs << " ns.";
+}
+
+void ConfigBenchmark::measure_evaluation(const Subject& subject) {
+	const std::vector<int>& requestIds = subject.requestIds;
+	if (requestIds.empty()) {
+		return;
+	}
+	const X52Config& raw = subject.raw;
+	IndicatorRequests requests = subject.requests;
+	boost::property_tree::ptree xml;
+	boost::property_tree::read_xml(subject.file, xml, boost::property_tree::xml_parser::no_comments + boost::property_tree::xml_parser::trim_whitespace);
+	boost::property_tree::ptree& indicators = xml.get_child("indicators");
+	put_request_ids(indicators, requests);
+	std::map<int, double> values;
+	for (int requestid : requestIds)
+	{
+		values[requestid] = 0;
+	}
+	// The reverse index of X52::index_indicator_requests()
+	std::vector<std::vector<size_t>> ledsForRequestId(requests.end_id());
+	for (size_t l = 0; l < raw.indicatorLeds.size(); l++)
+	{
+		const X52Config::IndicatorLed& led = raw.indicatorLeds[l];
+		for (size_t i = led.firstState; i < led.firstState + led.stateCount; i++)
+		{
+			int requestid = raw.indicatorStates[i].requestid;
+			if (requestid > 0 && raw.indicatorStates[i].instructionCount == 0) {
+				std::vector<size_t>& leds = ledsForRequestId[requestid];
+				if (std::find(leds.begin(), leds.end(), l) == leds.end()) {
+					leds.push_back(l);
+				}
+			}
+		}
+	}
+	auto notify = [&](size_t n) {
+		int requestid = requestIds[n % requestIds.size()];
+		double value = static_cast<double>((n * 7919) % 100);
+		values[requestid] = value;
+		requests.find(requestid)->value = value;
+		return requestid;
+	};
+	// The walk of the indicators tag, the flat table of all leds, and only the leds which read the SimVar
+	double ptreeUs = median_us([&]() {
+		for (size_t n = 0; n < NOTIFICATIONS_PER_RUN; n++)
+		{
+			notify(n);
+			evaluate_indicators_ptree("", indicators, xml, values);
+		}
+	}) / NOTIFICATIONS_PER_RUN;
+	double tableUs = median_us([&]() {
+		for (size_t n = 0; n < NOTIFICATIONS_PER_RUN; n++)
+		{
+			notify(n);
+			for (size_t l = 0; l < raw.indicatorLeds.size(); l++)
+			{
+				sink = sink + evaluate_led_table(raw, requests, l);
+			}
+		}
+	}) / NOTIFICATIONS_PER_RUN;
+	double indexedUs = median_us([&]() {
+		for (size_t n = 0; n < NOTIFICATIONS_PER_RUN; n++)
+		{
+			for (size_t l : ledsForRequestId[notify(n)])
+			{
+				sink = sink + evaluate_led_table(raw, requests, l);
+			}
+		}
+	}) / NOTIFICATIONS_PER_RUN;
+	CLOG(INFO, "toconsole", "tofile") << "  Led evaluation per notification: property tree walk " << ptreeUs << " us, flat table of all leds " << tableUs << " us ("
+		<< ptreeUs / tableUs << "x), flat table of the leds reading the SimVar " << indexedUs << " us (" << ptreeUs / indexedUs << "x).";
+}
+
+void ConfigBenchmark::measure_notifications(const Subject& subject) {
+	// Every SimVar requested by value, and with threshold buckets
+	X52Config bucketed = subject.config;
+	bucketed.bucketRequests = true;
+	IndicatorRequests bucketRequests;
+	assignRequests(bucketed, bucketRequests);
+	size_t valueCount = 0;
+	size_t bucketCount = 0;
+	size_t bucketedRequests = 0;
+	subject.requests.for_each([&](int requestid, const IndicatorRequests::Request& request) {
+		if (!request.calculatorcode.empty()) {
+			// A sim_evaluate led, requested the same way in both
+			return;
+		}
+		std::vector<X52Config::XmlOp> ops;
+		for (const X52Config::IndicatorState& state : subject.raw.indicatorStates)
+		{
+			if (state.requestid == requestid && state.instructionCount == 0) {
+				ops.push_back(state.op);
+			}
+		}
+		for (const X52Config::ConditionTerm& term : subject.raw.conditionTerms)
+		{
+			if (term.requestid == requestid) {
+				ops.push_back(term.op);
+			}
+		}
+		std::vector<double> stream = scripted_stream(ops, static_cast<unsigned>(requestid));
+		size_t notifications = value_notifications(stream, request.delta);
+		valueCount += notifications;
+		int bucketid = bucketRequests.find(request.dataref, request.unit, request.simvarindex);
+		const IndicatorRequests::Request* bucket = bucketRequests.find(bucketid);
+		if (bucket && !bucket->calculatorcode.empty()) {
+			bucketedRequests++;
+			bucketCount += bucket_notifications(stream, bucketed, bucketid);
+		} else {
+			bucketCount += notifications;
+		}
+	});
+	CLOG(INFO, "toconsole", "tofile") << "  Notifications in a scripted " << STREAM_DURATION.count() << " minute flight: " << valueCount << " with requests by value, "
+		<< bucketCount << " with bucket_requests (" << bucketedRequests << " of " << subject.requests.size() << " requests bucketed, "
+		<< (valueCount > 0 ? 100.0 * (valueCount - bucketCount) / valueCount : 0) << "% fewer).";
+}
@@ -0,0 +1,98 @@
+/*
+    Copyright (C) 2023  Csaba K Molnár
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <functional>
+#include <string>
+
+#include "X52Config.h"
+#include "IndicatorRequests.h"
+
+#ifndef CLASS_CONFIGBENCHMARK_H
+#define CLASS_CONFIGBENCHMARK_H
+
+/// <summary>
+/// Measures the code paths of x52msfsout which depend on the size of the configuration against the property tree code of version 0.5.0
+/// which they replaced: loading the XML file and the cache file, evaluating the leds when a SimVar changes, assigning data requests and the notifications WASim sends for raw and threshold bucket requests.
+/// The old code is kept here in a reduced form which only reads the XML tags it needs, and does not write to the joystick,
+/// so both sides do the same work. Needs neither MSFS nor the joystick.
+/// </summary>
+class ConfigBenchmark
+{
+// VARIABLES
+public:
+	/// <summary>
+	/// Assigns the data requests of a configuration the way x52msfsout does at startup.
+	/// </summary>
+	using AssignRequests = std::function<void(X52Config&, IndicatorRequests&)>;
+	/// <summary>
+	/// The generated configuration which is measured in addition to the XML file: every led has this many nested states.
+	/// </summary>
+	static constexpr size_t SYNTHETIC_STATES_PER_LED = 300;
+	/// <summary>
+	/// Number of different SimVars the states of the generated configuration read.
+	/// </summary>
+	static constexpr size_t SYNTHETIC_SIMVARS = 500;
+private:
+	struct Subject;
+	AssignRequests assignRequests;
+	int repetitions;
+
+// FUNCTIONS
+public:
+	/// <param name="repetitions">Each measurement is repeated this many times, and the median is reported.</param>
+	ConfigBenchmark(AssignRequests assignRequests, int repetitions = 21);
+	/// <summary>
+	/// Measures a configuration file and logs the results. The file is copied to the temporary directory first,
+	/// so no cache file is written next to it.
+	/// </summary>
+	/// <returns>False if the file cannot be compiled.</returns>
+	bool run(const std::string& xmlfilename);
+	/// <summary>
+	/// Measures the generated configuration with 11 leds of SYNTHETIC_STATES_PER_LED states each.
+	/// </summary>
+	bool run_synthetic();
+	/// <summary>
+	/// Returns a configuration with an indicators tag of 11 leds. Each led has chains of 10 nested states, which read
+	/// simvars different SimVars in turn with increasing thresholds.
+	/// </summary>
+	static std::string synthetic_xml(size_t statesPerLed, size_t simvars);
+private:
+	bool measure(const std::string& label, const std::string& xmlfilename);
+	/// <summary>
+	/// Load times of the property tree, the streaming loader and the cache file,
+	/// and the peak heap use of the property tree and the streaming loader.
+	/// </summary>
+	void measure_loading(const Subject& subject);
+	/// <summary>
+	/// Request assignment with a linear search per state and with the hashed registry, and storing a notified value.
+	/// </summary>
+	void measure_requests(const Subject& subject);
+	/// <summary>
+	/// Led evaluation per notification by the walk of the property tree and by the flat table.
+	/// </summary>
+	void measure_evaluation(const Subject& subject);
+	/// <summary>
+	/// Notifications of scripted value streams with requests by value and with threshold bucket requests.
+	/// </summary>
+	void measure_notifications(const Subject& subject);
+	/// <summary>
+	/// Runs function repetitions times and returns the median time of one run in microseconds.
+	/// </summary>
+	double median_us(const std::function<void()>& function) const;
+};
+
+#endif
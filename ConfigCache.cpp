@@ -0,0 +1,464 @@
+/*
+    Copyright (C) 2023  Csaba K Molnár
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ConfigCache.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+#include <windows.h>
+
+namespace {
+	const char MAGIC[8] = { 'X', '5', '2', 'C', 'A', 'C', 'H', 'E' };
+
+	/// <summary>
+	/// The beginning of the cache file.
+	/// </summary>
+	struct CacheHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t sizeSize; // sizeof(size_t), which differs between 32 and 64-bit builds
+		uint64_t xmlHash;
+		uint64_t payloadSize;
+		uint64_t payloadHash; // FNV-1a hash of the payload, so that a damaged cache file is not read
+	};
+
+	/// <summary>
+	/// Appends fields to the cache file's content. Numbers are stored with their in-memory representation,
+	/// which is fine because the cache is only read on the machine which wrote it, and the header records sizeof(size_t).
+	/// </summary>
+	class CacheWriter
+	{
+	public:
+		std::string data;
+		template <typename T>
+		void field(const T& value) {
+			static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "Only numbers are stored directly");
+			data.append(reinterpret_cast<const char*>(&value), sizeof(T));
+		}
+		void field(const bool& value) {
+			field(static_cast<uint8_t>(value));
+		}
+		void field(const std::string& value) {
+			field(static_cast<uint32_t>(value.size()));
+			data.append(value);
+		}
+		template <typename T, typename F>
+		void list(const std::vector<T>& values, F fields) {
+			field(static_cast<uint32_t>(values.size()));
+			for (const T& value : values)
+			{
+				fields(value);
+			}
+		}
+	};
+
+	/// <summary>
+	/// Reads fields from the mapped cache file. Once a read would go past the end of the file, ok is false and all reads fail.
+	/// </summary>
+	class CacheReader
+	{
+	public:
+		CacheReader(const char* data, size_t size) : pos(data), end(data + size) {}
+		bool ok = true;
+		template <typename T>
+		void field(T& value) {
+			static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "Only numbers are stored directly");
+			if (!ok || static_cast<size_t>(end - pos) < sizeof(T))
+			{
+				ok = false;
+				return;
+			}
+			std::memcpy(&value, pos, sizeof(T));
+			pos += sizeof(T);
+		}
+		void field(bool& value) {
+			uint8_t v = 0;
+			field(v);
+			value = v != 0;
+		}
+		void field(std::string& value) {
+			uint32_t size = 0;
+			field(size);
+			if (!ok || static_cast<size_t>(end - pos) < size)
+			{
+				ok = false;
+				return;
+			}
+			value.assign(pos, size);
+			pos += size;
+		}
+		template <typename T, typename F>
+		void list(std::vector<T>& values, F fields) {
+			uint32_t size = 0;
+			field(size);
+			// Every element takes at least one byte, so a corrupt size cannot make us allocate much
+			if (!ok || static_cast<size_t>(end - pos) < size)
+			{
+				ok = false;
+				return;
+			}
+			values.resize(size);
+			for (T& value : values)
+			{
+				fields(value);
+			}
+		}
+		bool at_end() const { return pos == end; }
+	private:
+		const char* pos;
+		const char* end;
+	};
+
+	/// <summary>
+	/// Writes or reads all compiled tables of config. The same function is used in both directions, so the order
+	/// of fields cannot differ between them. Runtime fields like requestid, bucketbit and clienteventid are not stored.
+	/// </summary>
+	template <typename Archive, typename Config>
+	void transfer(Archive& a, Config& config) {
+		auto op = [&a](auto& o) { a.field(o.type); a.field(o.operand); a.field(o.operand2); };
+		a.list(config.masterTargets, [&](auto& t) {
+			a.field(t.id); op(t.op); a.field(t.switchDataref); a.field(t.switchUnit); a.field(t.brightnessDataref); a.field(t.brightnessUnit);
+			a.field(t.min); a.field(t.max); a.field(t.defaultBrightness);
+		});
+		a.list(config.shiftStates, [&](auto& s) {
+			a.field(s.name); a.field(s.button); a.field(s.subtreeSize); a.field(s.id);
+		});
+		a.list(config.buttonActions, [&](auto& b) {
+			a.field(b.kind); a.field(b.type); a.field(b.command); a.field(b.dataref); a.field(b.unit); a.field(b.on); a.field(b.off); a.field(b.delay); a.field(b.interval); a.field(b.shiftState);
+		});
+		a.list(config.assignmentButtons, [&](auto& b) {
+			a.field(b.nr); a.field(b.action); a.field(b.shiftedCount); a.field(b.gesture); a.field(b.chordMask);
+		});
+		a.list(config.shiftStateNames, [&](auto& n) { a.field(n); });
+		a.list(config.buttonDispatch, [&](auto& d) { a.field(d); });
+		a.list(config.buttonTags, [&](auto& t) { a.field(t); });
+		a.list(config.clientEvents, [&](auto& e) { a.field(e); });
+		a.list(config.chords, [&](auto& c) { a.field(c); });
+		a.list(config.chordDispatch, [&](auto& d) { a.field(d); });
+		a.field(config.longPressButtons); a.field(config.doublePressButtons); a.field(config.chordButtons);
+		a.field(config.longPressTime); a.field(config.doublePressTime); a.field(config.chordTime);
+		a.list(config.shiftRules, [&](auto& r) { a.field(r.mask); a.field(r.id); });
+		a.field(config.shiftButtonMask);
+		a.list(config.sequences, [&](auto& s) {
+			a.field(s.name); a.field(s.pattern); a.field(s.loop); a.field(s.speed);
+		});
+		a.list(config.indicatorStates, [&](auto& s) {
+			a.field(s.dataref); a.field(s.unit); a.field(s.simvarindex); a.field(s.delta); op(s.op);
+			a.field(s.hysteresis); a.field(s.dwell); a.field(s.simresult); a.field(s.firstInstruction); a.field(s.instructionCount);
+			a.field(s.light); a.field(s.sequence);
+		});
+		a.list(config.indicatorLeds, [&](auto& l) {
+			a.field(l.id); a.field(l.firstState); a.field(l.stateCount); a.field(l.calculatorcode);
+		});
+		a.list(config.conditionTerms, [&](auto& t) {
+			a.field(t.dataref); a.field(t.unit); a.field(t.simvarindex); a.field(t.delta); op(t.op);
+		});
+		a.list(config.conditionCode, [&](auto& i) {
+			a.field(i.type); a.field(i.term);
+		});
+		a.field(config.bucketRequests);
+		a.list(config.aircraftTitles, [&](auto& t) {
+			a.field(t);
+		});
+	}
+
+	/// <summary>
+	/// Checks every index and enum stored in the compiled tables, because the runtime uses them without checks.
+	/// Runtime fields like requestid are not stored, so they are assigned again after loading.
+	/// </summary>
+	/// <returns>The name of the first invalid table, or nullptr if all tables are valid.</returns>
+	const char* invalid_table(const X52Config& config) {
+		using Config = X52Config;
+		auto validOp = [](const Config::XmlOp& op) {
+			return op.type > Config::XmlOp::Type::Invalid && op.type <= Config::XmlOp::Type::ChangedWithin;
+		};
+		auto validAction = [&config](int32_t action) {
+			return action >= -1 && (action < 0 || static_cast<size_t>(action) < config.buttonActions.size());
+		};
+		const uint64_t allButtons = (uint64_t(1) << Config::BUTTON_COUNT) - 1;
+		size_t columns = config.shiftStateNames.size() + 1;
+		if (!std::all_of(config.masterTargets.begin(), config.masterTargets.end(), [&](const Config::MasterTarget& t) { return validOp(t.op); }))
+		{
+			return "masterTargets";
+		}
+		for (size_t i = 0; i < config.shiftStates.size(); i++)
+		{
+			const Config::ShiftState& state = config.shiftStates[i];
+			if (state.button < 1 || state.button > Config::BUTTON_COUNT || state.subtreeSize < 1 || state.subtreeSize > config.shiftStates.size() - i
+				|| state.id < 0 || static_cast<size_t>(state.id) >= columns)
+			{
+				return "shiftStates";
+			}
+		}
+		for (const Config::ButtonAction& action : config.buttonActions)
+		{
+			if (action.kind > Config::ButtonAction::Kind::CalculatorCode || action.type > Config::ButtonAction::Type::Other
+				|| (action.type == Config::ButtonAction::Type::Repeater && (action.delay < 0 || action.interval < 10)))
+			{
+				return "buttonActions";
+			}
+		}
+		for (const Config::AssignmentButton& button : config.assignmentButtons)
+		{
+			if (button.action >= config.buttonActions.size() || button.shiftedCount >= config.buttonActions.size() - button.action
+				|| static_cast<size_t>(button.gesture) >= Config::GESTURE_COUNT || (button.chordMask & ~allButtons)
+				|| (button.chordMask == 0 && (button.nr < 1 || button.nr > Config::BUTTON_COUNT)))
+			{
+				return "assignmentButtons";
+			}
+		}
+		// The dispatch tables are indexed by button number, gesture and shift state id without checks
+		if (config.buttonDispatch.size() != Config::GESTURE_COUNT * Config::BUTTON_COUNT * columns
+			|| !std::all_of(config.buttonDispatch.begin(), config.buttonDispatch.end(), validAction))
+		{
+			return "buttonDispatch";
+		}
+		if (config.buttonTags.size() != Config::BUTTON_COUNT || !std::all_of(config.buttonTags.begin(), config.buttonTags.end(), validAction))
+		{
+			return "buttonTags";
+		}
+		if (!std::all_of(config.chords.begin(), config.chords.end(), [&](uint64_t mask) { return mask != 0 && !(mask & ~allButtons); }))
+		{
+			return "chords";
+		}
+		if (config.chordDispatch.size() != config.chords.size() * columns
+			|| !std::all_of(config.chordDispatch.begin(), config.chordDispatch.end(), validAction))
+		{
+			return "chordDispatch";
+		}
+		if ((config.longPressButtons | config.doublePressButtons | config.chordButtons | config.shiftButtonMask) & ~allButtons)
+		{
+			return "button masks";
+		}
+		if (!std::all_of(config.shiftRules.begin(), config.shiftRules.end(), [&](const Config::ShiftRule& rule) {
+				return rule.id > 0 && static_cast<size_t>(rule.id) < columns && !(rule.mask & ~allButtons);
+			}))
+		{
+			return "shiftRules";
+		}
+		for (const Config::ConditionInstruction& instruction : config.conditionCode)
+		{
+			if (instruction.type > Config::ConditionInstruction::Type::Not
+				|| (instruction.type == Config::ConditionInstruction::Type::Test && instruction.term >= config.conditionTerms.size()))
+			{
+				return "conditionCode";
+			}
+		}
+		if (!std::all_of(config.conditionTerms.begin(), config.conditionTerms.end(), [&](const Config::ConditionTerm& t) { return validOp(t.op); }))
+		{
+			return "conditionTerms";
+		}
+		for (const Config::IndicatorState& state : config.indicatorStates)
+		{
+			// States with a condition attribute have no op
+			if ((state.instructionCount == 0 && !validOp(state.op)) || state.sequence < -1 || (state.sequence >= 0 && static_cast<size_t>(state.sequence) >= config.sequences.size())
+				|| state.firstInstruction > config.conditionCode.size() || state.instructionCount > config.conditionCode.size() - state.firstInstruction)
+			{
+				return "indicatorStates";
+			}
+			// Conditions are evaluated on a fixed size stack, which must end with exactly one value
+			size_t depth = 0;
+			for (size_t c = state.firstInstruction; c < state.firstInstruction + state.instructionCount; c++)
+			{
+				switch (config.conditionCode[c].type) {
+				case Config::ConditionInstruction::Type::Test: depth++; break;
+				case Config::ConditionInstruction::Type::Not:  depth = depth >= 1 ? depth : Config::MAX_CONDITION_DEPTH + 1; break;
+				default:                                       depth = depth >= 2 ? depth - 1 : Config::MAX_CONDITION_DEPTH + 1; break;
+				}
+				if (depth > Config::MAX_CONDITION_DEPTH)
+				{
+					return "indicatorStates";
+				}
+			}
+			if (state.instructionCount > 0 && depth != 1)
+			{
+				return "indicatorStates";
+			}
+		}
+		for (const Config::IndicatorLed& led : config.indicatorLeds)
+		{
+			if (led.firstState > config.indicatorStates.size() || led.stateCount > config.indicatorStates.size() - led.firstState)
+			{
+				return "indicatorLeds";
+			}
+			for (size_t i = led.firstState; i < led.firstState + led.stateCount; i++)
+			{
+				int simresult = config.indicatorStates[i].simresult;
+				if (simresult < 0 || static_cast<size_t>(simresult) > led.stateCount)
+				{
+					return "indicatorLeds";
+				}
+			}
+		}
+		return nullptr;
+	}
+}
+
+ConfigCache::ConfigCache(const std::string& xmlfilename) : xmlFilename(xmlfilename), cacheFilename(xmlfilename + ".cache") {}
+
+uint64_t ConfigCache::fnv1a(const char* data, size_t size, uint64_t hash) {
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= static_cast<unsigned char>(data[i]);
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+bool ConfigCache::hash_xml() {
+	if (hashed)
+	{
+		return true;
+	}
+	std::ifstream file(xmlFilename, std::ios::binary);
+	if (!file)
+	{
+		return false;
+	}
+	uint64_t hash = 14695981039346656037ULL;
+	char buffer[65536];
+	while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0)
+	{
+		hash = fnv1a(buffer, static_cast<size_t>(file.gcount()), hash);
+	}
+	xmlHash = hash;
+	hashed = true;
+	return true;
+}
+
+std::string ConfigCache::serialize(const X52Config& config) {
+	CacheWriter writer;
+	transfer(writer, config);
+	return writer.data;
+}
+
+bool ConfigCache::deserialize(const char* data, size_t size, X52Config& config) {
+	CacheReader reader(data, size);
+	config = X52Config();
+	transfer(reader, config);
+	if (!reader.ok || !reader.at_end())
+	{
+		CLOG(DEBUG, "toconsole", "tofile") << "The compiled tables end unexpectedly.";
+		return false;
+	}
+	if (const char* table = invalid_table(config))
+	{
+		CLOG(DEBUG, "toconsole", "tofile") << "The compiled table " << table << " holds an invalid index.";
+		return false;
+	}
+	return true;
+}
+
+bool ConfigCache::load(X52Config& config) {
+	if (!hash_xml())
+	{
+		return false;
+	}
+	HANDLE file = CreateFileA(cacheFilename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		CLOG(DEBUG, "toconsole", "tofile") << "No cache file " << cacheFilename << " found.";
+		return false;
+	}
+	LARGE_INTEGER filesize;
+	if (!GetFileSizeEx(file, &filesize) || filesize.QuadPart < static_cast<LONGLONG>(sizeof(CacheHeader)))
+	{
+		CloseHandle(file);
+		CLOG(DEBUG, "toconsole", "tofile") << "Cache file " << cacheFilename << " is too short, ignoring it.";
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	const char* view = mapping != nullptr ? static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+	if (view == nullptr)
+	{
+		if (mapping != nullptr)
+		{
+			CloseHandle(mapping);
+		}
+		CloseHandle(file);
+		CLOG(WARNING, "toconsole", "tofile") << "Cannot map cache file " << cacheFilename << " into memory. Error code: " << GetLastError();
+		return false;
+	}
+	bool ok = false;
+	CacheHeader header;
+	std::memcpy(&header, view, sizeof(header));
+	if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || header.sizeSize != sizeof(size_t))
+	{
+		CLOG(DEBUG, "toconsole", "tofile") << "Cache file " << cacheFilename << " was written by another version of x52msfsout, ignoring it.";
+	}
+	else if (header.xmlHash != xmlHash)
+	{
+		CLOG(DEBUG, "toconsole", "tofile") << "XML file " << xmlFilename << " has changed since cache file " << cacheFilename << " was written, ignoring it.";
+	}
+	else if (header.payloadSize != static_cast<uint64_t>(filesize.QuadPart) - sizeof(CacheHeader))
+	{
+		CLOG(DEBUG, "toconsole", "tofile") << "Cache file " << cacheFilename << " is truncated, ignoring it.";
+	}
+	else if (header.payloadHash != fnv1a(view + sizeof(CacheHeader), static_cast<size_t>(header.payloadSize)))
+	{
+		CLOG(WARNING, "toconsole", "tofile") << "Cache file " << cacheFilename << " is damaged, ignoring it.";
+	}
+	else
+	{
+		ok = deserialize(view + sizeof(CacheHeader), static_cast<size_t>(header.payloadSize), config);
+		if (!ok)
+		{
+			CLOG(WARNING, "toconsole", "tofile") << "Cache file " << cacheFilename << " is corrupt, ignoring it.";
+		}
+	}
+	UnmapViewOfFile(view);
+	CloseHandle(mapping);
+	CloseHandle(file);
+	return ok;
+}
+
+bool ConfigCache::save(const X52Config& config) {
+	if (!hash_xml())
+	{
+		return false;
+	}
+	std::string payload = serialize(config);
+	CacheHeader header;
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.sizeSize = sizeof(size_t);
+	header.xmlHash = xmlHash;
+	header.payloadSize = payload.size();
+	header.payloadHash = fnv1a(payload.data(), payload.size());
+	// Write a temporary file first, so that a half-written cache file is never read
+	std::string tempFilename = cacheFilename + ".tmp";
+	{
+		std::ofstream file(tempFilename, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+		if (!file)
+		{
+			CLOG(WARNING, "toconsole", "tofile") << "Cannot write cache file " << tempFilename << ".";
+			return false;
+		}
+	}
+	std::remove(cacheFilename.c_str());
+	if (std::rename(tempFilename.c_str(), cacheFilename.c_str()) != 0)
+	{
+		CLOG(WARNING, "toconsole", "tofile") << "Cannot rename " << tempFilename << " to " << cacheFilename << ".";
+		std::remove(tempFilename.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,83 @@
+/*
+    Copyright (C) 2023  Csaba K Molnár
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstdint>
+#include <string>
+#include "X52Config.h"
+
+#ifndef CLASS_CONFIGCACHE_H
+#define CLASS_CONFIGCACHE_H
+
+/// <summary>
+/// Stores the compiled form of an XML configuration file in a binary file next to it, so that later runs
+/// can skip parsing and validating the XML. The cache file starts with a header holding a format version
+/// and the FNV-1a hashes of the XML file's content and of the cached tables. If any of them does not match,
+/// or a table holds an index out of range, the cache is ignored and the XML file is compiled again.
+/// The cache file is memory-mapped and read front to back. Strings and arrays are stored with their length
+/// in front, all numbers have a fixed size, so the file does not depend on the compiler's struct layout.
+/// </summary>
+class ConfigCache
+{
+// VARIABLES
+public:
+	/// <summary>
+	/// Increase this whenever a field of X52Config which is stored in the cache is added, removed or changes its meaning.
+	/// </summary>
+	static constexpr uint32_t VERSION = 9;
+private:
+	std::string xmlFilename;
+	std::string cacheFilename;
+	uint64_t xmlHash = 0;
+	bool hashed = false; // True if xmlHash holds the hash of the XML file
+
+// FUNCTIONS
+public:
+	/// <param name="xmlfilename">The XML configuration file. The cache file has the same name with ".cache" appended.</param>
+	ConfigCache(const std::string& xmlfilename);
+	/// <summary>
+	/// Loads the compiled configuration from the cache file if it was made from the current content of the XML file.
+	/// </summary>
+	/// <returns>False if there is no usable cache file. config may be partially filled in that case.</returns>
+	bool load(X52Config& config);
+	/// <summary>
+	/// Writes the compiled configuration to the cache file. Call it right after the XML file was compiled,
+	/// before data requests are registered.
+	/// </summary>
+	/// <returns>False if the cache file cannot be written.</returns>
+	bool save(const X52Config& config);
+	const std::string& get_cache_filename() const { return cacheFilename; }
+	/// <summary>
+	/// Returns the compiled tables of config in the format of the cache file, without the header.
+	/// </summary>
+	static std::string serialize(const X52Config& config);
+	/// <summary>
+	/// Reads compiled tables written by serialize() into config, and checks every index and enum they hold.
+	/// </summary>
+	/// <returns>False if the data is corrupt. config may be partially filled in that case.</returns>
+	static bool deserialize(const char* data, size_t size, X52Config& config);
+	/// <summary>
+	/// 64-bit FNV-1a hash.
+	/// </summary>
+	static uint64_t fnv1a(const char* data, size_t size, uint64_t hash = 14695981039346656037ULL);
+private:
+	/// <summary>
+	/// Reads the XML file and sets xmlHash.
+	/// </summary>
+	bool hash_xml();
+};
+
+#endif
@@ -0,0 +1,125 @@
+/*
+    Copyright (C) 2023  Csaba K Molnár
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+
+#include "IndicatorRequests.h"
+
+int IndicatorRequests::find(const std::string& dataref, const std::string& unit, uint8_t simvarindex) const {
+	if (count <= LINEAR_SEARCH_LIMIT) {
+		for (size_t id = 0; id < requests.size(); id++)
+		{
+			const std::optional<Request>& request = requests[id];
+			if (request && request->simvarindex == simvarindex && request->dataref == dataref && request->unit == unit) {
+				return static_cast<int>(id);
+			}
+		}
+		return 0;
+	}
+	std::optional<uint32_t> datarefName = interned(dataref);
+	std::optional<uint32_t> unitName = interned(unit);
+	if (!datarefName || !unitName) {
+		return 0;
+	}
+	auto it = requestIds.find(key(*datarefName, *unitName, simvarindex));
+	return it == requestIds.end() ? 0 : it->second;
+}
+
+int IndicatorRequests::add(Request&& request) {
+	if (requests.size() < static_cast<size_t>(FIRST_REQUEST_ID)) {
+		requests.resize(FIRST_REQUEST_ID);
+	}
+	int requestid = static_cast<int>(requests.size());
+	requests.emplace_back(std::move(request));
+	count++;
+	if (count == LINEAR_SEARCH_LIMIT + 1) {
+		// From now on find() uses the hash index
+		for (size_t id = 0; id < requests.size(); id++)
+		{
+			if (requests[id]) {
+				index(static_cast<int>(id));
+			}
+		}
+	}
+	else if (count > LINEAR_SEARCH_LIMIT) {
+		index(requestid);
+	}
+	return requestid;
+}
+
+void IndicatorRequests::renumber(const std::vector<int>& newIds) {
+	std::vector<std::optional<Request>> renumbered;
+	for (size_t id = 0; id < requests.size(); id++)
+	{
+		if (!requests[id]) {
+			continue;
+		}
+		if (renumbered.size() <= static_cast<size_t>(newIds[id])) {
+			renumbered.resize(newIds[id] + 1);
+		}
+		renumbered[newIds[id]] = std::move(requests[id]);
+	}
+	requests.swap(renumbered);
+	for (auto& [requestKey, requestid] : requestIds)
+	{
+		requestid = newIds[requestid];
+	}
+}
+
+void IndicatorRequests::clear() {
+	requests.clear();
+	count = 0;
+	names.clear();
+	requestIds.clear();
+}
+
+uint32_t IndicatorRequests::intern(const std::string& name) {
+	return names.try_emplace(name, static_cast<uint32_t>(names.size())).first->second;
+}
+
+std::optional<uint32_t> IndicatorRequests::interned(const std::string& name) const {
+	auto it = names.find(name);
+	if (it == names.end()) {
+		return std::nullopt;
+	}
+	return it->second;
+}
+
+void IndicatorRequests::index(int requestid) {
+	const Request& request = *requests[requestid];
+	requestIds[key(intern(request.dataref), intern(request.unit), request.simvarindex)] = requestid;
+}
+
+uint64_t IndicatorRequests::key(uint32_t dataref, uint32_t unit, uint8_t simvarindex) {
+	// 28 bits are more names than any configuration has
+	return (static_cast<uint64_t>(dataref) << 36) | (static_cast<uint64_t>(unit) << 8) | simvarindex;
+}
+
+std::vector<int> RequestIdDirectory::assign(const IndicatorRequests& requests) {
+	std::vector<int> newIds(requests.end_id(), 0);
+	requests.for_each([this, &newIds](int requestid, const IndicatorRequests::Request& request) {
+		// The delta is compared exactly, like the other fields
+		std::string identity = request.dataref + '\n' + request.unit + '\n' + std::to_string(request.simvarindex) + '\n'
+			+ std::string(reinterpret_cast<const char*>(&request.delta), sizeof(request.delta)) + request.calculatorcode;
+		auto [it, added] = requestIds.try_emplace(std::move(identity), nextId);
+		if (added) {
+			nextId++;
+		}
+		newIds[requestid] = it->second;
+	});
+	return newIds;
+}
@@ -0,0 +1,150 @@
+/*
+    Copyright (C) 2023  Csaba K Molnár
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "TrendBuffer.h"
+
+#ifndef CLASS_INDICATORREQUESTS_H
+#define CLASS_INDICATORREQUESTS_H
+
+/// <summary>
+/// The WASim data requests of the indicators, stored in a dense vector indexed by RequestID.
+/// Looking up a request by the RequestID of a WASim notification is a single array access.
+/// Requests are found by their dataref, unit and SimVar index through a hash of interned names,
+/// so that states reading the same SimVar share one request without comparing strings.
+/// Up to LINEAR_SEARCH_LIMIT requests, they are searched one by one instead, which is faster for so few.
+/// </summary>
+class IndicatorRequests
+{
+// VARIABLES
+public:
+	struct Request {
+		std::string dataref;
+		std::string unit;
+		uint8_t simvarindex = 0;
+		float delta = 0.0f;
+		std::string calculatorcode; // If not empty, MSFS evaluates this calculator code and sends us its result instead of the SimVar's value
+		double value = 0;
+		bool received = false; // True once WASim has sent a value
+		bool trend = false;   // True if a trend op reads this request, so that its samples are kept in history
+		TrendBuffer history;  // Recent samples, protected by X52::indicatorMutex
+	};
+	/// <summary>
+	/// The lowest RequestID. 0 means that a state has no request.
+	/// </summary>
+	static constexpr int FIRST_REQUEST_ID = 1;
+	/// <summary>
+	/// How often WASim checks each request for a new value.
+	/// </summary>
+	static constexpr uint32_t INTERVAL_MS = 50;
+	/// <summary>
+	/// Up to this many requests, find() compares the names of every request. Interning names and hashing only pay off for more,
+	/// so the hash index is built when the request after this one is added.
+	/// </summary>
+	static constexpr size_t LINEAR_SEARCH_LIMIT = 64;
+private:
+	std::vector<std::optional<Request>> requests; // Indexed by RequestID
+	size_t count = 0;
+	std::unordered_map<std::string, uint32_t> names; // Interned datarefs and units
+	std::unordered_map<uint64_t, int> requestIds;   // Interned dataref, unit and SimVar index to RequestID. Empty up to LINEAR_SEARCH_LIMIT requests.
+
+// FUNCTIONS
+public:
+	/// <summary>
+	/// Returns the request with the given RequestID, or nullptr if there is none.
+	/// </summary>
+	Request* find(int requestid) {
+		return requestid >= 0 && static_cast<size_t>(requestid) < requests.size() && requests[requestid] ? &*requests[requestid] : nullptr;
+	}
+	const Request* find(int requestid) const {
+		return const_cast<IndicatorRequests*>(this)->find(requestid);
+	}
+	/// <summary>
+	/// Returns the RequestID of the request for this dataref, unit and SimVar index, or 0 if there is none.
+	/// </summary>
+	int find(const std::string& dataref, const std::string& unit, uint8_t simvarindex) const;
+	/// <summary>
+	/// Adds a request with the next free RequestID and returns the RequestID.
+	/// The dataref, unit and SimVar index of the request must not be used by another request.
+	/// </summary>
+	int add(Request&& request);
+	bool contains(int requestid) const { return find(requestid) != nullptr; }
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	/// <summary>
+	/// One more than the highest RequestID, the size of vectors indexed by RequestID.
+	/// </summary>
+	size_t end_id() const { return requests.size(); }
+	/// <summary>
+	/// Moves each request to the RequestID given for it, for example by RequestIdDirectory::assign().
+	/// </summary>
+	/// <param name="newIds">The new RequestID of each request, indexed by its current RequestID.</param>
+	void renumber(const std::vector<int>& newIds);
+	/// <summary>
+	/// Calls function with the RequestID and the request of every request, in the order of RequestIDs.
+	/// </summary>
+	template <typename Function>
+	void for_each(Function function) {
+		for (size_t id = 0; id < requests.size(); id++) {
+			if (requests[id]) {
+				function(static_cast<int>(id), *requests[id]);
+			}
+		}
+	}
+	template <typename Function>
+	void for_each(Function function) const {
+		for (size_t id = 0; id < requests.size(); id++) {
+			if (requests[id]) {
+				function(static_cast<int>(id), *requests[id]);
+			}
+		}
+	}
+	void clear();
+private:
+	uint32_t intern(const std::string& name);
+	std::optional<uint32_t> interned(const std::string& name) const;
+	void index(int requestid);
+	static uint64_t key(uint32_t dataref, uint32_t unit, uint8_t simvarindex);
+};
+
+/// <summary>
+/// Gives identical requests the same RequestID in the registries of all profiles, and every other request a RequestID
+/// which no request had before. Switching profiles then only registers and removes the requests which differ, and a late
+/// notification of a removed request can not be mistaken for another request. RequestIDs are never reused while x52msfsout runs.
+/// </summary>
+class RequestIdDirectory
+{
+// VARIABLES
+private:
+	std::unordered_map<std::string, int> requestIds; // The dataref, unit, SimVar index, delta and calculator code of each request
+	int nextId = IndicatorRequests::FIRST_REQUEST_ID;
+
+// FUNCTIONS
+public:
+	/// <summary>
+	/// Finds the RequestID of each request in requests, or assigns a new one.
+	/// </summary>
+	/// <returns>The RequestID of each request, indexed by its RequestID in requests, for IndicatorRequests::renumber().</returns>
+	std::vector<int> assign(const IndicatorRequests& requests);
+};
+
+#endif
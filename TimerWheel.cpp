@@ -0,0 +1,151 @@
+/*
+    Copyright (C) 2023  Csaba K Molnár
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "TimerWheel.h"
+#include <algorithm>
+
+TimerWheel::TimerWheel(std::chrono::milliseconds resolution, size_t slotCount) : resolution(resolution), slots(slotCount) {
+}
+
+uint64_t TimerWheel::tick(Clock::time_point now) {
+	if (!hasOrigin)
+	{
+		origin = now;
+		hasOrigin = true;
+	}
+	if (now <= origin)
+	{
+		return 0;
+	}
+	return static_cast<uint64_t>((now - origin) / resolution);
+}
+
+TimerWheel::TimerId TimerWheel::start(Clock::time_point now, std::chrono::milliseconds delay, std::chrono::milliseconds interval, size_t key) {
+	uint32_t index;
+	if (freeTimers.empty())
+	{
+		index = static_cast<uint32_t>(timers.size());
+		timers.emplace_back();
+	}
+	else
+	{
+		index = freeTimers.back();
+		freeTimers.pop_back();
+	}
+	Timer& timer = timers[index];
+	// Round the deadline up to the next tick, so a timer never fires early
+	tick(now);
+	Clock::duration due = (now > origin ? now - origin : Clock::duration::zero()) + delay;
+	uint64_t deadline = static_cast<uint64_t>(due / resolution) + (due % resolution != Clock::duration::zero() ? 1 : 0);
+	timer.deadline = std::max(deadline, processedTick + 1);
+	timer.interval = interval.count() > 0 ? std::max<uint64_t>(1, (interval.count() + resolution.count() / 2) / resolution.count()) : 0;
+	timer.key = key;
+	timer.active = true;
+	activeCount++;
+	schedule(index);
+	return (static_cast<TimerId>(timer.generation) << 32) | (index + 1);
+}
+
+void TimerWheel::cancel(TimerId id) {
+	uint32_t index = static_cast<uint32_t>(id & 0xffffffff);
+	if (index == 0 || index > timers.size())
+	{
+		return;
+	}
+	index--;
+	if (timers[index].active && timers[index].generation == static_cast<uint32_t>(id >> 32))
+	{
+		// The slot entry is removed when its slot is processed
+		free_timer(index);
+	}
+}
+
+void TimerWheel::clear() {
+	for (uint32_t i = 0; i < timers.size(); i++)
+	{
+		if (timers[i].active)
+		{
+			free_timer(i);
+		}
+	}
+	for (std::vector<SlotEntry>& slot : slots)
+	{
+		slot.clear();
+	}
+}
+
+const std::vector<size_t>& TimerWheel::advance(Clock::time_point now) {
+	expired.clear();
+	uint64_t nowTick = tick(now);
+	if (activeCount == 0)
+	{
+		processedTick = std::max(processedTick, nowTick);
+		return expired;
+	}
+	// Each slot needs to be processed only once, even if advance() was not called for more than one turn of the wheel
+	uint64_t first = std::max(processedTick + 1, nowTick >= slots.size() ? nowTick - slots.size() + 1 : 0);
+	for (uint64_t t = first; t <= nowTick; t++)
+	{
+		std::vector<SlotEntry>& slot = slots[t % slots.size()];
+		for (size_t i = 0; i < slot.size();)
+		{
+			SlotEntry entry = slot[i];
+			Timer& timer = timers[entry.timer];
+			bool stale = !timer.active || timer.generation != entry.generation;
+			if (!stale && timer.deadline > nowTick)
+			{
+				// Due in a later turn of the wheel
+				i++;
+				continue;
+			}
+			slot[i] = slot.back();
+			slot.pop_back();
+			if (stale)
+			{
+				continue;
+			}
+			expired.push_back(timer.key);
+			if (timer.interval == 0)
+			{
+				free_timer(entry.timer);
+				continue;
+			}
+			timer.deadline += timer.interval;
+			if (timer.deadline <= nowTick)
+			{
+				timer.deadline += (nowTick - timer.deadline) / timer.interval * timer.interval + timer.interval;
+			}
+			// The new deadline is after nowTick, so the timer cannot fire again in this call
+			schedule(entry.timer);
+		}
+	}
+	processedTick = std::max(processedTick, nowTick);
+	return expired;
+}
+
+void TimerWheel::schedule(uint32_t index) {
+	const Timer& timer = timers[index];
+	slots[timer.deadline % slots.size()].push_back({ index, timer.generation });
+}
+
+void TimerWheel::free_timer(uint32_t index) {
+	Timer& timer = timers[index];
+	timer.active = false;
+	timer.generation++;
+	activeCount--;
+	freeTimers.push_back(index);
+}
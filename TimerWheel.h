@@ -0,0 +1,99 @@
+/*
+    Copyright (C) 2023  Csaba K Molnár
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#ifndef CLASS_TIMERWHEEL_H
+#define CLASS_TIMERWHEEL_H
+
+/// <summary>
+/// A hashed timer wheel for one-shot and periodic timers, like the repeats of repeater buttons. Deadlines are counted in
+/// ticks of a fixed resolution, and a timer is kept in the slot of its deadline tick modulo the number of slots, so starting,
+/// cancelling and firing a timer cost O(1) no matter how many timers run. The wheel does not read a clock: the current time
+/// is passed to start() and advance(), so its timing can be tested with any sequence of time points.
+/// </summary>
+class TimerWheel
+{
+// VARIABLES
+public:
+	using Clock = std::chrono::steady_clock;
+	/// <summary>
+	/// Identifies a started timer. Ids are never 0, so 0 can be used for no timer.
+	/// </summary>
+	using TimerId = uint64_t;
+private:
+	struct Timer {
+		uint64_t deadline = 0; // Tick at which the timer fires next
+		uint64_t interval = 0; // Ticks between two firings, 0 for a one-shot timer
+		size_t key = 0;
+		uint32_t generation = 0; // Incremented whenever the timer is freed, so stale ids and slot entries are ignored
+		bool active = false;
+	};
+	struct SlotEntry {
+		uint32_t timer;
+		uint32_t generation;
+	};
+	std::chrono::milliseconds resolution;
+	std::vector<Timer> timers;
+	std::vector<uint32_t> freeTimers;
+	std::vector<std::vector<SlotEntry>> slots;
+	std::vector<size_t> expired;
+	Clock::time_point origin; // Time of tick 0, set by the first call of start() or advance()
+	bool hasOrigin = false;
+	uint64_t processedTick = 0; // All slots up to this tick were processed
+	size_t activeCount = 0;
+
+// FUNCTIONS
+public:
+	/// <param name="resolution">Duration of one tick. A timer fires in the first advance() at or after its deadline rounded up to a tick.</param>
+	/// <param name="slotCount">Number of slots. Timers further ahead than one turn of the wheel share slots with earlier ones.</param>
+	TimerWheel(std::chrono::milliseconds resolution = std::chrono::milliseconds(10), size_t slotCount = 256);
+	/// <summary>
+	/// Starts a timer which fires after delay, then every interval if interval is not 0. The deadlines of a periodic timer are
+	/// counted from its first deadline, not from when it was processed, so a late advance() does not shift the following ones.
+	/// The interval is rounded to whole ticks.
+	/// </summary>
+	/// <param name="key">Returned by advance() when the timer fires.</param>
+	TimerId start(Clock::time_point now, std::chrono::milliseconds delay, std::chrono::milliseconds interval, size_t key);
+	/// <summary>
+	/// Stops a timer. Ids of timers which have already stopped are ignored.
+	/// </summary>
+	void cancel(TimerId id);
+	/// <summary>
+	/// Stops all timers.
+	/// </summary>
+	void clear();
+	/// <summary>
+	/// Processes the ticks up to now and returns the keys of the timers which fired. Timers whose deadline is in an earlier
+	/// tick come first.
+	/// A periodic timer fires at most once per call: deadlines which were missed because advance() was called late are skipped.
+	/// The returned vector is valid until the next call.
+	/// </summary>
+	const std::vector<size_t>& advance(Clock::time_point now);
+	/// <summary>
+	/// Returns the number of running timers.
+	/// </summary>
+	size_t size() const { return activeCount; }
+private:
+	uint64_t tick(Clock::time_point now);
+	void schedule(uint32_t timer);
+	void free_timer(uint32_t timer);
+};
+
+#endif
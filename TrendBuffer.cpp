@@ -0,0 +1,66 @@
+/*
+    Copyright (C) 2023  Csaba K Molnár
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "TrendBuffer.h"
+
+void TrendBuffer::push(Clock::time_point time, double value) {
+	if (samples.empty()) {
+		samples.resize(CAPACITY);
+	}
+	if (pushed > 0 && sample(pushed - 1).value != value) {
+		lastChange = time;
+		hasChanged = true;
+	}
+	samples[pushed % CAPACITY] = { time, value };
+	pushed++;
+	// The reference sample may have been overwritten
+	if (pushed - reference > CAPACITY) {
+		reference = pushed - CAPACITY;
+	}
+}
+
+double TrendBuffer::rate(Clock::time_point now) {
+	if (pushed < 2) {
+		return 0;
+	}
+	Clock::time_point windowStart = now - RATE_WINDOW;
+	while (reference + 1 < pushed && sample(reference + 1).time <= windowStart) {
+		reference++;
+	}
+	const Sample& newest = sample(pushed - 1);
+	const Sample& oldest = sample(reference);
+	if (oldest.time <= windowStart) {
+		// The value at the start of the window is the value of the reference sample
+		return (newest.value - oldest.value) / std::chrono::duration<double>(RATE_WINDOW).count();
+	}
+	// The history is shorter than the window
+	double seconds = std::chrono::duration<double>(now - oldest.time).count();
+	if (seconds <= 0) {
+		return 0;
+	}
+	return (newest.value - oldest.value) / seconds;
+}
+
+bool TrendBuffer::changed_within(Clock::time_point now, std::chrono::milliseconds window) const {
+	return hasChanged && now - lastChange <= window;
+}
+
+void TrendBuffer::clear() {
+	pushed = 0;
+	reference = 0;
+	hasChanged = false;
+}
@@ -0,0 +1,77 @@
+/*
+    Copyright (C) 2023  Csaba K Molnár
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#ifndef CLASS_TRENDBUFFER_H
+#define CLASS_TRENDBUFFER_H
+
+/// <summary>
+/// A fixed-size ring buffer of timestamped samples of one data request. Used by the trend ops,
+/// which depend on how a SimVar has changed over time rather than on its current value.
+/// Samples only arrive when the value changes, so the value is assumed to stay constant between samples.
+/// The samples are allocated once, by the first push(), so that the many requests which no trend op reads stay small.
+/// </summary>
+class TrendBuffer
+{
+// VARIABLES
+public:
+	using Clock = std::chrono::steady_clock;
+	/// <summary>
+	/// Number of samples kept. WASim sends at most 20 samples per second for our requests,
+	/// so this covers the rate window even when the value changes constantly.
+	/// </summary>
+	static constexpr size_t CAPACITY = 32;
+	/// <summary>
+	/// The rate of change is measured over this window.
+	/// </summary>
+	static constexpr std::chrono::milliseconds RATE_WINDOW{ 1000 };
+private:
+	struct Sample {
+		Clock::time_point time;
+		double value = 0;
+	};
+	std::vector<Sample> samples; // CAPACITY samples once the first one is pushed
+	uint64_t pushed = 0;    // Total number of samples pushed. Sample n is stored at samples[n % CAPACITY].
+	uint64_t reference = 0; // The newest sample which is at least RATE_WINDOW old when rate() was last called
+	Clock::time_point lastChange;
+	bool hasChanged = false;
+
+// FUNCTIONS
+public:
+	/// <summary>
+	/// Stores a new sample, overwriting the oldest one when the buffer is full.
+	/// </summary>
+	void push(Clock::time_point time, double value);
+	/// <summary>
+	/// Returns the rate of change in units per second over the last RATE_WINDOW, or over the
+	/// available history if it is shorter. The reference sample only moves forward, so each
+	/// sample is stepped over at most once.
+	/// </summary>
+	double rate(Clock::time_point now);
+	/// <summary>
+	/// Returns true if the value has changed within the given time before now.
+	/// </summary>
+	bool changed_within(Clock::time_point now, std::chrono::milliseconds window) const;
+	void clear();
+private:
+	const Sample& sample(uint64_t n) const { return samples[n % CAPACITY]; }
+};
+
+#endif
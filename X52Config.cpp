@@ -0,0 +1,1299 @@
+/*
+    Copyright (C) 2023  Csaba K Molnár
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "X52Config.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <fstream>
+#include <sstream>
+#include <tuple>
+#include <unordered_set>
+
+// https://fmt.dev/latest/index.html
+#define FMT_HEADER_ONLY
+#include <fmt/core.h>
+
+#define WSMCMND_API_STATIC
+#include <client/WASimClient.h>
+
+namespace {
+	/// <summary>
+	/// Returns "Line n: " to start error messages about a tag, or an empty string if the line is not known.
+	/// </summary>
+	std::string location(const XmlElement& element) {
+		return element.line > 0 ? fmt::format("Line {}: ", element.line) : "";
+	}
+
+	/// <summary>
+	/// Formats a number for MSFS calculator code, which does not accept exponents like 1e+20.
+	/// Fixed notation with 6 decimals, without trailing zeros.
+	/// </summary>
+	std::string rpn_number(double value) {
+		std::string s = fmt::format("{:.6f}", value);
+		s.erase(s.find_last_not_of('0') + 1);
+		if (s.back() == '.') {
+			s.pop_back();
+		}
+		return s == "-0" ? "0" : s;
+	}
+
+	bool required_attribute(const XmlElement& element, const char* attribute, std::string& value) {
+		const std::string* found = element.find(attribute);
+		if (found == nullptr)
+		{
+			CLOG(ERROR, "toconsole", "tofile") << location(element) << "The " << element.name << " tag has no " << attribute << " attribute.";
+			return false;
+		}
+		value = *found;
+		return true;
+	}
+
+	/// <summary>
+	/// Converts an attribute to a number the same way as boost::property_tree does, using the global locale.
+	/// If the attribute is missing, value is not changed.
+	/// </summary>
+	/// <returns>False if the attribute cannot be converted, or it is missing and required.</returns>
+	template <typename T>
+	bool number_attribute(const XmlElement& element, const char* attribute, T& value, bool required = false) {
+		const std::string* found = element.find(attribute);
+		if (found == nullptr)
+		{
+			if (required)
+			{
+				CLOG(ERROR, "toconsole", "tofile") << location(element) << "The " << element.name << " tag has no " << attribute << " attribute.";
+				return false;
+			}
+			return true;
+		}
+		std::istringstream iss(*found);
+		iss.imbue(std::locale());
+		T result;
+		iss >> result;
+		if (iss.fail() || (!iss.eof() && (iss >> std::ws, !iss.eof())))
+		{
+			CLOG(ERROR, "toconsole", "tofile") << location(element) << "Could not convert the " << attribute << " attribute \"" << *found << "\" of the " << element.name << " tag to a number. Check if the decimal separator is correct for your locale.";
+			return false;
+		}
+		value = result;
+		return true;
+	}
+
+	bool bool_attribute(const XmlElement& element, const char* attribute, bool& value) {
+		const std::string* found = element.find(attribute);
+		if (found == nullptr)
+		{
+			return true;
+		}
+		if (*found == "true" || *found == "1")
+		{
+			value = true;
+		}
+		else if (*found == "false" || *found == "0")
+		{
+			value = false;
+		}
+		else
+		{
+			CLOG(ERROR, "toconsole", "tofile") << location(element) << "The " << attribute << " attribute of the " << element.name << " tag must be true or false, not \"" << *found << "\".";
+			return false;
+		}
+		return true;
+	}
+}
+
+bool X52Config::load(const std::string& filename) {
+	std::ifstream file(filename, std::ios::binary);
+	if (!file)
+	{
+		CLOG(ERROR, "toconsole", "tofile") << "Cannot open XML file " << filename << ".";
+		return false;
+	}
+	XmlReader reader;
+	begin();
+	return reader.read(file, *this) && finish();
+}
+
+bool X52Config::compile(const boost::property_tree::ptree& xml_file) {
+	begin();
+	return walk(xml_file) && finish();
+}
+
+bool X52Config::walk(const boost::property_tree::ptree& xmltree) {
+	XmlElement element;
+	for (const boost::property_tree::ptree::value_type& v : xmltree)
+	{
+		if (v.first == "<xmlattr>" || v.first == "<xmlcomment>" || v.first == "<xmltext>")
+		{
+			continue;
+		}
+		element.name = v.first;
+		element.attributes.clear();
+		if (auto attributes = v.second.get_child_optional("<xmlattr>"))
+		{
+			for (const boost::property_tree::ptree::value_type& a : *attributes)
+			{
+				element.attributes.emplace_back(a.first, a.second.data());
+			}
+		}
+		if (!start_element(element) || !walk(v.second) || !end_element(v.first))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void X52Config::begin() {
+	masterTargets.clear();
+	shiftStates.clear();
+	buttonActions.clear();
+	assignmentButtons.clear();
+	shiftStateNames.clear();
+	buttonDispatch.clear();
+	buttonTags.clear();
+	clientEvents.clear();
+	chords.clear();
+	chordDispatch.clear();
+	longPressButtons = 0;
+	doublePressButtons = 0;
+	chordButtons = 0;
+	longPressTime = 500;
+	doublePressTime = 300;
+	chordTime = 50;
+	shiftRules.clear();
+	shiftButtonMask = 0;
+	bucketRequests = false;
+	aircraftTitles.clear();
+	sequences.clear();
+	indicatorStates.clear();
+	indicatorLeds.clear();
+	conditionTerms.clear();
+	conditionCode.clear();
+	openElements.clear();
+	openStates.clear();
+	openShiftStates.clear();
+}
+
+bool X52Config::finish() {
+	// Sequences can be defined after the leds which use them
+	for (IndicatorState& state : indicatorStates)
+	{
+		state.sequence = find_sequence(state.light);
+	}
+	// Shifted buttons can be defined before the shift_state tags they use
+	for (ShiftState& state : shiftStates)
+	{
+		state.id = shift_state_id(state.name);
+		if (state.id == 0)
+		{
+			shiftStateNames.push_back(state.name);
+			state.id = static_cast<int>(shiftStateNames.size());
+		}
+	}
+	compileShiftRules(0, shiftStates.size(), 0);
+	std::unordered_set<std::string> commands;
+	for (const ButtonAction& action : buttonActions)
+	{
+		if (action.kind == ButtonAction::Kind::Command && commands.insert(action.command).second)
+		{
+			clientEvents.push_back(action.command);
+		}
+	}
+	// Resolve once which action each button executes in each shift state, so a button press is two array lookups
+	size_t columns = shiftStateNames.size() + 1;
+	buttonDispatch.assign(GESTURE_COUNT * BUTTON_COUNT * columns, -1);
+	buttonTags.assign(BUTTON_COUNT, -1);
+	for (const AssignmentButton& button : assignmentButtons)
+	{
+		if (button.chordMask != 0)
+		{
+			chords.push_back(button.chordMask);
+			chordDispatch.resize(chords.size() * columns);
+			fill_dispatch_row(&chordDispatch[(chords.size() - 1) * columns], button);
+			chordButtons |= button.chordMask;
+			continue;
+		}
+		if (button.nr < 1 || button.nr > BUTTON_COUNT)
+		{
+			continue;
+		}
+		int32_t* row = &buttonDispatch[(static_cast<size_t>(button.gesture) * BUTTON_COUNT + button.nr - 1) * columns];
+		// Like before, only the first button tag of a button and gesture is used
+		if (row[0] >= 0)
+		{
+			continue;
+		}
+		fill_dispatch_row(row, button);
+		uint64_t bit = uint64_t(1) << (button.nr - 1);
+		if (button.gesture == Gesture::Short)
+		{
+			buttonTags[button.nr - 1] = static_cast<int32_t>(button.action);
+		}
+		else if (button.gesture == Gesture::Long)
+		{
+			longPressButtons |= bit;
+		}
+		else
+		{
+			doublePressButtons |= bit;
+		}
+	}
+	return true;
+}
+
+bool X52Config::start_element(const XmlElement& element) {
+	bool ok = true;
+	size_t depth = openElements.size();
+	// Tags not listed here are ignored, like the mfd tag
+	if (depth == 0)
+	{
+		if (element.name == "indicators")
+		{
+			ok = bool_attribute(element, "bucket_requests", bucketRequests);
+		}
+		else if (element.name == "assignments")
+		{
+			ok = number_attribute(element, "long_press_time", longPressTime) && number_attribute(element, "double_press_time", doublePressTime) &&
+				number_attribute(element, "chord_time", chordTime);
+			if (ok && (longPressTime < 10 || doublePressTime < 10 || chordTime < 10))
+			{
+				CLOG(ERROR, "toconsole", "tofile") << location(element) << "The long_press_time, double_press_time and chord_time attributes of the assignments tag must be at least 10 ms.";
+				ok = false;
+			}
+		}
+		else if (element.name == "aircraft")
+		{
+			std::string title;
+			ok = required_attribute(element, "title", title);
+			aircraftTitles.push_back(title);
+		}
+	}
+	else if (openElements[0] == "master")
+	{
+		if (depth == 1 && element.name == "target")
+		{
+			ok = compileMasterTarget(element);
+		}
+	}
+	else if (openElements[0] == "sequences")
+	{
+		if (depth == 1 && element.name == "sequence")
+		{
+			ok = compileSequence(element);
+		}
+		else if (depth == 1)
+		{
+			CLOG(ERROR,"toconsole", "tofile") << location(element) << "The sequences tag contains a <" << element.name << "> tag. It can only contain sequence tags.";
+			ok = false;
+		}
+	}
+	else if (openElements[0] == "shift_states")
+	{
+		// shift_state tags can be nested
+		if (element.name == "shift_state" && std::all_of(openElements.begin() + 1, openElements.end(), [](const std::string& name) { return name == "shift_state"; }))
+		{
+			ok = compileShiftState(element);
+		}
+	}
+	else if (openElements[0] == "assignments")
+	{
+		if (depth == 1 && element.name == "button")
+		{
+			ok = compileButton(element);
+		}
+		else if (depth == 1 && element.name == "chord")
+		{
+			ok = compileChord(element);
+		}
+		else if (depth == 2 && (openElements[1] == "button" || openElements[1] == "chord") && element.name == "shifted_button")
+		{
+			ok = compileShiftedButton(element);
+		}
+	}
+	else if (openElements[0] == "indicators")
+	{
+		if (depth == 1 && element.name == "led")
+		{
+			ok = compileLed(element);
+		}
+		// state tags can be nested
+		else if (depth >= 2 && openElements[1] == "led" && element.name == "state" && std::all_of(openElements.begin() + 2, openElements.end(), [](const std::string& name) { return name == "state"; }))
+		{
+			ok = compileState(element);
+		}
+	}
+	openElements.push_back(element.name);
+	return ok;
+}
+
+bool X52Config::end_element(const std::string& name) {
+	openElements.pop_back();
+	size_t depth = openElements.size();
+	if (depth == 0)
+	{
+		return true;
+	}
+	if (openElements[0] == "shift_states" && name == "shift_state" && !openShiftStates.empty())
+	{
+		size_t index = openShiftStates.back();
+		openShiftStates.pop_back();
+		shiftStates[index].subtreeSize = shiftStates.size() - index;
+	}
+	else if (openElements[0] == "indicators" && depth >= 2 && openElements[1] == "led" && name == "state" && !openStates.empty())
+	{
+		// Nested states were closed before, so they come first
+		indicatorStates.push_back(std::move(openStates.back()));
+		openStates.pop_back();
+	}
+	else if (openElements[0] == "indicators" && depth == 1 && name == "led")
+	{
+		return finishLed();
+	}
+	return true;
+}
+
+namespace {
+	/// <summary>
+	/// Linear units which can be converted to another unit of the same quantity.
+	/// Unit names are compared in lower case, like MSFS does.
+	/// Bool and number are not listed: MSFS turns any nonzero value into 1 in bool, so bool is not a factor of number,
+	/// and a value received in bool cannot be converted back to number.
+	/// </summary>
+	struct UnitConversion {
+		const char* unit;
+		const char* canonical;
+		double factor; // value in canonical unit = value in unit * factor
+	};
+	const UnitConversion UNIT_CONVERSIONS[] = {
+		{ "percent",               "percent", 1.0 },
+		{ "percentage",            "percent", 1.0 },
+		{ "percent over 100",      "percent", 100.0 },
+		{ "radians",               "radians", 1.0 },
+		{ "radian",                "radians", 1.0 },
+		{ "degrees",               "radians", 3.14159265358979323846 / 180.0 },
+		{ "degree",                "radians", 3.14159265358979323846 / 180.0 },
+		{ "feet",                  "feet", 1.0 },
+		{ "foot",                  "feet", 1.0 },
+		{ "ft",                    "feet", 1.0 },
+		{ "meters",                "feet", 1.0 / 0.3048 },
+		{ "meter",                 "feet", 1.0 / 0.3048 },
+		{ "m",                     "feet", 1.0 / 0.3048 },
+		{ "knots",                 "knots", 1.0 },
+		{ "knot",                  "knots", 1.0 },
+		{ "kt",                    "knots", 1.0 },
+		{ "meters per second",     "knots", 3600.0 / 1852.0 },
+		{ "meter per second",      "knots", 3600.0 / 1852.0 },
+		{ "m/s",                   "knots", 3600.0 / 1852.0 },
+	};
+}
+
+double X52Config::to_canonical_unit(std::string& unit) {
+	std::string lower;
+	lower.reserve(unit.size());
+	for (char c : unit)
+	{
+		lower += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+	}
+	for (const UnitConversion& conversion : UNIT_CONVERSIONS)
+	{
+		if (lower == conversion.unit)
+		{
+			unit = conversion.canonical;
+			return conversion.factor;
+		}
+	}
+	return 1.0;
+}
+
+X52Config::XmlOp X52Config::parse_xml_op(const std::string& op) {
+	XmlOp result;
+	if (op.size() < 3)
+	{
+		return result;
+	}
+	std::string_view oper(op.data(), 2);
+	std::string operands = op.substr(2);
+	size_t separatorpos = operands.find(':');
+	try
+	{
+		// The whole operand must be a number, so >=5abc is invalid instead of >=5
+		std::string operand = operands.substr(0, separatorpos);
+		size_t pos = 0;
+		result.operand = std::stod(operand, &pos);
+		if (pos != operand.size())
+		{
+			return result;
+		}
+		if (separatorpos != std::string::npos)
+		{
+			std::string operand2 = operands.substr(separatorpos + 1);
+			result.operand2 = std::stod(operand2, &pos);
+			if (pos != operand2.size())
+			{
+				return result;
+			}
+		}
+	}
+	catch (const std::exception&)
+	{
+		return result;
+	}
+	// Only ranges and epsilon-equality have a second operand
+	if (separatorpos != std::string::npos && oper != "[]" && oper != "~=")
+	{
+		return result;
+	}
+	if (oper == "==") {
+		result.type = XmlOp::Type::Equal;
+	} else if (oper == "--") {
+		result.type = XmlOp::Type::Less;
+	} else if (oper == "++") {
+		result.type = XmlOp::Type::Greater;
+	} else if (oper == ">=") {
+		result.type = XmlOp::Type::GreaterOrEqual;
+	} else if (oper == "<=") {
+		result.type = XmlOp::Type::LessOrEqual;
+	} else if (oper == "!=") {
+		result.type = XmlOp::Type::NotEqual;
+	} else if (oper == "[]") {
+		if (separatorpos != std::string::npos && result.operand <= result.operand2) {
+			result.type = XmlOp::Type::Range;
+		}
+	} else if (oper == "~=") {
+		if (separatorpos == std::string::npos) {
+			result.operand2 = 0.0001; // Default epsilon
+		}
+		if (result.operand2 >= 0) {
+			result.type = XmlOp::Type::NearlyEqual;
+		}
+	} else if (oper == "##") {
+		if (result.operand >= 0 && result.operand < XmlOp::BITS_MASK_LIMIT && result.operand == std::floor(result.operand)) {
+			result.type = XmlOp::Type::BitsSet;
+		}
+	} else if (oper == "/+") {
+		if (result.operand >= 0) {
+			result.type = XmlOp::Type::RisingFaster;
+		}
+	} else if (oper == "/-") {
+		if (result.operand >= 0) {
+			result.type = XmlOp::Type::FallingFaster;
+		}
+	} else if (oper == "@@") {
+		if (result.operand > 0) {
+			result.type = XmlOp::Type::ChangedWithin;
+		}
+	}
+	return result;
+}
+
+std::string X52Config::XmlOp::to_rpn(const std::string& value) const {
+	// fmt formats numbers independently of the locale, MSFS always expects a decimal point
+	std::string a = rpn_number(operand);
+	std::string b = rpn_number(operand2);
+	switch (type) {
+	case Type::Equal:          return fmt::format("{} {} ==", value, a);
+	case Type::Less:           return fmt::format("{} {} <", value, a);
+	case Type::Greater:        return fmt::format("{} {} >", value, a);
+	case Type::GreaterOrEqual: return fmt::format("{} {} >=", value, a);
+	case Type::LessOrEqual:    return fmt::format("{} {} <=", value, a);
+	case Type::NotEqual:       return fmt::format("{} {} !=", value, a);
+	case Type::Range:          return fmt::format("{0} {1} >= {0} {2} <= and", value, a, b);
+	case Type::NearlyEqual:    return fmt::format("{} {} - abs {} <=", value, a, b);
+	case Type::BitsSet:        return fmt::format("{} flr {} & {} ==", value, a, a);
+	case Type::RisingFaster:
+	case Type::FallingFaster:
+	case Type::ChangedWithin:  return ""; // MSFS does not keep the history of a value
+	default:                   return "0";
+	}
+}
+
+std::string X52Config::bucket_calculator_code(const std::string& dataref, const std::string& unit, uint8_t simvarindex, const std::vector<XmlOp>& ops) {
+	if (ops.empty() || ops.size() > MAX_BUCKET_OPS)
+	{
+		return "";
+	}
+	// Read the SimVar once into register 0
+	std::string code = "(A:" + dataref;
+	if (simvarindex != 0)
+	{
+		code += ":" + std::to_string(simvarindex);
+	}
+	code += ", " + unit + ") sp0";
+	// Add up 2^i for each true op
+	for (size_t i = 0; i < ops.size(); i++)
+	{
+		if (ops[i].is_trend())
+		{
+			return "";
+		}
+		code += " " + ops[i].to_rpn("l0");
+		if (i > 0)
+		{
+			code += fmt::format(" {} * +", static_cast<uint64_t>(1) << i);
+		}
+	}
+	if (code.size() >= WASimCommander::STRSZ_REQ)
+	{
+		return "";
+	}
+	return code;
+}
+
+bool X52Config::reads_trend(const IndicatorLed& led) const {
+	for (size_t i = led.firstState; i < led.firstState + led.stateCount; i++)
+	{
+		const IndicatorState& state = indicatorStates[i];
+		if (state.op.is_trend())
+		{
+			return true;
+		}
+		for (size_t c = state.firstInstruction; c < state.firstInstruction + state.instructionCount; c++)
+		{
+			if (conditionCode[c].type == ConditionInstruction::Type::Test && conditionTerms[conditionCode[c].term].op.is_trend())
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+std::string X52Config::led_calculator_code(IndicatorLed& led, std::string& reason) {
+	// Read each SimVar once into its own register
+	std::vector<std::tuple<std::string, std::string, uint8_t>> simvars;
+	std::string code;
+	auto registerOf = [&simvars, &code](const std::string& dataref, const std::string& unit, uint8_t simvarindex) -> int {
+		auto simvar = std::make_tuple(dataref, unit, simvarindex);
+		auto it = std::find(simvars.begin(), simvars.end(), simvar);
+		if (it != simvars.end())
+		{
+			return static_cast<int>(it - simvars.begin());
+		}
+		if (simvars.size() == MAX_SIM_EVALUATE_SIMVARS)
+		{
+			return -1;
+		}
+		simvars.push_back(simvar);
+		code += "(A:" + dataref;
+		if (simvarindex != 0)
+		{
+			code += ":" + std::to_string(simvarindex);
+		}
+		code += fmt::format(", {}) sp{} ", unit, simvars.size() - 1);
+		return static_cast<int>(simvars.size() - 1);
+	};
+	// Calculator code of each state which leaves 1 or 0 on the stack
+	std::vector<std::string> stateCode(led.stateCount);
+	for (size_t i = 0; i < led.stateCount; i++)
+	{
+		const IndicatorState& state = indicatorStates[led.firstState + i];
+		// Hysteresis depends on the led's active state and trend ops on the history of the value, which MSFS does not know
+		if (state.hysteresis > 0)
+		{
+			reason = fmt::format("state {} has a hysteresis attribute", i + 1);
+			return "";
+		}
+		if (state.op.is_trend())
+		{
+			reason = fmt::format("state {} uses a trend op", i + 1);
+			return "";
+		}
+		if (state.instructionCount == 0)
+		{
+			int reg = registerOf(state.dataref, state.unit, state.simvarindex);
+			if (reg < 0)
+			{
+				reason = fmt::format("it reads more than {} SimVars", MAX_SIM_EVALUATE_SIMVARS);
+				return "";
+			}
+			stateCode[i] = state.op.to_rpn(fmt::format("l{}", reg));
+			continue;
+		}
+		// Conditions are already in postfix order, just like calculator code
+		for (size_t c = state.firstInstruction; c < state.firstInstruction + state.instructionCount; c++)
+		{
+			if (!stateCode[i].empty())
+			{
+				stateCode[i] += " ";
+			}
+			switch (conditionCode[c].type) {
+			case ConditionInstruction::Type::Test: {
+				const ConditionTerm& term = conditionTerms[conditionCode[c].term];
+				if (term.op.is_trend())
+				{
+					reason = fmt::format("the condition of state {} uses a trend op", i + 1);
+					return "";
+				}
+				int reg = registerOf(term.dataref, term.unit, term.simvarindex);
+				if (reg < 0)
+				{
+					reason = fmt::format("it reads more than {} SimVars", MAX_SIM_EVALUATE_SIMVARS);
+					return "";
+				}
+				stateCode[i] += term.op.to_rpn(fmt::format("l{}", reg));
+				break;
+			}
+			case ConditionInstruction::Type::And: stateCode[i] += "and"; break;
+			case ConditionInstruction::Type::Or:  stateCode[i] += "or"; break;
+			case ConditionInstruction::Type::Not: stateCode[i] += "!"; break;
+			}
+		}
+	}
+	// The innermost true state wins, so start with the last state and let each
+	// true state overwrite the result: r = r + op * (i + 1 - r)
+	code += "0";
+	for (size_t i = led.stateCount; i-- > 0;)
+	{
+		code += fmt::format(" s9 {} {} l9 - * +", stateCode[i], i + 1);
+	}
+	if (code.size() >= WASimCommander::STRSZ_REQ)
+	{
+		reason = fmt::format("its calculator code has {} characters, more than the {} WASimCommander accepts", code.size(), WASimCommander::STRSZ_REQ - 1);
+		return "";
+	}
+	for (size_t i = 0; i < led.stateCount; i++)
+	{
+		indicatorStates[led.firstState + i].simresult = static_cast<int>(i + 1);
+	}
+	return code;
+}
+
+int X52Config::find_sequence(const std::string& name) const {
+	for (size_t i = 0; i < sequences.size(); i++)
+	{
+		if (sequences[i].name == name)
+		{
+			return static_cast<int>(i);
+		}
+	}
+	return -1;
+}
+
+void X52Config::fill_dispatch_row(int32_t* row, const AssignmentButton& button) const {
+	size_t columns = shiftStateNames.size() + 1;
+	std::fill(row, row + columns, static_cast<int32_t>(button.action));
+	std::vector<char> shifted(columns, false);
+	for (size_t i = button.action + 1; i <= button.action + button.shiftedCount; i++)
+	{
+		// A shifted_button without shift_state attribute is used while no shift state is active
+		int id = buttonActions[i].shiftState.empty() ? 0 : shift_state_id(buttonActions[i].shiftState);
+		if ((id > 0 || buttonActions[i].shiftState.empty()) && !shifted[id])
+		{
+			shifted[id] = true;
+			row[id] = static_cast<int32_t>(i);
+		}
+	}
+}
+
+int X52Config::shift_state_id(const std::string& name) const {
+	for (size_t i = 0; i < shiftStateNames.size(); i++)
+	{
+		if (shiftStateNames[i] == name)
+		{
+			return static_cast<int>(i + 1);
+		}
+	}
+	return 0;
+}
+
+bool X52Config::matches_aircraft(const std::string& title) const {
+	return std::any_of(aircraftTitles.begin(), aircraftTitles.end(), [&title](const std::string& pattern) {
+		return wildcard_match(pattern, title);
+	});
+}
+
+bool X52Config::wildcard_match(const std::string& pattern, const std::string& text) {
+	// Greedy matching which backtracks to the last *, enough for patterns with a few wildcards
+	size_t p = 0;
+	size_t t = 0;
+	size_t star = std::string::npos;
+	size_t starText = 0;
+	while (t < text.size())
+	{
+		if (p < pattern.size() && pattern[p] == '*')
+		{
+			star = p++;
+			starText = t;
+		}
+		else if (p < pattern.size() && std::tolower(static_cast<unsigned char>(pattern[p])) == std::tolower(static_cast<unsigned char>(text[t])))
+		{
+			p++;
+			t++;
+		}
+		else if (star != std::string::npos)
+		{
+			p = star + 1;
+			t = ++starText;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	while (p < pattern.size() && pattern[p] == '*')
+	{
+		p++;
+	}
+	return p == pattern.size();
+}
+
+bool X52Config::compileMasterTarget(const XmlElement& element) {
+	MasterTarget target;
+	std::string op;
+	if (!required_attribute(element, "id", target.id) || !required_attribute(element, "op", op))
+	{
+		return false;
+	}
+	target.op = parse_xml_op(op);
+	if (target.op.type == XmlOp::Type::Invalid || target.op.is_trend())
+	{
+		CLOG(ERROR, "toconsole", "tofile") << location(element) << "The master target " << target.id << " has an invalid op attribute \"" << op << "\". Trend ops can only be used in state tags.";
+		return false;
+	}
+	// Separate SimVar names from units of measurement. The attributes are mandatory, a
+	// missing one is reported when the data is requested.
+	const std::string* attr = element.find("switch_dataref");
+	if (attr != nullptr)
+	{
+		size_t separatorpos = attr->find("%");
+		target.switchDataref = attr->substr(0, separatorpos);
+		target.switchUnit = separatorpos == std::string::npos ? "" : attr->substr(separatorpos + 1);
+	}
+	attr = element.find("brightness_dataref");
+	if (attr != nullptr)
+	{
+		size_t separatorpos = attr->find("%");
+		target.brightnessDataref = attr->substr(0, separatorpos);
+		target.brightnessUnit = separatorpos == std::string::npos ? "" : attr->substr(separatorpos + 1);
+	}
+	if (!number_attribute(element, "min", target.min, true) ||
+		!number_attribute(element, "max", target.max, true) ||
+		!number_attribute(element, "default", target.defaultBrightness, true))
+	{
+		return false;
+	}
+	if (target.max <= target.min)
+	{
+		CLOG(ERROR, "toconsole", "tofile") << location(element) << "The master target " << target.id << " has a max attribute which is not greater than its min attribute.";
+		return false;
+	}
+	masterTargets.push_back(target);
+	return true;
+}
+
+bool X52Config::compileShiftState(const XmlElement& element) {
+	ShiftState state;
+	if (!required_attribute(element, "name", state.name) || !number_attribute(element, "button", state.button, true))
+	{
+		return false;
+	}
+	if (state.button < 1 || state.button > BUTTON_COUNT)
+	{
+		CLOG(ERROR, "toconsole", "tofile") << location(element) << "The shift state " << state.name << " has an invalid button attribute " << state.button << ". Joystick buttons are numbered from 1 to " << BUTTON_COUNT << ".";
+		return false;
+	}
+	openShiftStates.push_back(shiftStates.size());
+	shiftStates.push_back(state);
+	return true;
+}
+
+void X52Config::compileShiftRules(size_t first, size_t end, uint64_t parentMask) {
+	for (size_t i = first; i < end; i += shiftStates[i].subtreeSize)
+	{
+		const ShiftState& state = shiftStates[i];
+		uint64_t mask = parentMask | (uint64_t(1) << (state.button - 1));
+		shiftButtonMask |= mask;
+		compileShiftRules(i + 1, i + state.subtreeSize, mask);
+		shiftRules.push_back({ mask, state.id });
+	}
+}
+
+bool X52Config::compileButton(const XmlElement& element) {
+	AssignmentButton button;
+	if (!number_attribute(element, "nr", button.nr, true))
+	{
+		return false;
+	}
+	const std::string* press = element.find("press");
+	if (press == nullptr || *press == "" || *press == "short") {
+		button.gesture = Gesture::Short;
+	} else if (*press == "long") {
+		button.gesture = Gesture::Long;
+	} else if (*press == "double") {
+		button.gesture = Gesture::Double;
+	} else {
+		CLOG(ERROR, "toconsole", "tofile") << location(element) << "Button " << button.nr << " has an invalid press attribute \"" << *press << "\". It can be short, long or double.";
+		return false;
+	}
+	button.action = buttonActions.size();
+	ButtonAction action;
+	if (!compileButtonAction(element, describe_button(button), action))
+	{
+		return false;
+	}
+	buttonActions.push_back(action);
+	assignmentButtons.push_back(button);
+	return true;
+}
+
+bool X52Config::compileChord(const XmlElement& element) {
+	AssignmentButton chord;
+	std::string buttons;
+	if (!required_attribute(element, "buttons", buttons))
+	{
+		return false;
+	}
+	std::istringstream iss(buttons);
+	std::string nr;
+	size_t count = 0;
+	while (std::getline(iss, nr, ','))
+	{
+		int button = 0;
+		std::istringstream number(nr);
+		number >> button;
+		if (number.fail() || button < 1 || button > BUTTON_COUNT || (chord.chordMask & (uint64_t(1) << (button - 1))))
+		{
+			CLOG(ERROR, "toconsole", "tofile") << location(element) << "The chord \"" << buttons << "\" has an invalid or repeated button \"" << nr << "\". Joystick buttons are numbered from 1 to " << BUTTON_COUNT << ".";
+			return false;
+		}
+		chord.chordMask |= uint64_t(1) << (button - 1);
+		count++;
+	}
+	if (count < 2)
+	{
+		CLOG(ERROR, "toconsole", "tofile") << location(element) << "The chord \"" << buttons << "\" needs at least two buttons.";
+		return false;
+	}
+	chord.action = buttonActions.size();
+	ButtonAction action;
+	if (!compileButtonAction(element, describe_button(chord), action))
+	{
+		return false;
+	}
+	buttonActions.push_back(action);
+	assignmentButtons.push_back(chord);
+	return true;
+}
+
+bool X52Config::compileShiftedButton(const XmlElement& element) {
+	// The shifted_button tags of a button directly follow the button's own action
+	AssignmentButton& button = assignmentButtons.back();
+	ButtonAction shifted;
+	std::string owner = describe_button(button);
+	owner[0] = static_cast<char>(std::tolower(static_cast<unsigned char>(owner[0])));
+	if (!compileButtonAction(element, "A shifted_button tag of " + owner, shifted))
+	{
+		return false;
+	}
+	const std::string* shiftState = element.find("shift_state");
+	if (shiftState != nullptr)
+	{
+		shifted.shiftState = *shiftState;
+	}
+	buttonActions.push_back(shifted);
+	button.shiftedCount++;
+	return true;
+}
+
+std::string X52Config::describe_button(const AssignmentButton& button) {
+	if (button.chordMask == 0)
+	{
+		return "Button " + std::to_string(button.nr);
+	}
+	std::string buttons;
+	for (int nr = 1; nr <= BUTTON_COUNT; nr++)
+	{
+		if (button.chordMask & (uint64_t(1) << (nr - 1)))
+		{
+			buttons += (buttons.empty() ? "" : ",") + std::to_string(nr);
+		}
+	}
+	return fmt::format("The chord of buttons {} (mask 0x{:x})", buttons, button.chordMask);
+}
+
+bool X52Config::compileButtonAction(const XmlElement& element, const std::string& owner, ButtonAction& action) {
+	const std::string* type = element.find("type");
+	if (type == nullptr || *type == "trigger_pos" || *type == "") {
+		action.type = ButtonAction::Type::TriggerPos;
+	} else if (*type == "trigger_neg") {
+		action.type = ButtonAction::Type::TriggerNeg;
+	} else if (*type == "hold") {
+		action.type = ButtonAction::Type::Hold;
+	} else if (*type == "toggle") {
+		action.type = ButtonAction::Type::Toggle;
+	} else if (*type == "repeater") {
+		action.type = ButtonAction::Type::Repeater;
+	} else {
+		action.type = ButtonAction::Type::Other;
+	}
+	const std::string* attr;
+	if ((attr = element.find("custom_command")) != nullptr && !attr->empty()) {
+		action.kind = ButtonAction::Kind::CustomCommand;
+	} else if ((attr = element.find("command")) != nullptr && !attr->empty()) {
+		action.kind = ButtonAction::Kind::Command;
+		action.command = *attr;
+		if (!number_attribute(element, "on", action.on))
+		{
+			return false;
+		}
+	} else if ((attr = element.find("dataref")) != nullptr && !attr->empty()) {
+		action.kind = ButtonAction::Kind::Dataref;
+		size_t separatorpos = attr->find("%");
+		action.dataref = attr->substr(0, separatorpos);
+		action.unit = attr->substr(separatorpos + 1);
+		if (!number_attribute(element, "on", action.on, true))
+		{
+			CLOG(ERROR, "toconsole", "tofile") << location(element) << owner << " sets dataref " << action.dataref << ", so it needs a valid on attribute.";
+			return false;
+		}
+	} else if ((attr = element.find("calculator_code")) != nullptr && !attr->empty()) {
+		action.kind = ButtonAction::Kind::CalculatorCode;
+		action.command = *attr;
+	}
+	if (!number_attribute(element, "off", action.off))
+	{
+		return false;
+	}
+	if (action.type == ButtonAction::Type::Repeater)
+	{
+		if (!number_attribute(element, "delay", action.delay) || !number_attribute(element, "interval", action.interval))
+		{
+			return false;
+		}
+		if (action.delay < 0 || action.interval < 10)
+		{
+			CLOG(ERROR, "toconsole", "tofile") << location(element) << owner << " is a repeater with delay " << action.delay << " and interval " << action.interval << ". The delay cannot be negative, and the interval must be at least 10 ms.";
+			return false;
+		}
+	}
+	return true;
+}
+
+bool X52Config::compileSequence(const XmlElement& element) {
+	Sequence sequence;
+	sequence.loop = 0;
+	if (!required_attribute(element, "name", sequence.name) ||
+		!required_attribute(element, "pattern", sequence.pattern) ||
+		!number_attribute(element, "loop", sequence.loop) ||
+		!number_attribute(element, "speed", sequence.speed, true))
+	{
+		return false;
+	}
+	if (sequence.speed > 10)
+	{
+		CLOG(ERROR,"toconsole", "tofile") << location(element) << "The speed of sequence tag " << sequence.name << " is greater than 10. The maximum allowed speed is 10.";
+		return false;
+	}
+	if (sequence.speed < 1)
+	{
+		CLOG(ERROR,"toconsole", "tofile") << location(element) << "The speed of sequence tag " << sequence.name << " is less than 1.";
+		return false;
+	}
+	sequences.push_back(sequence);
+	return true;
+}
+
+bool X52Config::compileLed(const XmlElement& element) {
+	openLed = IndicatorLed();
+	openLedSimEvaluate = false;
+	if (!required_attribute(element, "id", openLed.id) || !bool_attribute(element, "sim_evaluate", openLedSimEvaluate))
+	{
+		return false;
+	}
+	openLed.firstState = indicatorStates.size();
+	return true;
+}
+
+bool X52Config::finishLed() {
+	IndicatorLed& led = openLed;
+	led.stateCount = indicatorStates.size() - led.firstState;
+	if (openLedSimEvaluate && led.stateCount > 0)
+	{
+		std::string reason;
+		led.calculatorcode = led_calculator_code(led, reason);
+		if (led.calculatorcode.empty())
+		{
+			CLOG(WARNING, "toconsole", "tofile") << "Led " << led.id << " cannot be evaluated in MSFS, because " << reason << ". It is evaluated by x52msfsout instead.";
+		}
+	}
+	indicatorLeds.push_back(led);
+	return true;
+}
+
+bool X52Config::compileState(const XmlElement& element) {
+	const std::string& led = openLed.id;
+	IndicatorState state;
+	// If a delta is given, read it from the XML. Otherwise only notify us
+	// when value has changed, no matter with how small amount.
+	if (!number_attribute(element, "delta", state.delta) ||
+		!number_attribute(element, "hysteresis", state.hysteresis) ||
+		!number_attribute(element, "dwell", state.dwell))
+	{
+		return false;
+	}
+	const std::string* condition = element.find("condition");
+	if (condition != nullptr && !condition->empty())
+	{
+		// A compound condition instead of dataref and op
+		if (!compileCondition(*condition, state, element))
+		{
+			return false;
+		}
+	}
+	else
+	{
+		std::string attr;
+		std::string op;
+		if (!required_attribute(element, "dataref", attr) || !required_attribute(element, "op", op))
+		{
+			return false;
+		}
+		// Separate SimVar name from unit of measurement
+		size_t separatorpos = attr.find("%");
+		state.dataref = attr.substr(0, separatorpos);
+		state.unit = attr.substr(separatorpos + 1);
+		// If an index is given, read it from the XML
+		int simvarindex = 0;
+		if (!number_attribute(element, "index", simvarindex))
+		{
+			return false;
+		}
+		if (simvarindex < 0 || simvarindex > MAX_SIMVAR_INDEX)
+		{
+			CLOG(ERROR, "toconsole", "tofile") << location(element) << "A state tag of led " << led << " has the index attribute " << simvarindex << ". The index must be between 0 and " << MAX_SIMVAR_INDEX << ".";
+			return false;
+		}
+		state.simvarindex = static_cast<uint8_t>(simvarindex);
+		state.op = parse_xml_op(op);
+		if (state.op.type == XmlOp::Type::Invalid)
+		{
+			CLOG(ERROR, "toconsole", "tofile") << location(element) << "A state tag of led " << led << " has an invalid op attribute \"" << op << "\".";
+			return false;
+		}
+	}
+	if (state.hysteresis < 0 || state.dwell < 0)
+	{
+		CLOG(ERROR, "toconsole", "tofile") << location(element) << "A state tag of led " << led << " has a negative hysteresis or dwell attribute.";
+		return false;
+	}
+	if (state.hysteresis > 0 && state.op.is_trend())
+	{
+		CLOG(ERROR, "toconsole", "tofile") << location(element) << "A state tag of led " << led << " has both a trend op and a hysteresis attribute. Trend ops have no threshold which hysteresis could move.";
+		return false;
+	}
+	if (state.hysteresis > 0 && state.instructionCount > 0)
+	{
+		CLOG(ERROR, "toconsole", "tofile") << location(element) << "A state tag of led " << led << " has both a condition and a hysteresis attribute. Hysteresis can only be used with dataref and op.";
+		return false;
+	}
+	if (!required_attribute(element, "light", state.light))
+	{
+		return false;
+	}
+	// The sequence is looked up by finish(), because the sequences tag may come later
+	openStates.push_back(std::move(state));
+	return true;
+}
+
+bool X52Config::compileCondition(const std::string& condition, IndicatorState& state, const XmlElement& element) {
+	size_t firstTerm = conditionTerms.size();
+	state.firstInstruction = conditionCode.size();
+	size_t pos = 0;
+	bool ok = parseConditionOr(condition, pos, element);
+	while (ok && pos < condition.size() && std::isspace(static_cast<unsigned char>(condition[pos])))
+	{
+		pos++;
+	}
+	if (!ok && pos == std::string::npos)
+	{
+		// The error was logged already
+		return false;
+	}
+	if (!ok || pos != condition.size())
+	{
+		CLOG(ERROR, "toconsole", "tofile") << location(element) << "A state tag of led " << openLed.id << " has an invalid condition attribute. Syntax error at character " << pos + 1 << " of \"" << condition << "\".";
+		return false;
+	}
+	state.instructionCount = conditionCode.size() - state.firstInstruction;
+	// Check that the condition can be evaluated on the fixed size stack
+	size_t depth = 0;
+	size_t maxDepth = 0;
+	for (size_t i = state.firstInstruction; i < conditionCode.size(); i++)
+	{
+		switch (conditionCode[i].type) {
+		case ConditionInstruction::Type::Test: depth++; break;
+		case ConditionInstruction::Type::And:
+		case ConditionInstruction::Type::Or:   depth--; break;
+		default: break;
+		}
+		maxDepth = std::max(maxDepth, depth);
+	}
+	if (maxDepth > MAX_CONDITION_DEPTH)
+	{
+		CLOG(ERROR, "toconsole", "tofile") << location(element) << "A state tag of led " << openLed.id << " has a condition which is nested too deeply. The maximum depth is " << MAX_CONDITION_DEPTH << ".";
+		return false;
+	}
+	for (size_t i = firstTerm; i < conditionTerms.size(); i++)
+	{
+		conditionTerms[i].delta = state.delta;
+	}
+	return true;
+}
+
+bool X52Config::skipConditionKeyword(const std::string& condition, size_t& pos, std::string_view keyword) {
+	while (pos < condition.size() && std::isspace(static_cast<unsigned char>(condition[pos])))
+	{
+		pos++;
+	}
+	if (condition.compare(pos, keyword.size(), keyword) != 0)
+	{
+		return false;
+	}
+	size_t end = pos + keyword.size();
+	if (end < condition.size() && !std::isspace(static_cast<unsigned char>(condition[end])) && condition[end] != '(' && condition[end] != '{')
+	{
+		return false;
+	}
+	pos = end;
+	return true;
+}
+
+bool X52Config::parseConditionOr(const std::string& condition, size_t& pos, const XmlElement& element) {
+	if (!parseConditionAnd(condition, pos, element))
+	{
+		return false;
+	}
+	while (skipConditionKeyword(condition, pos, "or"))
+	{
+		if (!parseConditionAnd(condition, pos, element))
+		{
+			return false;
+		}
+		conditionCode.push_back({ ConditionInstruction::Type::Or });
+	}
+	return true;
+}
+
+bool X52Config::parseConditionAnd(const std::string& condition, size_t& pos, const XmlElement& element) {
+	if (!parseConditionFactor(condition, pos, element))
+	{
+		return false;
+	}
+	while (skipConditionKeyword(condition, pos, "and"))
+	{
+		if (!parseConditionFactor(condition, pos, element))
+		{
+			return false;
+		}
+		conditionCode.push_back({ ConditionInstruction::Type::And });
+	}
+	return true;
+}
+
+bool X52Config::parseConditionFactor(const std::string& condition, size_t& pos, const XmlElement& element) {
+	if (skipConditionKeyword(condition, pos, "not"))
+	{
+		if (!parseConditionFactor(condition, pos, element))
+		{
+			return false;
+		}
+		conditionCode.push_back({ ConditionInstruction::Type::Not });
+		return true;
+	}
+	// skipConditionKeyword has skipped the whitespace
+	if (pos >= condition.size())
+	{
+		return false;
+	}
+	if (condition[pos] == '(')
+	{
+		pos++;
+		if (!parseConditionOr(condition, pos, element))
+		{
+			return false;
+		}
+		while (pos < condition.size() && std::isspace(static_cast<unsigned char>(condition[pos])))
+		{
+			pos++;
+		}
+		if (pos >= condition.size() || condition[pos] != ')')
+		{
+			return false;
+		}
+		pos++;
+		return true;
+	}
+	if (condition[pos] != '{')
+	{
+		return false;
+	}
+	// {SIMVAR NAME:index%unit} op
+	size_t end = condition.find('}', pos);
+	if (end == std::string::npos)
+	{
+		return false;
+	}
+	std::string attr = condition.substr(pos + 1, end - pos - 1);
+	size_t separatorpos = attr.find('%');
+	if (separatorpos == std::string::npos)
+	{
+		return false;
+	}
+	ConditionTerm term;
+	term.dataref = attr.substr(0, separatorpos);
+	term.unit = attr.substr(separatorpos + 1);
+	size_t indexpos = term.dataref.rfind(':');
+	if (indexpos != std::string::npos && indexpos + 1 < term.dataref.size() &&
+		term.dataref.find_first_not_of("0123456789", indexpos + 1) == std::string::npos)
+	{
+		const char* first = term.dataref.data() + indexpos + 1;
+		const char* last = term.dataref.data() + term.dataref.size();
+		int simvarindex = 0;
+		auto [ptr, ec] = std::from_chars(first, last, simvarindex);
+		if (ec != std::errc() || ptr != last || simvarindex > MAX_SIMVAR_INDEX)
+		{
+			CLOG(ERROR, "toconsole", "tofile") << location(element) << "A state tag of led " << openLed.id << " has the SimVar index " << std::string(first, last)
+				<< " in its condition attribute. The index must be between 0 and " << MAX_SIMVAR_INDEX << ".";
+			pos = std::string::npos;
+			return false;
+		}
+		term.simvarindex = static_cast<uint8_t>(simvarindex);
+		term.dataref.erase(indexpos);
+	}
+	pos = end + 1;
+	while (pos < condition.size() && std::isspace(static_cast<unsigned char>(condition[pos])))
+	{
+		pos++;
+	}
+	size_t opEnd = pos;
+	while (opEnd < condition.size() && !std::isspace(static_cast<unsigned char>(condition[opEnd])) && condition[opEnd] != ')')
+	{
+		opEnd++;
+	}
+	term.op = parse_xml_op(condition.substr(pos, opEnd - pos));
+	if (term.op.type == XmlOp::Type::Invalid || conditionTerms.size() > UINT16_MAX)
+	{
+		return false;
+	}
+	pos = opEnd;
+	ConditionInstruction test{ ConditionInstruction::Type::Test };
+	test.term = static_cast<uint16_t>(conditionTerms.size());
+	conditionTerms.push_back(term);
+	conditionCode.push_back(test);
+	return true;
+}
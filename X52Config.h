@@ -0,0 +1,560 @@
+/*
+    Copyright (C) 2023  Csaba K Molnár
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <boost/property_tree/ptree.hpp>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include "TrendBuffer.h"
+#include "XmlReader.h"
+#ifndef EASYLOGGINGPP_H
+#include "easylogging++.h"
+#endif
+
+#ifndef CLASS_X52CONFIG_H
+#define CLASS_X52CONFIG_H
+
+/// <summary>
+/// The compiled form of the XML configuration file. Tags which are processed on every data
+/// change are converted once at load time into flat arrays with pre-parsed attributes, so that
+/// the runtime does not have to walk the property tree and convert strings again and again.
+/// </summary>
+class X52Config : public XmlHandler
+{
+// VARIABLES
+public:
+	/// <summary>
+	/// A pre-parsed op attribute, like "++30". Evaluating it does not allocate or parse anything.
+	/// </summary>
+	struct XmlOp {
+		enum class Type : uint8_t {
+			Invalid,
+			Equal,          // ==value
+			Less,           // --value
+			Greater,        // ++value
+			GreaterOrEqual, // >=value
+			LessOrEqual,    // <=value (write &lt;= in XML)
+			NotEqual,       // !=value
+			Range,          // []min:max, inclusive at both ends
+			NearlyEqual,    // ~=value:epsilon, true if the difference is at most epsilon
+			BitsSet,        // ##mask, true if all bits of mask are set in the integer value
+			// Trend ops below depend on the history of the value, see matches_trend()
+			RisingFaster,   // /+rate, true if the value rises faster than rate units per second
+			FallingFaster,  // /-rate, true if the value falls faster than rate units per second
+			ChangedWithin,  // @@ms, true if the value changed within the last ms milliseconds
+		};
+		/// <summary>
+		/// 2^64, the values BitsSet tests must be below it.
+		/// </summary>
+		static constexpr double MASK_LIMIT = 18446744073709551616.0;
+		/// <summary>
+		/// 2^32, the masks of BitsSet must be below it, because the & operator of MSFS calculator code works on 32-bit integers.
+		/// </summary>
+		static constexpr double BITS_MASK_LIMIT = 4294967296.0;
+		Type type = Type::Invalid;
+		double operand = 0;  // value, min or mask
+		double operand2 = 0; // max or epsilon
+		bool matches(double simvarvalue) const {
+			switch (type) {
+			case Type::Equal:          return simvarvalue == operand;
+			case Type::Less:           return simvarvalue < operand;
+			case Type::Greater:        return simvarvalue > operand;
+			case Type::GreaterOrEqual: return simvarvalue >= operand;
+			case Type::LessOrEqual:    return simvarvalue <= operand;
+			case Type::NotEqual:       return simvarvalue != operand;
+			case Type::Range:          return simvarvalue >= operand && simvarvalue <= operand2;
+			case Type::NearlyEqual:    return std::fabs(simvarvalue - operand) <= operand2;
+			case Type::BitsSet: {
+				// Converting a negative or too large double to an integer is undefined
+				if (!(simvarvalue >= 0 && simvarvalue < MASK_LIMIT)) {
+					return false;
+				}
+				uint64_t mask = static_cast<uint64_t>(operand);
+				return (static_cast<uint64_t>(simvarvalue) & mask) == mask;
+			}
+			default:                   return false;
+			}
+		}
+		/// <summary>
+		/// Same as matches(), but the threshold is moved by hysteresis so that the op stays true for values
+		/// slightly beyond it. Used for the state which is currently active, so that a value fluctuating around
+		/// the threshold does not switch the led back and forth.
+		/// </summary>
+		bool matches(double simvarvalue, double hysteresis) const {
+			switch (type) {
+			case Type::Equal:          return std::fabs(simvarvalue - operand) <= hysteresis;
+			case Type::Less:           return simvarvalue < operand + hysteresis;
+			case Type::Greater:        return simvarvalue > operand - hysteresis;
+			case Type::GreaterOrEqual: return simvarvalue >= operand - hysteresis;
+			case Type::LessOrEqual:    return simvarvalue <= operand + hysteresis;
+			case Type::Range:          return simvarvalue >= operand - hysteresis && simvarvalue <= operand2 + hysteresis;
+			case Type::NearlyEqual:    return std::fabs(simvarvalue - operand) <= operand2 + hysteresis;
+			default:                   return matches(simvarvalue); // NotEqual and BitsSet have no threshold to move
+			}
+		}
+		/// <summary>
+		/// True if the op is a trend op, which is evaluated with matches_trend() instead of matches().
+		/// </summary>
+		bool is_trend() const {
+			return type == Type::RisingFaster || type == Type::FallingFaster || type == Type::ChangedWithin;
+		}
+		/// <summary>
+		/// Evaluates a trend op using the recent samples of the value.
+		/// </summary>
+		/// <param name="unitFactor">Converts the samples to the unit of the op, see IndicatorState::unitFactor.</param>
+		bool matches_trend(TrendBuffer& history, TrendBuffer::Clock::time_point now, double unitFactor = 1.0) const {
+			switch (type) {
+			case Type::RisingFaster:   return history.rate(now) * unitFactor > operand;
+			case Type::FallingFaster:  return history.rate(now) * unitFactor < -operand;
+			case Type::ChangedWithin:  return history.changed_within(now, std::chrono::milliseconds(static_cast<long long>(operand)));
+			default:                   return false;
+			}
+		}
+		/// <summary>
+		/// Returns the op as MSFS calculator code (RPN) which leaves 1 or 0 on the stack.
+		/// Returns an empty string for trend ops, which cannot be evaluated in MSFS.
+		/// </summary>
+		/// <param name="value">Calculator code which pushes the value to compare, for example "l0".</param>
+		std::string to_rpn(const std::string& value) const;
+		bool operator==(const XmlOp& other) const {
+			return type == other.type && operand == other.operand && operand2 == other.operand2;
+		}
+	};
+	/// <summary>
+	/// A target tag inside the master tag.
+	/// </summary>
+	struct MasterTarget {
+		std::string id; // "mfd" or "led"
+		XmlOp op;       // Evaluated against switch_dataref
+		std::string switchDataref;     // SimVar name of switch_dataref without the unit, empty if the attribute is missing
+		std::string switchUnit;
+		std::string brightnessDataref; // SimVar name of brightness_dataref without the unit, empty if the attribute is missing
+		std::string brightnessUnit;
+		double min = 0;
+		double max = 100;
+		double defaultBrightness = 100; // The default attribute in percent
+	};
+	/// <summary>
+	/// What a button or shifted_button tag inside the assignments tag does when the joystick button is pressed.
+	/// </summary>
+	struct ButtonAction {
+		enum class Kind : uint8_t {
+			None,           // The tag has no supported action attribute
+			CustomCommand,  // custom_command, not supported yet
+			Command,        // command: an InputEvent (Key Event) sent via SimConnect
+			Dataref,        // dataref: a SimVar set to the value of the on attribute
+			CalculatorCode, // calculator_code executed via WASim
+		};
+		enum class Type : uint8_t {
+			TriggerPos, // trigger_pos, also used if the type attribute is missing: executed when the button is pressed
+			TriggerNeg, // trigger_neg: executed when the button is released
+			Hold,       // hold: on is sent when the button is pressed, off when it is released
+			Toggle,     // toggle: each press sends on and off in turn
+			Repeater,   // repeater: executed when the button is pressed, then every interval after delay until it is released
+			Other,      // Types which are not supported yet
+		};
+		Kind kind = Kind::None;
+		Type type = Type::TriggerPos;
+		std::string command;        // The InputEvent name, or the calculator code
+		std::string dataref;        // SimVar name without the unit
+		std::string unit;
+		int clienteventid = 0;      // SimConnect Client Event ID of command, assigned when the client events are mapped. 0 if not mapped yet.
+		double on = 0;              // The on attribute
+		double off = 0;             // The off attribute, used by hold and toggle
+		int delay = 500;            // The delay attribute of a repeater in ms, the time before the first repeat
+		int interval = 100;         // The interval attribute of a repeater in ms, the time between two repeats
+		std::string shiftState;     // The shift_state attribute of a shifted_button tag, empty for button tags
+	};
+	/// <summary>
+	/// A shift_state tag. Nested shift_state tags directly follow their parent in shiftStates.
+	/// </summary>
+	struct ShiftState {
+		std::string name;
+		int button = 0;         // Joystick button number, 1-39
+		size_t subtreeSize = 1; // Number of entries in shiftStates taken by this tag and its nested tags
+		int id = 0;             // Index of name in shiftStateNames plus one, set by finish()
+	};
+	enum class Gesture : uint8_t {
+		Short,  // The button is pressed, also used if the press attribute is missing
+		Long,   // press="long": the button is held for longPressTime
+		Double, // press="double": the button is pressed again within doublePressTime after it was released
+	};
+	static constexpr size_t GESTURE_COUNT = 3;
+	/// <summary>
+	/// A button or chord tag inside the assignments tag. Its own action and the actions of its shifted_button tags
+	/// follow each other in buttonActions.
+	/// </summary>
+	struct AssignmentButton {
+		int nr = 0;                // Joystick button number, 0 for a chord tag
+		size_t action = 0;         // Index of the button tag's action in buttonActions
+		size_t shiftedCount = 0;   // Number of shifted_button tags, stored after action in buttonActions
+		Gesture gesture = Gesture::Short;
+		uint64_t chordMask = 0;    // The buttons attribute of a chord tag, bit n-1 is set for joystick button n
+	};
+	struct Sequence {
+		std::string name;
+		std::string pattern;
+		int loop;
+		int speed;
+	};
+	/// <summary>
+	/// One comparison inside the condition attribute of a state tag, like {GEAR HANDLE POSITION%bool} ==1.
+	/// </summary>
+	struct ConditionTerm {
+		std::string dataref;
+		std::string unit;
+		uint8_t simvarindex = 0;
+		float delta = 0.0f; // The delta attribute of the state
+		XmlOp op;
+		int requestid = 0; // WASim RequestID, assigned when data requests are registered
+		double unitFactor = 1.0; // Converts the value of the request to unit, see IndicatorState::unitFactor
+	};
+	/// <summary>
+	/// One instruction of a compiled condition. Conditions are stored in postfix order and evaluated on a small stack of booleans.
+	/// </summary>
+	struct ConditionInstruction {
+		enum class Type : uint8_t {
+			Test, // Push the result of conditionTerms[term]
+			And,  // Pop two, push their AND
+			Or,   // Pop two, push their OR
+			Not,  // Negate the top
+		};
+		Type type;
+		uint16_t term = 0;
+	};
+	/// <summary>
+	/// One state tag of a led.
+	/// </summary>
+	struct IndicatorState {
+		std::string dataref; // SimVar name without the unit
+		std::string unit;
+		uint8_t simvarindex = 0;
+		float delta = 0.0f;
+		XmlOp op;
+		float hysteresis = 0.0f; // Once this state is active, it stays active until the value moves this much beyond the op's threshold
+		int dwell = 0;         // Minimum time in ms the led stays in this state before another state can be shown
+		int bucketbit = -1;    // If the request is a threshold bucket request, the bit which holds the result of op. Otherwise -1.
+		int simresult = 0;     // If the led is evaluated in MSFS, the number the led's request returns when this state wins. Otherwise 0.
+		size_t firstInstruction = 0; // If the state has a condition attribute, its first instruction in conditionCode
+		size_t instructionCount = 0; // Number of instructions of the condition. 0 if the state uses dataref and op.
+		std::string light;     // The light attribute: a color, "on", "off" or the name of a sequence
+		int sequence = -1;     // Index into sequences if light is the name of a sequence, otherwise -1
+		int requestid = 0;     // WASim RequestID, assigned when data requests are registered. 0 means not yet registered.
+		double unitFactor = 1.0; // The value of the request times unitFactor is the value in unit. Not 1 if the request
+		                         // is shared with a state which reads the SimVar in another unit, see to_canonical_unit().
+	};
+	/// <summary>
+	/// One led tag. Its states are stored contiguously in indicatorStates.
+	/// </summary>
+	struct IndicatorLed {
+		std::string id;
+		size_t firstState = 0;
+		size_t stateCount = 0;
+		/// <summary>
+		/// If the led tag has sim_evaluate="true", calculator code which evaluates all states of the led in MSFS and returns
+		/// the simresult of the winning state, or 0 if no state is true. Empty if the led is evaluated by x52msfsout.
+		/// </summary>
+		std::string calculatorcode;
+	};
+	std::vector<MasterTarget> masterTargets; // In the order of the target tags
+	std::vector<ShiftState> shiftStates;
+	std::vector<ButtonAction> buttonActions;
+	/// <summary>
+	/// Built by finish(): the distinct command attributes of all button, shifted_button and chord tags, in the order of the XML.
+	/// They are mapped to Client Event IDs in one batch after connecting to SimConnect.
+	/// </summary>
+	std::vector<std::string> clientEvents;
+	std::vector<AssignmentButton> assignmentButtons;
+	/// <summary>
+	/// Number of joystick buttons of the X52 Pro.
+	/// </summary>
+	static constexpr int BUTTON_COUNT = 39;
+	/// <summary>
+	/// The distinct names of the shift_state tags. The id of a shift state is its index here plus one, 0 means no shift state.
+	/// </summary>
+	std::vector<std::string> shiftStateNames;
+	/// <summary>
+	/// Built by finish(): for each gesture one row per joystick button with one entry per shift state id. Each entry is the index
+	/// in buttonActions of the action the gesture executes in that shift state, or -1 if the button has no button tag for the gesture.
+	/// </summary>
+	std::vector<int32_t> buttonDispatch;
+	/// <summary>
+	/// Built by finish(): for each joystick button the index in buttonActions of its button tag's action, or -1.
+	/// </summary>
+	std::vector<int32_t> buttonTags;
+	/// <summary>
+	/// The chord tags, in the order of the XML. A chord is executed as soon as all its buttons are held.
+	/// </summary>
+	std::vector<uint64_t> chords;
+	/// <summary>
+	/// Built by finish(): one row per chord, like the rows of buttonDispatch.
+	/// </summary>
+	std::vector<int32_t> chordDispatch;
+	uint64_t longPressButtons = 0;   // Buttons with a press="long" button tag
+	uint64_t doublePressButtons = 0; // Buttons with a press="double" button tag
+	uint64_t chordButtons = 0;       // Buttons used by a chord tag
+	/// <summary>
+	/// The long_press_time, double_press_time and chord_time attributes of the assignments tag in ms. A press is long if the button
+	/// is held for longPressTime. A second press within doublePressTime after the release is a double press. The buttons of a chord
+	/// must all be pressed within chordTime.
+	/// </summary>
+	int longPressTime = 500;
+	int doublePressTime = 300;
+	int chordTime = 50;
+	/// <summary>
+	/// A shift state compiled into the buttons which must be held for it: the button of its shift_state tag and of all parent tags.
+	/// </summary>
+	struct ShiftRule {
+		uint64_t mask = 0; // Bit n-1 is set for joystick button n
+		int id = 0;        // See ShiftState::id
+	};
+	/// <summary>
+	/// Built by finish(): the active shift state is the first rule whose buttons are all held. Nested shift states come before
+	/// their parent, and each shift_state tag before its later siblings, which gives the same result as walking the tags.
+	/// </summary>
+	std::vector<ShiftRule> shiftRules;
+	/// <summary>
+	/// The buttons used by any shift_state tag. Other buttons cannot change the shift state.
+	/// </summary>
+	uint64_t shiftButtonMask = 0;
+	std::vector<Sequence> sequences;
+	/// <summary>
+	/// The state tags of all leds. The states of one led follow each other in evaluation order,
+	/// that is innermost state first, so the first state which evaluates to true wins.
+	/// </summary>
+	std::vector<IndicatorState> indicatorStates;
+	std::vector<IndicatorLed> indicatorLeds;
+	std::vector<ConditionTerm> conditionTerms;
+	std::vector<ConditionInstruction> conditionCode;
+	/// <summary>
+	/// The bucket_requests attribute of the indicators tag. If true, the ops of all states which read the same SimVar are
+	/// evaluated in MSFS and we only receive a bit mask of their results, so we are only notified when a threshold is crossed.
+	/// </summary>
+	bool bucketRequests = false;
+	/// <summary>
+	/// The title attributes of the top-level aircraft tags. When x52msfsout is started with a profile directory, this file is
+	/// used for aircraft whose title matches one of them. * matches any number of characters, case is ignored.
+	/// </summary>
+	std::vector<std::string> aircraftTitles;
+private:
+	// The state of the compiler while the tags are reported one by one
+	std::vector<std::string> openElements; // Names of the tags which are not closed yet, outermost first
+	std::vector<IndicatorState> openStates; // State tags which are not closed yet, innermost last
+	std::vector<size_t> openShiftStates;    // Indexes in shiftStates of the shift_state tags which are not closed yet
+	IndicatorLed openLed;
+	bool openLedSimEvaluate = false;
+
+// FUNCTIONS
+public:
+	/// <summary>
+	/// Compile the XML configuration file with the streaming XmlReader, without building a property tree. Errors are logged with line numbers.
+	/// </summary>
+	/// <param name="filename">Path of the XML configuration file.</param>
+	/// <returns>False if the file cannot be read, is not well-formed, or contains invalid data.</returns>
+	bool load(const std::string& filename);
+	/// <summary>
+	/// Compile an XML configuration file which was already read into a property tree. Errors are logged without line numbers.
+	/// </summary>
+	/// <param name="xml_file">The whole XML configuration file.</param>
+	/// <returns>False if the configuration contains invalid data.</returns>
+	bool compile(const boost::property_tree::ptree& xml_file);
+	/// <summary>
+	/// Called by XmlReader, or by compile() for each tag of the property tree. Each tag is compiled as soon as it is
+	/// reported, the only thing left for finish() is what depends on tags later in the file.
+	/// </summary>
+	bool start_element(const XmlElement& element) override;
+	bool end_element(const std::string& name) override;
+	/// <summary>
+	/// Parses an op attribute.
+	/// </summary>
+	/// <param name="op">Two operator characters followed by the operand(s). See XmlOp::Type for the list of operators.</param>
+	/// <returns>An XmlOp of type Invalid if op cannot be parsed.</returns>
+	static XmlOp parse_xml_op(const std::string& op);
+	/// <summary>
+	/// Returns the index of the sequence with the given name, or -1 if there is no such sequence.
+	/// </summary>
+	int find_sequence(const std::string& name) const;
+	/// <summary>
+	/// Returns the id of the shift state with the given name, or 0 if no shift_state tag has this name.
+	/// </summary>
+	int shift_state_id(const std::string& name) const;
+	/// <summary>
+	/// Returns the index in buttonActions of the action which a press of the button executes in the given shift state,
+	/// or -1 if the button has no button tag for the gesture.
+	/// </summary>
+	/// <param name="button">Joystick button number, 1-39.</param>
+	/// <param name="shiftStateId">See ShiftState::id, 0 if no shift state is active.</param>
+	/// <param name="gesture">The gesture of the press.</param>
+	int dispatch_action(int button, int shiftStateId, Gesture gesture = Gesture::Short) const {
+		return buttonDispatch[(static_cast<size_t>(gesture) * BUTTON_COUNT + button - 1) * (shiftStateNames.size() + 1) + shiftStateId];
+	}
+	/// <summary>
+	/// Returns the index in buttonActions of the action which the chord executes in the given shift state.
+	/// </summary>
+	int chord_action(size_t chord, int shiftStateId) const {
+		return chordDispatch[chord * (shiftStateNames.size() + 1) + shiftStateId];
+	}
+	/// <summary>
+	/// True if the aircraft title matches one of aircraftTitles.
+	/// </summary>
+	bool matches_aircraft(const std::string& title) const;
+	/// <summary>
+	/// Matches text against a pattern in which * stands for any number of characters. Case is ignored.
+	/// </summary>
+	static bool wildcard_match(const std::string& pattern, const std::string& text);
+	/// <summary>
+	/// Returns true if the state's op is true for a value received from the state's request.
+	/// For bucket requests the value is a bit mask of op results, otherwise it is the SimVar's value,
+	/// which is converted to the state's unit.
+	/// Not used for states with a condition attribute.
+	/// </summary>
+	static bool state_matches(const IndicatorState& state, double value) {
+		if (state.simresult > 0) {
+			return value == state.simresult;
+		}
+		if (state.bucketbit >= 0) {
+			return (static_cast<uint64_t>(value) >> state.bucketbit) & 1;
+		}
+		return state.op.matches(value * state.unitFactor);
+	}
+	/// <summary>
+	/// Converts a unit of measurement to the canonical unit of the same quantity, for example "percent over 100"
+	/// to "percent" or "degrees" to "radians", so that consumers which use different units of the same SimVar
+	/// can share one data request. Unknown units are left as they are. Ops are not changed, the value is converted instead.
+	/// </summary>
+	/// <param name="unit">The unit, replaced by the canonical unit.</param>
+	/// <returns>The factor which converts a value in the original unit to the canonical unit, or 1 if there is no conversion.</returns>
+	static double to_canonical_unit(std::string& unit);
+	/// <summary>
+	/// True if a state of the led, or a term of a state's condition, uses a trend op.
+	/// </summary>
+	bool reads_trend(const IndicatorLed& led) const;
+	/// <summary>
+	/// Generates the calculator code of a threshold bucket request. The code reads the SimVar once and returns a number
+	/// whose bit i is 1 if ops[i] is true.
+	/// </summary>
+	/// <returns>An empty string if the ops cannot be evaluated this way.</returns>
+	static std::string bucket_calculator_code(const std::string& dataref, const std::string& unit, uint8_t simvarindex, const std::vector<XmlOp>& ops);
+	/// <summary>
+	/// Maximum number of different ops in one bucket request. A double can represent integers up to 2^53 exactly.
+	/// </summary>
+	static constexpr size_t MAX_BUCKET_OPS = 52;
+	/// <summary>
+	/// Maximum number of different SimVars in the calculator code of a led with sim_evaluate="true".
+	/// Each SimVar is kept in a calculator register, and register 9 holds the result.
+	/// </summary>
+	static constexpr size_t MAX_SIM_EVALUATE_SIMVARS = 9;
+	/// <summary>
+	/// Maximum depth of the boolean stack when a condition is evaluated.
+	/// </summary>
+	static constexpr size_t MAX_CONDITION_DEPTH = 16;
+	/// <summary>
+	/// Largest SimVar index of the index attribute and of SimVars in conditions. Indexes are stored in a byte.
+	/// </summary>
+	static constexpr int MAX_SIMVAR_INDEX = 255;
+private:
+	/// <summary>
+	/// Clears the compiled configuration before the first tag is reported.
+	/// </summary>
+	void begin();
+	/// <summary>
+	/// Resolves references between tags after the last tag was reported, for example light attributes naming sequences.
+	/// </summary>
+	bool finish();
+	/// <summary>
+	/// Walks a property tree and reports its tags like XmlReader would. This function is called recursively.
+	/// </summary>
+	bool walk(const boost::property_tree::ptree& xmltree);
+	/// <summary>
+	/// Compile a target tag inside the master tag.
+	/// </summary>
+	bool compileMasterTarget(const XmlElement& element);
+	/// <summary>
+	/// Appends a shift_state tag to shiftStates. Nested shift_state tags follow it, and its subtreeSize is set when it is closed.
+	/// </summary>
+	bool compileShiftState(const XmlElement& element);
+	/// <summary>
+	/// Appends the rules of the shift_state tags in shiftStates[first, end) and their nested tags to shiftRules.
+	/// </summary>
+	/// <param name="parentMask">The buttons of the parent shift_state tags.</param>
+	void compileShiftRules(size_t first, size_t end, uint64_t parentMask);
+	/// <summary>
+	/// Compile a button tag inside the assignments tag, or a shifted_button tag inside a button tag.
+	/// </summary>
+	bool compileButton(const XmlElement& element);
+	bool compileShiftedButton(const XmlElement& element);
+	/// <summary>
+	/// Compile a chord tag inside the assignments tag. Its buttons attribute lists the joystick buttons separated by commas.
+	/// </summary>
+	bool compileChord(const XmlElement& element);
+	/// <summary>
+	/// Fills one row of buttonDispatch or chordDispatch with the actions of a button or chord tag for each shift state id.
+	/// </summary>
+	void fill_dispatch_row(int32_t* row, const AssignmentButton& button) const;
+	/// <summary>
+	/// Describes a button or chord tag in error messages, like "Button 5" or "The chord of buttons 4,5 (mask 0x18)".
+	/// </summary>
+	static std::string describe_button(const AssignmentButton& button);
+	/// <summary>
+	/// Reads the attributes of a button, chord or shifted_button tag into a ButtonAction.
+	/// </summary>
+	/// <param name="owner">The button or chord in error messages, from describe_button.</param>
+	static bool compileButtonAction(const XmlElement& element, const std::string& owner, ButtonAction& action);
+	/// <summary>
+	/// Validate and compile a sequence tag.
+	/// </summary>
+	bool compileSequence(const XmlElement& element);
+	/// <summary>
+	/// Compile a led tag. Its states are appended to indicatorStates as they are closed, and the led itself
+	/// is appended to indicatorLeds by finishLed() when it is closed.
+	/// </summary>
+	bool compileLed(const XmlElement& element);
+	bool finishLed();
+	/// <summary>
+	/// Compile a state tag into openStates. It is moved to indicatorStates when it is closed, after its nested
+	/// state tags, because the innermost state has the highest priority.
+	/// </summary>
+	bool compileState(const XmlElement& element);
+	/// <summary>
+	/// Compiles the condition attribute of a state tag into conditionTerms and conditionCode.
+	/// A condition combines comparisons with and, or, not and parentheses, for example
+	/// "{GEAR HANDLE POSITION%bool} ==1 and ({AIRSPEED INDICATED%knots} --140 or not {SIM ON GROUND%bool} ==1)".
+	/// A SimVar index can be appended to the name after a colon, like {ENG ON FIRE:1%bool}.
+	/// </summary>
+	bool compileCondition(const std::string& condition, IndicatorState& state, const XmlElement& element);
+	/// <summary>
+	/// Recursive descent parser of conditions. Each function parses one level of precedence starting at pos,
+	/// appends the instructions in postfix order to conditionCode and moves pos behind the parsed text.
+	/// </summary>
+	/// <returns>False on a syntax error. If the error was logged already, pos is set to std::string::npos.</returns>
+	bool parseConditionOr(const std::string& condition, size_t& pos, const XmlElement& element);
+	bool parseConditionAnd(const std::string& condition, size_t& pos, const XmlElement& element);
+	bool parseConditionFactor(const std::string& condition, size_t& pos, const XmlElement& element);
+	/// <summary>
+	/// Skips whitespace and returns true if the text at pos is the keyword, followed by whitespace, a parenthesis, or a brace.
+	/// </summary>
+	static bool skipConditionKeyword(const std::string& condition, size_t& pos, std::string_view keyword);
+	/// <summary>
+	/// Generates the calculator code of a led with sim_evaluate="true" and sets the simresult of its states.
+	/// </summary>
+	/// <param name="reason">Set to why the led cannot be evaluated in MSFS, if it returns an empty string.</param>
+	/// <returns>An empty string if the led's states cannot be evaluated in MSFS.</returns>
+	std::string led_calculator_code(IndicatorLed& led, std::string& reason);
+};
+
+#endif
@@ -0,0 +1,247 @@
+/*
+    Copyright (C) 2023  Csaba K Molnár
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "XmlReader.h"
+#include <cctype>
+#include <cstring>
+#ifndef EASYLOGGINGPP_H
+#include "easylogging++.h"
+#endif
+
+int XmlReader::get() {
+	int c = in->sbumpc();
+	if (c == '\n') {
+		line++;
+	}
+	return c;
+}
+
+int XmlReader::peek() {
+	return in->sgetc();
+}
+
+void XmlReader::skip_whitespace() {
+	while (peek() != std::char_traits<char>::eof() && std::isspace(peek())) {
+		get();
+	}
+}
+
+bool XmlReader::skip_until(const char* terminator) {
+	size_t length = std::strlen(terminator);
+	// Knuth-Morris-Pratt: fallback[i] is the length of the longest proper prefix of the
+	// terminator which is also a suffix of its first i + 1 characters. "-->" and "]]>"
+	// repeat their first character, so "--->" must keep 2 matched characters, not restart.
+	std::vector<size_t> fallback(length, 0);
+	for (size_t i = 1, k = 0; i < length; i++) {
+		while (k > 0 && terminator[i] != terminator[k]) {
+			k = fallback[k - 1];
+		}
+		if (terminator[i] == terminator[k]) {
+			k++;
+		}
+		fallback[i] = k;
+	}
+	size_t matched = 0;
+	int c;
+	while ((c = get()) != std::char_traits<char>::eof()) {
+		while (matched > 0 && c != terminator[matched]) {
+			matched = fallback[matched - 1];
+		}
+		if (c == terminator[matched] && ++matched == length) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool XmlReader::read_name(std::string& name) {
+	name.clear();
+	int c = peek();
+	while (c != std::char_traits<char>::eof() && (std::isalnum(c) || c == '_' || c == '-' || c == '.' || c == ':' || c > 127)) {
+		name += static_cast<char>(get());
+		c = peek();
+	}
+	return !name.empty();
+}
+
+bool XmlReader::read_attribute_value(std::string& value) {
+	value.clear();
+	int quote = get();
+	if (quote != '"' && quote != '\'') {
+		return error("Attribute values must be quoted.");
+	}
+	int c;
+	while ((c = get()) != quote) {
+		if (c == std::char_traits<char>::eof() || c == '<') {
+			return error("Unterminated attribute value.");
+		}
+		if (c != '&') {
+			value += static_cast<char>(c);
+			continue;
+		}
+		std::string entity;
+		while ((c = get()) != ';') {
+			if (c == std::char_traits<char>::eof() || entity.size() > 10) {
+				return error("Invalid entity in attribute value.");
+			}
+			entity += static_cast<char>(c);
+		}
+		if (entity == "lt") {
+			value += '<';
+		} else if (entity == "gt") {
+			value += '>';
+		} else if (entity == "amp") {
+			value += '&';
+		} else if (entity == "quot") {
+			value += '"';
+		} else if (entity == "apos") {
+			value += '\'';
+		} else if (entity.size() > 1 && entity[0] == '#') {
+			unsigned long codepoint = 0;
+			try {
+				codepoint = entity[1] == 'x' ? std::stoul(entity.substr(2), nullptr, 16) : std::stoul(entity.substr(1));
+			}
+			catch (const std::exception&) {
+				return error("Invalid character reference &" + entity + ";.");
+			}
+			// Encode the character as UTF-8
+			if (codepoint < 0x80) {
+				value += static_cast<char>(codepoint);
+			} else if (codepoint < 0x800) {
+				value += static_cast<char>(0xC0 | (codepoint >> 6));
+				value += static_cast<char>(0x80 | (codepoint & 0x3F));
+			} else if (codepoint < 0x10000) {
+				value += static_cast<char>(0xE0 | (codepoint >> 12));
+				value += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+				value += static_cast<char>(0x80 | (codepoint & 0x3F));
+			} else {
+				value += static_cast<char>(0xF0 | (codepoint >> 18));
+				value += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+				value += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+				value += static_cast<char>(0x80 | (codepoint & 0x3F));
+			}
+		} else {
+			return error("Unknown entity &" + entity + ";.");
+		}
+	}
+	return true;
+}
+
+bool XmlReader::read_tag(XmlHandler& handler) {
+	// The < was already read
+	int c = peek();
+	if (c == '?') {
+		return skip_until("?>") || error("Unterminated processing instruction.");
+	}
+	if (c == '!') {
+		get();
+		if (peek() == '-') {
+			get();
+			if (get() != '-') {
+				return error("Invalid comment.");
+			}
+			return skip_until("-->") || error("Unterminated comment.");
+		}
+		if (peek() == '[') {
+			return skip_until("]]>") || error("Unterminated CDATA section.");
+		}
+		// DOCTYPE without an internal subset
+		return skip_until(">") || error("Unterminated declaration.");
+	}
+	if (c == '/') {
+		get();
+		std::string name;
+		if (!read_name(name)) {
+			return error("Invalid end tag.");
+		}
+		skip_whitespace();
+		if (get() != '>') {
+			return error("Invalid end tag </" + name + ".");
+		}
+		if (openElements.empty() || openElements.back() != name) {
+			return error("End tag </" + name + "> does not match the start tag" + (openElements.empty() ? "" : " <" + openElements.back() + ">") + ".");
+		}
+		openElements.pop_back();
+		return handler.end_element(name);
+	}
+	element.line = line;
+	element.attributes.clear();
+	if (!read_name(element.name)) {
+		return error("Invalid tag name.");
+	}
+	while (true) {
+		skip_whitespace();
+		c = peek();
+		if (c == '>' || c == '/') {
+			break;
+		}
+		std::pair<std::string, std::string> attribute;
+		if (!read_name(attribute.first)) {
+			return error("Invalid attribute in tag <" + element.name + ">.");
+		}
+		skip_whitespace();
+		if (get() != '=') {
+			return error("Attribute " + attribute.first + " of tag <" + element.name + "> has no value.");
+		}
+		skip_whitespace();
+		if (!read_attribute_value(attribute.second)) {
+			return false;
+		}
+		element.attributes.push_back(std::move(attribute));
+	}
+	bool empty = get() == '/';
+	if (empty && get() != '>') {
+		return error("Invalid empty tag <" + element.name + ">.");
+	}
+	if (!handler.start_element(element)) {
+		return false;
+	}
+	if (empty) {
+		return handler.end_element(element.name);
+	}
+	openElements.push_back(element.name);
+	return true;
+}
+
+bool XmlReader::read(std::istream& stream, XmlHandler& handler) {
+	in = stream.rdbuf();
+	line = 1;
+	openElements.clear();
+	// Skip the UTF-8 byte order mark
+	if (peek() == 0xEF) {
+		get();
+		if (get() != 0xBB || get() != 0xBF) {
+			return error("Invalid byte order mark.");
+		}
+	}
+	int c;
+	while ((c = get()) != std::char_traits<char>::eof()) {
+		// Text content is not used
+		if (c == '<' && !read_tag(handler)) {
+			return false;
+		}
+	}
+	if (!openElements.empty()) {
+		return error("The tag <" + openElements.back() + "> is not closed.");
+	}
+	return true;
+}
+
+bool XmlReader::error(const std::string& message) const {
+	CLOG(ERROR, "toconsole", "tofile") << "XML syntax error in line " << line << ": " << message;
+	return false;
+}
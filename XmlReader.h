@@ -0,0 +1,93 @@
+/*
+    Copyright (C) 2023  Csaba K Molnár
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <istream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef CLASS_XMLREADER_H
+#define CLASS_XMLREADER_H
+
+/// <summary>
+/// A start tag with its attributes, as reported by XmlReader.
+/// </summary>
+struct XmlElement {
+	std::string name;
+	std::vector<std::pair<std::string, std::string>> attributes; // In the order they were written, entities already decoded
+	int line = 0; // Line number of the tag in the file, 0 if not known
+	/// <summary>
+	/// Returns the value of an attribute, or nullptr if the tag has no such attribute.
+	/// </summary>
+	const std::string* find(const char* attribute) const {
+		for (const auto& a : attributes)
+		{
+			if (a.first == attribute)
+			{
+				return &a.second;
+			}
+		}
+		return nullptr;
+	}
+};
+
+/// <summary>
+/// Receives the tags of an XML file from XmlReader in document order.
+/// </summary>
+class XmlHandler
+{
+public:
+	virtual ~XmlHandler() = default;
+	/// <returns>False to stop reading, for example because the tag is invalid. The handler logs the reason.</returns>
+	virtual bool start_element(const XmlElement& element) = 0;
+	virtual bool end_element(const std::string& name) = 0;
+};
+
+/// <summary>
+/// A small streaming (SAX-style) XML reader. It reads the file once and reports each tag to a handler,
+/// without building a tree in memory. Text content, comments, processing instructions, CDATA sections
+/// and DOCTYPE declarations are skipped, because x52msfsout configuration files only use tags and attributes.
+/// Several top-level tags are allowed, like in X52LuaOut configuration files.
+/// </summary>
+class XmlReader
+{
+// VARIABLES
+private:
+	std::streambuf* in = nullptr;
+	int line = 1;
+	std::vector<std::string> openElements;
+	XmlElement element; // Reused for every tag to avoid allocations
+
+// FUNCTIONS
+public:
+	/// <summary>
+	/// Reads the whole stream and reports its tags to handler. Syntax errors are logged with their line number.
+	/// </summary>
+	/// <returns>False on a syntax error or if the handler stopped reading.</returns>
+	bool read(std::istream& stream, XmlHandler& handler);
+private:
+	int get();
+	int peek();
+	void skip_whitespace();
+	bool skip_until(const char* terminator);
+	bool read_name(std::string& name);
+	bool read_attribute_value(std::string& value);
+	bool read_tag(XmlHandler& handler);
+	bool error(const std::string& message) const;
+};
+
+#endif
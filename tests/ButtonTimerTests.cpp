@@ -0,0 +1,330 @@
+/*
+    Copyright (C) 2023  Csaba K Molnár
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <boost/property_tree/xml_parser.hpp>
+#include <sstream>
+
+#include "Check.h"
+#include "Fakes.h"
+#include "x52.h"
+
+namespace {
+
+using namespace std::chrono_literals;
+
+/// <summary>
+/// Compiles an assignments tag and presses its buttons on a clock which only moves when the test advances it.
+/// Commands are mapped to Client Event IDs like MapClientEvents() does.
+/// </summary>
+struct ButtonFixture {
+	X52Config config;
+	X52 x52;
+	TimerWheel::Clock::time_point now = TimerWheel::Clock::time_point(100s);
+
+	explicit ButtonFixture(const std::string& xml) {
+		Fakes::reset();
+		std::istringstream stream(xml);
+		boost::property_tree::ptree tree;
+		boost::property_tree::read_xml(stream, tree);
+		CHECK(config.compile(tree));
+		for (X52Config::ButtonAction& action : config.buttonActions)
+		{
+			if (action.kind == X52Config::ButtonAction::Kind::Command) {
+				action.clienteventid = event_id(action.command);
+			}
+		}
+		x52.buttonClock = [this] { return now; };
+		x52.set_simconnect_handle(nullptr);
+		x52.set_config(&config);
+	}
+
+	DWORD event_id(const std::string& command) const {
+		auto c = std::find(config.clientEvents.begin(), config.clientEvents.end(), command);
+		return c == config.clientEvents.end() ? 0 : X52::EVENT_CLIENTID + static_cast<DWORD>(c - config.clientEvents.begin());
+	}
+
+	void press(int btn) {
+		x52.assignment_button_action(btn, true, now);
+	}
+
+	void release(int btn) {
+		x52.assignment_button_action(btn, false, now);
+	}
+
+	/// <summary>
+	/// Runs the button timers every millisecond for the given time.
+	/// </summary>
+	void advance(std::chrono::milliseconds time) {
+		for (auto end = now + time; now < end; )
+		{
+			now += 1ms;
+			x52.run_button_timers();
+		}
+	}
+
+	/// <summary>
+	/// Number of times the command was sent.
+	/// </summary>
+	int sent(const std::string& command) const {
+		DWORD id = event_id(command);
+		return static_cast<int>(std::count_if(Fakes::clientEvents.begin(), Fakes::clientEvents.end(),
+			[id](const Fakes::ClientEvent& e) { return e.eventId == id; }));
+	}
+
+	/// <summary>
+	/// The data of the last event sent, or -1 if nothing was sent.
+	/// </summary>
+	long last_data() const {
+		return Fakes::clientEvents.empty() ? -1 : static_cast<long>(Fakes::clientEvents.back().data);
+	}
+};
+
+}
+
+TEST(timer_wheel_fires_after_delay_then_every_interval) {
+	TimerWheel wheel(10ms, 16);
+	auto t0 = TimerWheel::Clock::time_point(10s);
+	wheel.start(t0, 500ms, 100ms, 7);
+	std::vector<int> fired;
+	for (int ms = 1; ms <= 800; ms++)
+	{
+		for (size_t key : wheel.advance(t0 + std::chrono::milliseconds(ms)))
+		{
+			CHECK_EQUAL(key, size_t(7));
+			fired.push_back(ms);
+		}
+	}
+	// 500 ms is further ahead than one turn of 16 slots of 10 ms
+	CHECK(fired == std::vector<int>({ 500, 600, 700, 800 }));
+	CHECK_EQUAL(wheel.size(), size_t(1));
+}
+
+TEST(timer_wheel_one_shot_timer_stops_after_firing) {
+	TimerWheel wheel;
+	auto t0 = TimerWheel::Clock::time_point(10s);
+	wheel.start(t0, 25ms, 0ms, 3);
+	// Deadlines are rounded up to the 10 ms resolution
+	CHECK(wheel.advance(t0 + 29ms).empty());
+	CHECK_EQUAL(wheel.advance(t0 + 30ms).size(), size_t(1));
+	CHECK(wheel.advance(t0 + 1000ms).empty());
+	CHECK_EQUAL(wheel.size(), size_t(0));
+}
+
+TEST(timer_wheel_cancel_stops_a_timer) {
+	TimerWheel wheel;
+	auto t0 = TimerWheel::Clock::time_point(10s);
+	TimerWheel::TimerId id = wheel.start(t0, 100ms, 100ms, 1);
+	wheel.start(t0, 100ms, 100ms, 2);
+	CHECK_EQUAL(wheel.advance(t0 + 100ms).size(), size_t(2));
+	wheel.cancel(id);
+	// Cancelling twice is ignored
+	wheel.cancel(id);
+	const std::vector<size_t>& fired = wheel.advance(t0 + 200ms);
+	CHECK(fired == std::vector<size_t>({ 2 }));
+	CHECK_EQUAL(wheel.size(), size_t(1));
+}
+
+TEST(timer_wheel_late_advance_skips_missed_repeats) {
+	TimerWheel wheel;
+	auto t0 = TimerWheel::Clock::time_point(10s);
+	wheel.start(t0, 50ms, 50ms, 4);
+	CHECK_EQUAL(wheel.advance(t0 + 49ms).size(), size_t(0));
+	CHECK_EQUAL(wheel.advance(t0 + 50ms).size(), size_t(1));
+	// The main loop stalled for almost 3 seconds: the timer fires once, and its next deadline keeps its phase
+	CHECK_EQUAL(wheel.advance(t0 + 3020ms).size(), size_t(1));
+	CHECK_EQUAL(wheel.advance(t0 + 3040ms).size(), size_t(0));
+	CHECK_EQUAL(wheel.advance(t0 + 3050ms).size(), size_t(1));
+}
+
+TEST(repeater_repeats_after_its_delay_at_its_interval) {
+	ButtonFixture f(R"(
+		<assignments>
+			<button nr="1" type="repeater" command="ELEV_TRIM_UP" on="1" delay="400" interval="100"/>
+		</assignments>)");
+	f.press(1);
+	CHECK_EQUAL(f.sent("ELEV_TRIM_UP"), 1);
+	f.advance(399ms);
+	CHECK_EQUAL(f.sent("ELEV_TRIM_UP"), 1);
+	f.advance(1ms);
+	CHECK_EQUAL(f.sent("ELEV_TRIM_UP"), 2);
+	f.advance(99ms);
+	CHECK_EQUAL(f.sent("ELEV_TRIM_UP"), 2);
+	f.advance(1ms);
+	CHECK_EQUAL(f.sent("ELEV_TRIM_UP"), 3);
+	f.advance(200ms);
+	CHECK_EQUAL(f.sent("ELEV_TRIM_UP"), 5);
+	CHECK_EQUAL(f.last_data(), 1);
+}
+
+TEST(repeater_uses_the_default_first_repeat_delay) {
+	ButtonFixture f(R"(
+		<assignments>
+			<button nr="1" type="repeater" command="ELEV_TRIM_UP" on="1"/>
+		</assignments>)");
+	f.press(1);
+	f.advance(499ms);
+	CHECK_EQUAL(f.sent("ELEV_TRIM_UP"), 1);
+	f.advance(1ms);
+	CHECK_EQUAL(f.sent("ELEV_TRIM_UP"), 2);
+	f.advance(100ms);
+	CHECK_EQUAL(f.sent("ELEV_TRIM_UP"), 3);
+}
+
+TEST(repeater_stops_on_release) {
+	ButtonFixture f(R"(
+		<assignments>
+			<button nr="1" type="repeater" command="ELEV_TRIM_UP" on="1" delay="400" interval="100"/>
+			<button nr="2" type="repeater" command="ELEV_TRIM_DOWN" on="1" delay="400" interval="100"/>
+		</assignments>)");
+	// Released before the first repeat
+	f.press(1);
+	f.advance(200ms);
+	f.release(1);
+	f.advance(1000ms);
+	CHECK_EQUAL(f.sent("ELEV_TRIM_UP"), 1);
+	// Released while repeating, the other repeater keeps going
+	f.press(1);
+	f.press(2);
+	f.advance(450ms);
+	f.release(1);
+	f.advance(300ms);
+	CHECK_EQUAL(f.sent("ELEV_TRIM_UP"), 3);
+	CHECK_EQUAL(f.sent("ELEV_TRIM_DOWN"), 5);
+	f.release(2);
+	f.advance(1000ms);
+	CHECK_EQUAL(f.sent("ELEV_TRIM_DOWN"), 5);
+	// A new press starts the delay again
+	f.press(1);
+	f.advance(399ms);
+	CHECK_EQUAL(f.sent("ELEV_TRIM_UP"), 4);
+	f.advance(1ms);
+	CHECK_EQUAL(f.sent("ELEV_TRIM_UP"), 5);
+}
+
+TEST(hold_sends_on_when_pressed_and_off_when_released) {
+	ButtonFixture f(R"(
+		<assignments>
+			<button nr="3" type="hold" command="PARKING_BRAKES" on="1" off="0"/>
+		</assignments>)");
+	f.press(3);
+	CHECK_EQUAL(f.sent("PARKING_BRAKES"), 1);
+	CHECK_EQUAL(f.last_data(), 1);
+	// A hold button is not repeated, and a repeated press while held is ignored
+	f.advance(2000ms);
+	f.press(3);
+	CHECK_EQUAL(f.sent("PARKING_BRAKES"), 1);
+	f.release(3);
+	CHECK_EQUAL(f.sent("PARKING_BRAKES"), 2);
+	CHECK_EQUAL(f.last_data(), 0);
+}
+
+TEST(long_press_fires_while_held_after_long_press_time) {
+	ButtonFixture f(R"(
+		<assignments long_press_time="500">
+			<button nr="2" command="FLAPS_DECR" on="1"/>
+			<button nr="2" press="long" type="repeater" command="FLAPS_UP" on="1" delay="300" interval="100"/>
+		</assignments>)");
+	// A short press executes on release
+	f.press(2);
+	f.advance(100ms);
+	CHECK_EQUAL(f.sent("FLAPS_DECR"), 0);
+	f.release(2);
+	CHECK_EQUAL(f.sent("FLAPS_DECR"), 1);
+	// A long press executes when long_press_time has passed, and its repeats are timed from then
+	f.press(2);
+	f.advance(499ms);
+	CHECK_EQUAL(f.sent("FLAPS_UP"), 0);
+	f.advance(1ms);
+	CHECK_EQUAL(f.sent("FLAPS_UP"), 1);
+	f.advance(300ms);
+	CHECK_EQUAL(f.sent("FLAPS_UP"), 2);
+	f.release(2);
+	f.advance(1000ms);
+	CHECK_EQUAL(f.sent("FLAPS_UP"), 2);
+	CHECK_EQUAL(f.sent("FLAPS_DECR"), 1);
+}
+
+TEST(double_press_fires_on_the_second_press_within_double_press_time) {
+	ButtonFixture f(R"(
+		<assignments double_press_time="300">
+			<button nr="4" command="GEAR_UP" on="1"/>
+			<button nr="4" press="double" command="GEAR_DOWN" on="1"/>
+		</assignments>)");
+	// A single press executes once double_press_time has passed without a second press
+	f.press(4);
+	f.release(4);
+	f.advance(250ms);
+	CHECK_EQUAL(f.sent("GEAR_UP"), 0);
+	f.advance(100ms);
+	CHECK_EQUAL(f.sent("GEAR_UP"), 1);
+	// A second press within double_press_time executes the double press, and not the single press
+	f.press(4);
+	f.release(4);
+	f.advance(150ms);
+	f.press(4);
+	CHECK_EQUAL(f.sent("GEAR_DOWN"), 1);
+	f.release(4);
+	f.advance(1000ms);
+	CHECK_EQUAL(f.sent("GEAR_UP"), 1);
+	CHECK_EQUAL(f.sent("GEAR_DOWN"), 1);
+}
+
+TEST(chord_fires_when_its_buttons_are_pressed_within_chord_time) {
+	ButtonFixture f(R"(
+		<assignments chord_time="50">
+			<button nr="5" command="TOGGLE_NAV_LIGHTS"/>
+			<button nr="6" command="TOGGLE_TAXI_LIGHTS"/>
+			<chord buttons="5,6" command="TOGGLE_BEACON_LIGHTS"/>
+		</assignments>)");
+	// Both buttons within chord_time: only the chord is executed
+	f.press(5);
+	f.advance(20ms);
+	f.press(6);
+	CHECK_EQUAL(f.sent("TOGGLE_BEACON_LIGHTS"), 1);
+	f.release(5);
+	f.release(6);
+	f.advance(200ms);
+	CHECK_EQUAL(f.sent("TOGGLE_NAV_LIGHTS"), 0);
+	CHECK_EQUAL(f.sent("TOGGLE_TAXI_LIGHTS"), 0);
+	// One button alone executes its own action after chord_time
+	f.press(5);
+	f.advance(30ms);
+	CHECK_EQUAL(f.sent("TOGGLE_NAV_LIGHTS"), 0);
+	f.advance(40ms);
+	CHECK_EQUAL(f.sent("TOGGLE_NAV_LIGHTS"), 1);
+	// Too late for the chord
+	f.press(6);
+	f.advance(100ms);
+	CHECK_EQUAL(f.sent("TOGGLE_TAXI_LIGHTS"), 1);
+	CHECK_EQUAL(f.sent("TOGGLE_BEACON_LIGHTS"), 1);
+}
+
+TEST(chord_button_does_not_wait_if_its_chord_cannot_start) {
+	ButtonFixture f(R"(
+		<assignments chord_time="50">
+			<button nr="5" command="TOGGLE_NAV_LIGHTS"/>
+			<button nr="6" command="TOGGLE_TAXI_LIGHTS"/>
+			<chord buttons="5,6" command="TOGGLE_BEACON_LIGHTS"/>
+		</assignments>)");
+	f.press(6);
+	f.advance(100ms);
+	CHECK_EQUAL(f.sent("TOGGLE_TAXI_LIGHTS"), 1);
+	// Button 6 is held for its own action, so button 5 executes as soon as it is pressed
+	f.press(5);
+	CHECK_EQUAL(f.sent("TOGGLE_NAV_LIGHTS"), 1);
+	CHECK_EQUAL(f.sent("TOGGLE_BEACON_LIGHTS"), 0);
+}
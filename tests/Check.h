@@ -0,0 +1,70 @@
+/*
+    Copyright (C) 2023  Csaba K Molnár
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef CLASS_CHECK_H
+#define CLASS_CHECK_H
+
+/// <summary>
+/// A test of x52tests, registered by the TEST macro and run by main() in TestMain.cpp.
+/// </summary>
+struct TestCase {
+	const char* name;
+	void (*function)();
+};
+
+std::vector<TestCase>& test_cases();
+
+struct TestRegistration {
+	TestRegistration(const char* name, void (*function)()) {
+		test_cases().push_back({ name, function });
+	}
+};
+
+/// <summary>
+/// Counts a failed check and prints where it failed. A test continues after a failed check.
+/// </summary>
+void check_failed(const char* file, int line, const std::string& message);
+
+#define TEST(name) \
+	static void name(); \
+	static TestRegistration name##_registration(#name, name); \
+	static void name()
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			check_failed(__FILE__, __LINE__, #condition); \
+		} \
+	} while (false)
+
+#define CHECK_EQUAL(actual, expected) \
+	do { \
+		auto actualValue = (actual); \
+		auto expectedValue = (expected); \
+		if (!(actualValue == expectedValue)) { \
+			std::ostringstream message; \
+			message << #actual << " is " << actualValue << ", expected " << expectedValue; \
+			check_failed(__FILE__, __LINE__, message.str()); \
+		} \
+	} while (false)
+
+#endif
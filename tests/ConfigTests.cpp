@@ -0,0 +1,276 @@
+/*
+    Copyright (C) 2023  Csaba K Molnár
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <boost/property_tree/xml_parser.hpp>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Check.h"
+#include "ConfigCache.h"
+#include "X52Config.h"
+#include "XmlReader.h"
+
+namespace {
+
+/// <summary>
+/// Compiles an XML snippet the way the --ptreeloader option does.
+/// </summary>
+bool compile(const std::string& xml, X52Config& config) {
+	std::istringstream stream(xml);
+	boost::property_tree::ptree tree;
+	boost::property_tree::read_xml(stream, tree);
+	return config.compile(tree);
+}
+
+/// <summary>
+/// Records the tags XmlReader reports.
+/// </summary>
+struct RecordingHandler : XmlHandler {
+	std::vector<XmlElement> elements;
+	std::vector<std::string> ends;
+	bool start_element(const XmlElement& element) override {
+		elements.push_back(element);
+		return true;
+	}
+	bool end_element(const std::string& name) override {
+		ends.push_back(name);
+		return true;
+	}
+};
+
+/// <summary>
+/// An XML file in the temporary directory which is removed with its cache file at the end of the test.
+/// </summary>
+struct TempXmlFile {
+	std::string filename;
+	explicit TempXmlFile(const std::string& xml) : filename((std::filesystem::temp_directory_path() / "x52tests_config.xml").string()) {
+		write(xml);
+	}
+	~TempXmlFile() {
+		std::error_code ec;
+		std::filesystem::remove(filename, ec);
+		std::filesystem::remove(ConfigCache(filename).get_cache_filename(), ec);
+	}
+	void write(const std::string& xml) const {
+		std::ofstream(filename, std::ios::binary | std::ios::trunc) << xml;
+	}
+};
+
+const char* const CACHED_XML = R"xml(
+	<shift_states>
+		<shift_state name="mode1" button="28"/>
+	</shift_states>
+	<assignments>
+		<button nr="18" command="ELEV_TRIM_UP" type="repeater" delay="400" interval="100">
+			<shifted_button shift_state="mode1" calculator_code="(A:ELEVATOR TRIM POSITION, Radians) 0.005 + (&gt;A:ELEVATOR TRIM POSITION, Radians)"/>
+		</button>
+		<chord buttons="17,18" dataref="ELEVATOR TRIM POSITION%Radians" on="0"/>
+	</assignments>
+	<indicators>
+		<led id="t1">
+			<state light="off" dataref="FLAPS HANDLE PERCENT%percent" op="--5">
+				<state light="blink" dataref="FLAPS HANDLE PERCENT%percent" op="[]30:60" hysteresis="2" dwell="300"/>
+			</state>
+		</led>
+		<led id="b">
+			<state light="red" condition="{GEAR HANDLE POSITION%Bool} ==1 and not {GENERAL ENG RPM:1%rpm} ++100"/>
+		</led>
+	</indicators>
+	<sequences>
+		<sequence name="blink" pattern="g a " speed="4" loop="3"/>
+	</sequences>)xml";
+
+std::string led_with_condition(const std::string& condition) {
+	return "<indicators><led id=\"b\"><state light=\"red\" condition=\"" + condition + "\"/></led></indicators>";
+}
+
+}
+
+TEST(rpn_numbers_have_no_exponent) {
+	// MSFS calculator code does not accept 1e+20
+	CHECK_EQUAL(X52Config::parse_xml_op("++100000000000000000000").to_rpn("l0"), std::string("l0 100000000000000000000 >"));
+	CHECK_EQUAL(X52Config::parse_xml_op("--0.00001").to_rpn("l0"), std::string("l0 0.00001 <"));
+	CHECK_EQUAL(X52Config::parse_xml_op("==-2.5").to_rpn("l0"), std::string("l0 -2.5 =="));
+	CHECK_EQUAL(X52Config::parse_xml_op("[]10:20").to_rpn("l1"), std::string("l1 10 >= l1 20 <= and"));
+}
+
+TEST(bit_masks_are_limited_to_32_bits) {
+	CHECK(X52Config::parse_xml_op("##4294967295").type == X52Config::XmlOp::Type::BitsSet);
+	CHECK(X52Config::parse_xml_op("##4294967296").type == X52Config::XmlOp::Type::Invalid);
+	CHECK_EQUAL(X52Config::parse_xml_op("##6").to_rpn("l0"), std::string("l0 flr 6 & 6 =="));
+}
+
+TEST(condition_compiles_to_postfix_code) {
+	X52Config config;
+	CHECK(compile(led_with_condition("{ENG ON FIRE:2%Bool} ==1 and not ({ALTITUDE%feet} ++10 or {AIRSPEED%knots} --5)"), config));
+	CHECK_EQUAL(config.conditionTerms.size(), 3u);
+	CHECK_EQUAL(config.conditionTerms[0].dataref, std::string("ENG ON FIRE"));
+	CHECK_EQUAL(config.conditionTerms[0].unit, std::string("Bool"));
+	CHECK_EQUAL(static_cast<int>(config.conditionTerms[0].simvarindex), 2);
+	CHECK(config.conditionTerms[2].op.type == X52Config::XmlOp::Type::Less);
+	using Type = X52Config::ConditionInstruction::Type;
+	const Type expected[] = { Type::Test, Type::Test, Type::Test, Type::Or, Type::Not, Type::And };
+	CHECK_EQUAL(config.conditionCode.size(), std::size(expected));
+	for (size_t i = 0; i < config.conditionCode.size() && i < std::size(expected); i++)
+	{
+		CHECK(config.conditionCode[i].type == expected[i]);
+	}
+}
+
+TEST(condition_syntax_errors_are_rejected) {
+	X52Config a;
+	CHECK(!compile(led_with_condition("{ALTITUDE%feet} ++10 and"), a));
+	X52Config b;
+	CHECK(!compile(led_with_condition("({ALTITUDE%feet} ++10"), b));
+	X52Config c;
+	CHECK(!compile(led_with_condition("{ALTITUDE} ++10"), c));
+	X52Config d;
+	CHECK(!compile(led_with_condition("{ALTITUDE%feet} >>10"), d));
+}
+
+TEST(simvar_indexes_must_fit_a_byte) {
+	X52Config a;
+	CHECK(compile(led_with_condition("{ENG ON FIRE:255%Bool} ==1"), a));
+	CHECK_EQUAL(static_cast<int>(a.conditionTerms[0].simvarindex), 255);
+	X52Config b;
+	CHECK(!compile(led_with_condition("{ENG ON FIRE:256%Bool} ==1"), b));
+	// Too large for an int, must not throw
+	X52Config c;
+	CHECK(!compile(led_with_condition("{ENG ON FIRE:99999999999%Bool} ==1"), c));
+	X52Config d;
+	CHECK(!compile("<indicators><led id=\"b\"><state light=\"red\" dataref=\"ENG ON FIRE%Bool\" index=\"256\" op=\"==1\"/></led></indicators>", d));
+	X52Config e;
+	CHECK(!compile("<indicators><led id=\"b\"><state light=\"red\" dataref=\"ENG ON FIRE%Bool\" index=\"-1\" op=\"==1\"/></led></indicators>", e));
+}
+
+TEST(xml_reader_reports_line_numbers_and_decodes_entities) {
+	std::istringstream xml(
+		"<?xml version=\"1.0\"?>\n"
+		"<!-- A comment\n spanning two lines -->\n"
+		"<indicators>\n"
+		"  <led id=\"a\"\n"
+		"       name='&lt;&amp;&gt;&quot;&apos;'>\n"
+		"    <state op=\"==&#49;&#x41;&#233;\"/>\n"
+		"  </led>\n"
+		"</indicators>\n");
+	XmlReader reader;
+	RecordingHandler handler;
+	CHECK(reader.read(xml, handler));
+	CHECK_EQUAL(handler.elements.size(), 3u);
+	if (handler.elements.size() == 3) {
+		CHECK_EQUAL(handler.elements[0].line, 4);
+		CHECK_EQUAL(handler.elements[1].line, 5);
+		CHECK_EQUAL(handler.elements[2].line, 7);
+		CHECK_EQUAL(*handler.elements[1].find("name"), std::string("<&>\"'"));
+		CHECK_EQUAL(*handler.elements[2].find("op"), std::string("==1A\xC3\xA9"));
+	}
+	// The self-closing state tag is ended too
+	CHECK_EQUAL(handler.ends.size(), 3u);
+}
+
+TEST(xml_reader_rejects_invalid_xml) {
+	const char* invalid[] = {
+		"<led id=\"a\"></state>",
+		"<led id=a/>",
+		"<led id=\"&unknown;\"/>",
+		"<led id=\"&#xZZ;\"/>",
+		"<led id=\"a\">",
+	};
+	for (const char* text : invalid)
+	{
+		std::istringstream xml(text);
+		XmlReader reader;
+		RecordingHandler handler;
+		CHECK(!reader.read(xml, handler));
+	}
+}
+
+TEST(cache_round_trip_restores_the_compiled_tables) {
+	TempXmlFile xml(CACHED_XML);
+	X52Config compiled;
+	CHECK(compiled.load(xml.filename));
+	CHECK(ConfigCache(xml.filename).save(compiled));
+	X52Config cached;
+	CHECK(ConfigCache(xml.filename).load(cached));
+	CHECK(ConfigCache::serialize(cached) == ConfigCache::serialize(compiled));
+	CHECK_EQUAL(cached.indicatorStates.size(), 3u);
+	CHECK_EQUAL(cached.indicatorStates[0].light, std::string("blink"));
+	CHECK_EQUAL(cached.indicatorStates[0].dwell, 300);
+	CHECK_EQUAL(cached.conditionTerms.size(), 2u);
+	CHECK_EQUAL(cached.chords.size(), 1u);
+	CHECK_EQUAL(cached.sequences.size(), 1u);
+}
+
+TEST(changed_or_damaged_cache_files_are_not_used) {
+	TempXmlFile xml(CACHED_XML);
+	X52Config compiled;
+	CHECK(compiled.load(xml.filename));
+	ConfigCache cache(xml.filename);
+	CHECK(cache.save(compiled));
+	std::string cacheFilename = cache.get_cache_filename();
+	std::string content;
+	{
+		std::ifstream file(cacheFilename, std::ios::binary);
+		content.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+	// A flipped byte in the tables
+	std::string damaged = content;
+	damaged[damaged.size() / 2] ^= 0x5a;
+	std::ofstream(cacheFilename, std::ios::binary | std::ios::trunc) << damaged;
+	X52Config a;
+	CHECK(!ConfigCache(xml.filename).load(a));
+	// A truncated file
+	std::ofstream(cacheFilename, std::ios::binary | std::ios::trunc) << content.substr(0, content.size() - 1);
+	X52Config b;
+	CHECK(!ConfigCache(xml.filename).load(b));
+	// The XML file has changed since the cache file was written
+	std::ofstream(cacheFilename, std::ios::binary | std::ios::trunc) << content;
+	X52Config c;
+	CHECK(ConfigCache(xml.filename).load(c));
+	xml.write(std::string(CACHED_XML) + " ");
+	X52Config d;
+	CHECK(!ConfigCache(xml.filename).load(d));
+}
+
+TEST(corrupt_tables_are_rejected_by_deserialize) {
+	X52Config compiled;
+	TempXmlFile xml(CACHED_XML);
+	CHECK(compiled.load(xml.filename));
+	std::string tables = ConfigCache::serialize(compiled);
+	// Every truncation must be detected, not read past the end
+	for (size_t size = 0; size < tables.size(); size += 7)
+	{
+		X52Config truncated;
+		CHECK(!ConfigCache::deserialize(tables.data(), size, truncated));
+	}
+	// Indexes out of range, from bytes overwritten with 0xff
+	size_t rejected = 0;
+	for (size_t i = 0; i < tables.size(); i += 13)
+	{
+		std::string corrupt = tables;
+		corrupt[i] = static_cast<char>(0xff);
+		X52Config config;
+		if (!ConfigCache::deserialize(corrupt.data(), corrupt.size(), config)) {
+			rejected++;
+		}
+	}
+	CHECK(rejected > 0);
+}
@@ -0,0 +1,88 @@
+/*
+    Copyright (C) 2023  Csaba K Molnár
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "Fakes.h"
+#include "x52.h"
+
+namespace Fakes
+{
+	std::vector<ClientEvent> clientEvents;
+	std::map<std::string, std::string> ledColors;
+	int ledWrites = 0;
+	std::map<std::string, std::string> ledSequences;
+
+	void reset() {
+		clientEvents.clear();
+		ledColors.clear();
+		ledWrites = 0;
+		ledSequences.clear();
+	}
+}
+
+SIMCONNECTAPI SimConnect_TransmitClientEvent(HANDLE hSimConnect, SIMCONNECT_OBJECT_ID ObjectID, SIMCONNECT_CLIENT_EVENT_ID EventID, DWORD dwData, SIMCONNECT_NOTIFICATION_GROUP_ID GroupID, SIMCONNECT_EVENT_FLAG Flags) {
+	Fakes::clientEvents.push_back({ EventID, dwData });
+	return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_GetLastSentPacketID(HANDLE hSimConnect, DWORD* pdwError) {
+	*pdwError = 0;
+	return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_ClearDataDefinition(HANDLE hSimConnect, SIMCONNECT_DATA_DEFINITION_ID DefineID) {
+	return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_AddToDataDefinition(HANDLE hSimConnect, SIMCONNECT_DATA_DEFINITION_ID DefineID, const char* DatumName, const char* UnitsName, SIMCONNECT_DATATYPE DatumType, float fEpsilon, DWORD DatumID) {
+	return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_SetDataOnSimObject(HANDLE hSimConnect, SIMCONNECT_DATA_DEFINITION_ID DefineID, SIMCONNECT_OBJECT_ID ObjectID, SIMCONNECT_DATA_SET_FLAG Flags, DWORD ArrayCount, DWORD cbUnitSize, void* pDataSet) {
+	return S_OK;
+}
+
+HRESULT WASimCommander::Client::WASimClient::executeCalculatorCode(const std::string& code, WASimCommander::Enums::CalcResultType resultType, double* pfResult, std::string* psResult) const {
+	return E_FAIL;
+}
+
+x52HID::~x52HID() {
+}
+
+bool x52HID::setLedColor(const std::string& targetLed, const std::string& color) {
+	Fakes::ledColors[targetLed] = color;
+	Fakes::ledWrites++;
+	return true;
+}
+
+void x52HID::setShift(std::string_view shiftState) {
+}
+
+void x52HID::setMFDTextLine(int line, std::string text) {
+}
+
+void x52HID::clearMFDTextLine(int line) {
+}
+
+LedBlinker::LedBlinker() {
+}
+
+LedBlinker::~LedBlinker() {
+}
+
+void LedBlinker::setLedToSequence(LedBlinker::LedSequence& newData) {
+	Fakes::ledSequences[newData.led] = newData.sequence;
+}
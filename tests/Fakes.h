@@ -0,0 +1,58 @@
+/*
+    Copyright (C) 2023  Csaba K Molnár
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <map>
+#include <string>
+#include <vector>
+#include <windows.h>
+
+#ifndef CLASS_FAKES_H
+#define CLASS_FAKES_H
+
+/// <summary>
+/// What x52.cpp sent to SimConnect, the joystick and the blinker thread. Fakes.cpp replaces SimConnect.lib, WASimClient.lib,
+/// x52HID.cpp and LedBlinker.cpp, so the tests run without MSFS and without a joystick.
+/// </summary>
+namespace Fakes
+{
+	struct ClientEvent {
+		DWORD eventId;
+		DWORD data;
+	};
+	/// <summary>
+	/// The events of SimConnect_TransmitClientEvent, in the order they were sent.
+	/// </summary>
+	extern std::vector<ClientEvent> clientEvents;
+	/// <summary>
+	/// The last color x52HID::setLedColor set for each led.
+	/// </summary>
+	extern std::map<std::string, std::string> ledColors;
+	/// <summary>
+	/// Number of x52HID::setLedColor calls.
+	/// </summary>
+	extern int ledWrites;
+	/// <summary>
+	/// The last sequence sent to the blinker thread for each led, empty if the led stopped blinking.
+	/// </summary>
+	extern std::map<std::string, std::string> ledSequences;
+	/// <summary>
+	/// Forgets everything that was sent.
+	/// </summary>
+	void reset();
+}
+
+#endif
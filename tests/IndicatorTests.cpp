@@ -0,0 +1,407 @@
+/*
+    Copyright (C) 2023  Csaba K Molnár
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <boost/property_tree/xml_parser.hpp>
+#include <sstream>
+
+#include "Check.h"
+#include "Fakes.h"
+#include "x52.h"
+
+namespace {
+
+using namespace std::chrono_literals;
+
+/// <summary>
+/// Compiles an indicators tag and evaluates its leds with values fed in by the test, on a clock which only moves when the
+/// test advances it. Requests are shared by states reading the same SimVar in the same unit, like AssignIndicatorRequests()
+/// does without bucket requests.
+/// </summary>
+struct IndicatorFixture {
+	X52Config config;
+	IndicatorRequests requests;
+	X52 x52;
+	x52HID hid;
+	LedBlinker blinker;
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::time_point(100s);
+
+	explicit IndicatorFixture(const std::string& xml) {
+		Fakes::reset();
+		std::istringstream stream(xml);
+		boost::property_tree::ptree tree;
+		boost::property_tree::read_xml(stream, tree);
+		CHECK(config.compile(tree));
+		for (X52Config::IndicatorState& state : config.indicatorStates)
+		{
+			if (state.instructionCount == 0) {
+				state.requestid = request(state.dataref, state.unit, state.simvarindex, state.op.is_trend());
+			}
+		}
+		for (X52Config::ConditionTerm& term : config.conditionTerms)
+		{
+			term.requestid = request(term.dataref, term.unit, term.simvarindex, term.op.is_trend());
+		}
+		x52.indicatorClock = [this] { return now; };
+		x52.set_x52HID(hid);
+		x52.set_LedBlinker(blinker);
+		x52.set_config(&config);
+		x52.setIndicatorRequests(requests);
+		x52.index_indicator_requests();
+		x52.set_coalesce_window(0);
+	}
+
+	int request(const std::string& dataref, const std::string& unit, uint8_t simvarindex, bool trend) {
+		int requestid = requests.find(dataref, unit, simvarindex);
+		if (requestid == 0) {
+			IndicatorRequests::Request r;
+			r.dataref = dataref;
+			r.unit = unit;
+			r.simvarindex = simvarindex;
+			requestid = requests.add(std::move(r));
+		}
+		requests.find(requestid)->trend |= trend;
+		return requestid;
+	}
+
+	/// <summary>
+	/// Sends a new value of a SimVar, as the WASim callback does, and runs the main loop once.
+	/// </summary>
+	void feed(const std::string& dataref, const std::string& unit, double value) {
+		CHECK(x52.store_indicator_value(requests.find(dataref, unit, 0), value));
+		loop();
+	}
+
+	/// <summary>
+	/// Runs the main loop every 10 ms for the given time.
+	/// </summary>
+	void advance(std::chrono::milliseconds time) {
+		for (auto end = now + time; now < end; )
+		{
+			now += 10ms;
+			loop();
+		}
+	}
+
+	void loop() {
+		x52.evaluate_dirty_leds();
+		x52.evaluate_dwelling_leds();
+		x52.evaluate_trend_leds();
+	}
+
+	std::string light(const std::string& led) const {
+		auto color = Fakes::ledColors.find(led);
+		return color == Fakes::ledColors.end() ? "" : color->second;
+	}
+};
+
+}
+
+TEST(hysteresis_keeps_the_active_state_near_its_threshold) {
+	IndicatorFixture f(R"(
+		<indicators>
+			<led id="t1">
+				<state light="green" dataref="FLAPS HANDLE PERCENT%percent" op="++30" hysteresis="2"/>
+			</led>
+		</indicators>)");
+	f.feed("FLAPS HANDLE PERCENT", "percent", 31);
+	CHECK_EQUAL(f.light("t1"), "green");
+	// Below the threshold, but within the hysteresis
+	f.feed("FLAPS HANDLE PERCENT", "percent", 29);
+	CHECK_EQUAL(f.light("t1"), "green");
+	f.feed("FLAPS HANDLE PERCENT", "percent", 28.5);
+	CHECK_EQUAL(f.light("t1"), "green");
+	CHECK_EQUAL(f.x52.indicatorStatistics.suppressedByHysteresis.load(), 2ul);
+	f.feed("FLAPS HANDLE PERCENT", "percent", 27.9);
+	CHECK_EQUAL(f.light("t1"), "off");
+	// The hysteresis only keeps a state active, it does not activate it
+	f.feed("FLAPS HANDLE PERCENT", "percent", 29);
+	CHECK_EQUAL(f.light("t1"), "off");
+	f.feed("FLAPS HANDLE PERCENT", "percent", 30.5);
+	CHECK_EQUAL(f.light("t1"), "green");
+	CHECK_EQUAL(Fakes::ledWrites, 3);
+}
+
+TEST(hysteresis_uses_the_unit_of_a_shared_request) {
+	IndicatorFixture f(R"(
+		<indicators>
+			<led id="t1">
+				<state light="green" dataref="FLAPS HANDLE PERCENT%percent over 100" op="++0.3" hysteresis="0.02"/>
+			</led>
+		</indicators>)");
+	// The request is in percent, the state reads percent over 100
+	f.config.indicatorStates[0].unitFactor = 0.01;
+	f.feed("FLAPS HANDLE PERCENT", "percent over 100", 31);
+	CHECK_EQUAL(f.light("t1"), "green");
+	f.feed("FLAPS HANDLE PERCENT", "percent over 100", 28.5);
+	CHECK_EQUAL(f.light("t1"), "green");
+	f.feed("FLAPS HANDLE PERCENT", "percent over 100", 27.9);
+	CHECK_EQUAL(f.light("t1"), "off");
+}
+
+TEST(dwell_holds_a_state_for_its_dwell_time) {
+	IndicatorFixture f(R"(
+		<indicators>
+			<led id="a">
+				<state light="green" dataref="GEAR POSITION%percent" op="--50">
+					<state light="red" dataref="GEAR POSITION%percent" op="++50" dwell="500"/>
+				</state>
+			</led>
+		</indicators>)");
+	f.feed("GEAR POSITION", "percent", 60);
+	CHECK_EQUAL(f.light("a"), "red");
+	f.advance(100ms);
+	f.feed("GEAR POSITION", "percent", 40);
+	CHECK_EQUAL(f.light("a"), "red");
+	CHECK_EQUAL(f.x52.indicatorStatistics.suppressedByDwell.load(), 1ul);
+	f.advance(390ms);
+	CHECK_EQUAL(f.light("a"), "red");
+	// The dwell time ends 500 ms after red was set, and evaluate_dwelling_leds() shows the state which is true now
+	f.advance(10ms);
+	CHECK_EQUAL(f.light("a"), "green");
+	// Green has no dwell time
+	f.feed("GEAR POSITION", "percent", 60);
+	CHECK_EQUAL(f.light("a"), "red");
+}
+
+TEST(dwell_shows_the_held_state_again_if_it_became_true_again) {
+	IndicatorFixture f(R"(
+		<indicators>
+			<led id="a">
+				<state light="green" dataref="GEAR POSITION%percent" op="--50">
+					<state light="red" dataref="GEAR POSITION%percent" op="++50" dwell="500"/>
+				</state>
+			</led>
+		</indicators>)");
+	f.feed("GEAR POSITION", "percent", 60);
+	f.advance(100ms);
+	f.feed("GEAR POSITION", "percent", 40);
+	f.advance(100ms);
+	f.feed("GEAR POSITION", "percent", 70);
+	f.advance(400ms);
+	CHECK_EQUAL(f.light("a"), "red");
+	CHECK_EQUAL(Fakes::ledWrites, 1);
+}
+
+TEST(rising_trend_follows_the_rate_of_the_last_second) {
+	IndicatorFixture f(R"(
+		<indicators>
+			<led id="e">
+				<state light="on" dataref="INDICATED ALTITUDE%feet" op="/+10"/>
+			</led>
+		</indicators>)");
+	f.feed("INDICATED ALTITUDE", "feet", 0);
+	CHECK_EQUAL(f.light("e"), "off");
+	// 5 feet per second
+	for (int i = 1; i <= 10; i++)
+	{
+		f.advance(100ms);
+		f.feed("INDICATED ALTITUDE", "feet", i * 0.5);
+	}
+	CHECK_EQUAL(f.light("e"), "off");
+	// 20 feet per second
+	for (int i = 1; i <= 10; i++)
+	{
+		f.advance(100ms);
+		f.feed("INDICATED ALTITUDE", "feet", 5 + i * 2);
+	}
+	CHECK_EQUAL(f.light("e"), "on");
+	// No new data arrives when the value stops changing, evaluate_trend_leds() switches the led off
+	f.advance(1000ms);
+	CHECK_EQUAL(f.light("e"), "off");
+}
+
+TEST(changed_trend_turns_off_after_its_window) {
+	IndicatorFixture f(R"(
+		<indicators>
+			<led id="d">
+				<state light="amber" dataref="ELEVATOR TRIM POSITION%radians" op="@@500"/>
+			</led>
+		</indicators>)");
+	f.feed("ELEVATOR TRIM POSITION", "radians", 0.1);
+	CHECK_EQUAL(f.light("d"), "off");
+	f.advance(100ms);
+	f.feed("ELEVATOR TRIM POSITION", "radians", 0.2);
+	CHECK_EQUAL(f.light("d"), "amber");
+	f.advance(400ms);
+	CHECK_EQUAL(f.light("d"), "amber");
+	f.advance(200ms);
+	CHECK_EQUAL(f.light("d"), "off");
+}
+
+TEST(condition_combines_values_of_two_requests) {
+	IndicatorFixture f(R"(
+		<indicators>
+			<led id="b">
+				<state light="red" condition="{GEAR HANDLE POSITION%Bool} ==1 and not {GENERAL ENG RPM:1%rpm} ++100"/>
+			</led>
+		</indicators>)");
+	f.feed("GEAR HANDLE POSITION", "Bool", 1);
+	CHECK_EQUAL(f.light("b"), "red");
+	CHECK(f.x52.store_indicator_value(f.requests.find("GENERAL ENG RPM", "rpm", 1), 2000));
+	f.loop();
+	CHECK_EQUAL(f.light("b"), "off");
+}
+
+TEST(requests_are_found_before_and_after_the_hash_index_is_built) {
+	IndicatorRequests requests;
+	std::vector<int> requestIds;
+	for (size_t i = 0; i < IndicatorRequests::LINEAR_SEARCH_LIMIT * 2; i++)
+	{
+		IndicatorRequests::Request request;
+		request.dataref = "GENERAL ENG RPM";
+		request.unit = i % 2 ? "rpm" : "percent";
+		request.simvarindex = static_cast<uint8_t>(i / 2);
+		requestIds.push_back(requests.add(std::move(request)));
+		// Every request added so far, also those added before the index
+		for (size_t j = 0; j <= i; j++)
+		{
+			CHECK_EQUAL(requests.find("GENERAL ENG RPM", j % 2 ? "rpm" : "percent", static_cast<uint8_t>(j / 2)), requestIds[j]);
+		}
+		CHECK_EQUAL(requests.find("GENERAL ENG RPM", "feet", 0), 0);
+	}
+	// Renumbered requests are found under their new RequestID
+	std::vector<int> newIds(requests.end_id(), 0);
+	for (int requestid : requestIds)
+	{
+		newIds[requestid] = requestid + 100;
+	}
+	requests.renumber(newIds);
+	CHECK_EQUAL(requests.find("GENERAL ENG RPM", "rpm", 3), requestIds[7] + 100);
+}
+
+TEST(swapped_leds_wait_for_the_first_value_of_added_requests) {
+	IndicatorFixture f(R"(
+		<indicators>
+			<led id="b">
+				<state light="red" dataref="GEAR HANDLE POSITION%Bool" op="==1"/>
+			</led>
+		</indicators>)");
+	f.feed("GEAR HANDLE POSITION", "Bool", 1);
+	CHECK_EQUAL(f.light("b"), "red");
+	// The new configuration reads the gear handle and a new SimVar, whose value 0 would switch the led off
+	std::istringstream stream(R"(
+		<indicators>
+			<led id="b">
+				<state light="green" condition="{GEAR HANDLE POSITION%Bool} ==1 and {GENERAL ENG RPM:1%rpm} ++100"/>
+			</led>
+			<led id="a">
+				<state light="amber" dataref="GEAR HANDLE POSITION%Bool" op="==1"/>
+			</led>
+		</indicators>)");
+	boost::property_tree::ptree tree;
+	boost::property_tree::read_xml(stream, tree);
+	X52Config config;
+	CHECK(config.compile(tree));
+	IndicatorRequests requests;
+	IndicatorRequests::Request gear;
+	gear.dataref = "GEAR HANDLE POSITION";
+	gear.unit = "Bool";
+	int gearId = requests.add(std::move(gear));
+	IndicatorRequests::Request rpm;
+	rpm.dataref = "GENERAL ENG RPM";
+	rpm.unit = "rpm";
+	rpm.simvarindex = 1;
+	int rpmId = requests.add(std::move(rpm));
+	config.conditionTerms[0].requestid = gearId;
+	config.conditionTerms[1].requestid = rpmId;
+	config.indicatorStates[1].requestid = gearId;
+	f.x52.swap_config(config, requests);
+	f.x52.evaluate_indicators();
+	// Led a has the value of the kept request, led b keeps its light
+	CHECK_EQUAL(f.light("a"), "amber");
+	CHECK_EQUAL(f.light("b"), "red");
+	f.advance(1s);
+	CHECK_EQUAL(f.light("b"), "red");
+	CHECK(f.x52.store_indicator_value(rpmId, 2000));
+	f.loop();
+	CHECK_EQUAL(f.light("b"), "green");
+}
+
+TEST(swapped_leds_are_set_if_a_request_never_sends_a_value) {
+	IndicatorFixture f(R"(
+		<indicators>
+			<led id="b">
+				<state light="red" dataref="GEAR HANDLE POSITION%Bool" op="==1"/>
+			</led>
+		</indicators>)");
+	f.feed("GEAR HANDLE POSITION", "Bool", 1);
+	X52Config config;
+	std::istringstream stream(R"(
+		<indicators>
+			<led id="b">
+				<state light="green" dataref="NO SUCH SIMVAR%Bool" op="==1"/>
+			</led>
+		</indicators>)");
+	boost::property_tree::ptree tree;
+	boost::property_tree::read_xml(stream, tree);
+	CHECK(config.compile(tree));
+	IndicatorRequests requests;
+	IndicatorRequests::Request missing;
+	missing.dataref = "NO SUCH SIMVAR";
+	missing.unit = "Bool";
+	requests.add(IndicatorRequests::Request());
+	config.indicatorStates[0].requestid = requests.add(std::move(missing));
+	f.x52.swap_config(config, requests);
+	f.x52.evaluate_indicators();
+	CHECK_EQUAL(f.light("b"), "red");
+	// X52::INITIAL_DATA_TIMEOUT
+	f.advance(5100ms);
+	CHECK_EQUAL(f.light("b"), "off");
+}
+
+TEST(switching_back_to_a_profile_waits_for_its_requests_again) {
+	// Profiles keep their configuration and requests, so the registry of a profile still holds the values of its last activation
+	IndicatorFixture f(R"(
+		<indicators>
+			<led id="b">
+				<state light="red" dataref="GEAR HANDLE POSITION%Bool" op="==1"/>
+			</led>
+		</indicators>)");
+	f.feed("GEAR HANDLE POSITION", "Bool", 1);
+	CHECK_EQUAL(f.light("b"), "red");
+	X52Config other;
+	std::istringstream stream(R"(
+		<indicators>
+			<led id="b">
+				<state light="green" dataref="GENERAL ENG RPM:1%rpm" op="++100"/>
+			</led>
+		</indicators>)");
+	boost::property_tree::ptree tree;
+	boost::property_tree::read_xml(stream, tree);
+	CHECK(other.compile(tree));
+	IndicatorRequests otherRequests;
+	IndicatorRequests::Request rpm;
+	rpm.dataref = "GENERAL ENG RPM";
+	rpm.unit = "rpm";
+	rpm.simvarindex = 1;
+	otherRequests.add(std::move(rpm));
+	// A RequestID which the first profile does not use, like RequestIdDirectory gives it
+	otherRequests.renumber({ 0, 2 });
+	int rpmId = 2;
+	other.indicatorStates[0].requestid = rpmId;
+	f.x52.swap_config(other, otherRequests);
+	f.x52.evaluate_indicators();
+	CHECK(f.x52.store_indicator_value(rpmId, 2000));
+	f.loop();
+	CHECK_EQUAL(f.light("b"), "green");
+	// Back to the first profile: the gear handle was not requested meanwhile, its old value is not used
+	f.x52.swap_config(f.config, f.requests);
+	f.x52.evaluate_indicators();
+	CHECK_EQUAL(f.light("b"), "green");
+	f.feed("GEAR HANDLE POSITION", "Bool", 0);
+	CHECK_EQUAL(f.light("b"), "off");
+}
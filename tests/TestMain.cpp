@@ -0,0 +1,67 @@
+/*
+    Copyright (C) 2023  Csaba K Molnár
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "Check.h"
+#include "easylogging++.h"
+
+INITIALIZE_EASYLOGGINGPP
+
+static int failedChecks = 0;
+
+std::vector<TestCase>& test_cases() {
+	static std::vector<TestCase> cases;
+	return cases;
+}
+
+void check_failed(const char* file, int line, const std::string& message) {
+	failedChecks++;
+	std::cout << file << "(" << line << "): check failed: " << message << std::endl;
+}
+
+int main(int argc, char** argv) {
+	// x52.cpp and X52Config.cpp log to these loggers. Only errors are shown, so that the results can be read.
+	el::Configurations consoleConf;
+	consoleConf.setGlobally(el::ConfigurationType::Enabled, "false");
+	consoleConf.setGlobally(el::ConfigurationType::Format, "[%level] %msg");
+	consoleConf.setGlobally(el::ConfigurationType::ToFile, "false");
+	consoleConf.set(el::Level::Error, el::ConfigurationType::Enabled, "true");
+	el::Loggers::reconfigureLogger("toconsole", consoleConf);
+	el::Configurations fileConf;
+	fileConf.setGlobally(el::ConfigurationType::Enabled, "false");
+	fileConf.setGlobally(el::ConfigurationType::ToFile, "false");
+	el::Loggers::reconfigureLogger("tofile", fileConf);
+
+	int runTests = 0;
+	int failedTests = 0;
+	for (const TestCase& test : test_cases())
+	{
+		// A test name given on the command line runs only that test
+		if (argc > 1 && std::string(argv[1]) != test.name) {
+			continue;
+		}
+		runTests++;
+		int failedBefore = failedChecks;
+		test.function();
+		bool passed = failedChecks == failedBefore;
+		if (!passed) {
+			failedTests++;
+		}
+		std::cout << (passed ? "PASSED " : "FAILED ") << test.name << std::endl;
+	}
+	std::cout << runTests << " tests, " << failedTests << " failed." << std::endl;
+	return failedTests == 0 ? 0 : 1;
+}
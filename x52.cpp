@@ -33,37 +33,178 @@ void X52::set_LedBlinker(LedBlinker& instance) {
 	ledBlinker = &instance;
 }
 
-void X52::set_xmlfile(boost::property_tree::ptree* file) {
-	xml_file = file;
+void X52::set_config(const X52Config* compiledConfig) {
+	config = compiledConfig;
+	indicatorLedLight.assign(config->indicatorLeds.size(), "");
+	indicatorLedState.assign(config->indicatorLeds.size(), -1);
+	indicatorLedDwellUntil.assign(config->indicatorLeds.size(), std::chrono::steady_clock::time_point());
+	indicatorLedDwellPending.assign(config->indicatorLeds.size(), false);
+	dwellPendingCount = 0;
+	indicatorLedAwaitingData.assign(config->indicatorLeds.size(), false);
+	ledsAwaitingData = 0;
+	std::lock_guard lock(dirtyMutex);
+	indicatorLedDirty.assign(config->indicatorLeds.size(), false);
+	dirtyLeds.reserve(config->indicatorLeds.size());
+	indicatorsDirty = false;
+	buttonActionStates.assign(config->buttonActions.size(), ButtonActionState());
+	pressedActions.fill(-1);
+	buttonTimers.clear();
+	// Gestures which were not recognized yet are dropped
+	buttonGestures.fill(ButtonGesture());
+	gestureTimers.clear();
+	pressedChordActions.assign(config->chords.size(), -1);
+	shiftButtonsChecked = false;
+	trendLeds.clear();
+	for (size_t i = 0; i < config->indicatorLeds.size(); i++)
+	{
+		if (config->reads_trend(config->indicatorLeds[i])) {
+			trendLeds.push_back(i);
+		}
+	}
 }
 
-void X52::setDataForIndicatorsMap(std::map<int, X52::DataForIndicators>& map) {
-	dataForIndicatorsMap = &map;
-}
+void X52::swap_config(const X52Config& newConfig, IndicatorRequests& newRequests) {
+	std::unique_lock reloadLock(reloadMutex);
+	std::lock_guard lock(indicatorMutex);
+	// Values of requests which were not registered again will not be sent again until they change.
+	// The other requests of a profile which was active before hold old values, they are registered again.
+	if (&newRequests != indicatorRequests) {
+		newRequests.for_each([this](int requestid, X52::DataForIndicators& data) {
+			const X52::DataForIndicators* old = indicatorRequests->find(requestid);
+			if (old) {
+				data.value = old->value;
+				data.received = old->received;
+				if (data.trend && old->trend) {
+					data.history = old->history;
+				}
+			} else {
+				data.value = 0;
+				data.received = false;
+				data.history.clear();
+			}
+		});
+	}
+	indicatorRequests = &newRequests;
+	if (waitingForInitialData) {
+		size_t missing = 0;
+		indicatorRequests->for_each([&missing](int, const X52::DataForIndicators& data) {
+			if (!data.received) {
+				missing++;
+			}
+		});
+		initialDataMissing = missing;
+	}
+	std::vector<std::string> oldLight = std::move(indicatorLedLight);
+	std::vector<int> oldState = std::move(indicatorLedState);
+	std::vector<std::chrono::steady_clock::time_point> oldDwellUntil = std::move(indicatorLedDwellUntil);
+	std::vector<ButtonActionState> oldButtonActionStates = std::move(buttonActionStates);
+	const X52Config& oldConfig = *config;
+	set_config(&newConfig);
+	// Shift state ids can change, the next shift_state_action() checks if the shift state is still active
+	if (CUR_SHIFT_STATE > 0) {
+		CUR_SHIFT_STATE = config->shift_state_id(oldConfig.shiftStateNames[CUR_SHIFT_STATE - 1]);
+		if (CUR_SHIFT_STATE == 0) {
+			x52hid->setShift("off");
+		}
+	}
 
-bool X52::validateSequences() {
-	if (xml_file->count("sequences") == 0)
+	// The value of a request which has not sent data yet is 0, which would show a wrong state until its first value arrives.
+	// store_indicator_value() marks the led for evaluation when it does.
+	awaitingDataUntil = indicatorClock() + INITIAL_DATA_TIMEOUT;
+	for (size_t l = 0; l < config->indicatorLeds.size(); l++)
 	{
-		// Nothing to validate
-		return true;
+		if (!led_has_data(l)) {
+			indicatorLedAwaitingData[l] = true;
+			ledsAwaitingData++;
+		}
+	}
+
+	std::vector<char> ledKept(oldConfig.indicatorLeds.size(), false);
+	for (size_t l = 0; l < config->indicatorLeds.size(); l++)
+	{
+		const X52Config::IndicatorLed& led = config->indicatorLeds[l];
+		for (size_t o = 0; o < oldConfig.indicatorLeds.size(); o++)
+		{
+			const X52Config::IndicatorLed& oldLed = oldConfig.indicatorLeds[o];
+			if (ledKept[o] || oldLed.id != led.id) {
+				continue;
+			}
+			ledKept[o] = true;
+			indicatorLedLight[l] = oldLight[o];
+			// The active state is only known if the led has the same number of states, otherwise it is found by the next evaluation
+			if (oldState[o] >= 0 && oldLed.stateCount == led.stateCount) {
+				indicatorLedState[l] = static_cast<int>(led.firstState + (oldState[o] - oldLed.firstState));
+				indicatorLedDwellUntil[l] = oldDwellUntil[o];
+			}
+			break;
+		}
 	}
-	for (boost::property_tree::ptree::value_type& v : xml_file->get_child("sequences"))
+	for (size_t o = 0; o < oldConfig.indicatorLeds.size(); o++)
+	{
+		if (!ledKept[o]) {
+			// Also stops the led blinking
+			update_led(oldConfig.indicatorLeds[o].id, "off", -1, oldLight[o], false);
+		}
+	}
+
+	for (const X52Config::AssignmentButton& button : config->assignmentButtons)
 	{
-		if (v.first == "sequence")
+		for (const X52Config::AssignmentButton& oldButton : oldConfig.assignmentButtons)
 		{
-			if (v.second.get<double>("<xmlattr>.speed") > 10)
+			if (oldButton.nr != button.nr || oldButton.gesture != button.gesture || oldButton.chordMask != button.chordMask) {
+				continue;
+			}
+			for (size_t i = 0; i <= button.shiftedCount; i++)
 			{
-				CLOG(ERROR,"toconsole", "tofile") << "The speed of sequence tag " << v.second.get<std::string>("<xmlattr>.name") << " is greater than 10. The maximum allowed speed is 10.";
-				return false;
+				const X52Config::ButtonAction& action = config->buttonActions[button.action + i];
+				for (size_t j = 0; j <= oldButton.shiftedCount; j++)
+				{
+					const X52Config::ButtonAction& oldAction = oldConfig.buttonActions[oldButton.action + j];
+					if ((i == 0) != (j == 0) || action.shiftState != oldAction.shiftState) {
+						continue;
+					}
+					ButtonActionState& state = buttonActionStates[button.action + i];
+					state = oldButtonActionStates[oldButton.action + j];
+					// A held repeater keeps repeating with the new interval
+					if (state.repeatTimer != 0) {
+						state.repeatTimer = action.type == X52Config::ButtonAction::Type::Repeater ?
+							buttonTimers.start(buttonClock(), std::chrono::milliseconds(action.interval), std::chrono::milliseconds(action.interval), button.action + i) : 0;
+					}
+					break;
+				}
 			}
+			break;
 		}
-		else
+	}
+	// Buttons which are still held are released with the action they pressed
+	for (const X52Config::AssignmentButton& button : config->assignmentButtons)
+	{
+		for (size_t i = button.action; i <= button.action + button.shiftedCount; i++)
 		{
-			CLOG(ERROR,"toconsole", "tofile") << "The sequences tag contains a <" << v.first << "> tag. It can only contain sequence tags.";
-			return false;
+			ButtonActionState& state = buttonActionStates[i];
+			if (state.pressType == PressType::None) {
+				continue;
+			}
+			if (button.nr >= 1 && button.nr <= X52Config::BUTTON_COUNT && pressedActions[button.nr - 1] < 0) {
+				pressedActions[button.nr - 1] = static_cast<int32_t>(i);
+				continue;
+			}
+			// Held chords are not tracked over a reload, so their next press must not be ignored
+			buttonTimers.cancel(state.repeatTimer);
+			state.repeatTimer = 0;
+			state.pressed = false;
+			state.pressType = PressType::None;
 		}
 	}
-	return true;
+	index_indicator_requests();
+}
+
+void X52::set_coalesce_window(long ms) {
+	coalesceWindow = std::chrono::milliseconds(ms);
+}
+
+void X52::setIndicatorRequests(IndicatorRequests& requests) {
+	indicatorRequests = &requests;
 }
 
 void X52::write_to_mfd(std::string& line1, std::string& line2, std::string& line3) {
@@ -102,34 +243,26 @@ void X52::write_led(const std::string& led, const std::string& color) {
 	if (CURRENT_LED_COLOR[led] != color) {
 		if (x52hid->setLedColor(led, color))
 		{
+			indicatorStatistics.ledWrites++;
 			CURRENT_LED_COLOR[led] = color;
 			CLOG(TRACE,"toconsole", "tofile") << "Color of LED \"" << led << "\" was successfully set to \"" << color << "\".";
 		}
 }
 }
 
-void X52::update_led(std::string led, std::string light, std::string current_light, boost::property_tree::ptree &state, bool force) {
-	// Are there sequences defined in the XML file?
-	if (xml_file->count("sequences") != 0) {
-		for (auto& [first, second] : xml_file->get_child("sequences"))
-		{
-			if (first == "sequence" && light == second.get<std::string>("<xmlattr>.name"))
-			{
-				// Found sequence tag with the name in the light variable
-				if (!state.empty())
-				{
-					LedBlinker::LedSequence ledSequence;
-					ledSequence.led = led;
-					ledSequence.sequence = second.get<std::string>("<xmlattr>.pattern");
-					ledSequence.loopCount = second.get<int>("<xmlattr>.loop", 0);
-					ledSequence.speed = second.get<int>("<xmlattr>.speed", 0);
-					// Determine the led's tick duration (time per character)
-					ledSequence.tickDuration = std::chrono::duration<double> (1.0 / ledSequence.speed);
-					ledBlinker->setLedToSequence(ledSequence);
-				}
-				return; // If matching sequence was found, no need to loop further
-			}
-		}
+void X52::update_led(const std::string& led, const std::string& light, int sequence, const std::string& current_light, bool force) {
+	if (sequence >= 0) {
+		// The light is a sequence, send it to the blinker thread
+		const X52Config::Sequence& s = config->sequences[sequence];
+		LedBlinker::LedSequence ledSequence;
+		ledSequence.led = led;
+		ledSequence.sequence = s.pattern;
+		ledSequence.loopCount = s.loop;
+		ledSequence.speed = s.speed;
+		// Determine the led's tick duration (time per character)
+		ledSequence.tickDuration = std::chrono::duration<double> (1.0 / ledSequence.speed);
+		ledBlinker->setLedToSequence(ledSequence);
+		return;
 	}
 	// This led will not be blinking, so make sure it
 	// stops blinking if it was blinking before.
@@ -140,197 +273,676 @@ void X52::update_led(std::string led, std::string light, std::string current_lig
 	if (light != current_light || force) write_led(led, light);
 }
 
-bool X52::evaluate_xml_op(double simvarvalue, std::string op) {
-	std::string oper, value;
+void X52::send_button_action(size_t action, double value) {
+	const X52Config::ButtonAction& a = config->buttonActions[action];
+	if (a.kind == X52Config::ButtonAction::Kind::CustomCommand) {
 
-	oper = op.substr(0, 2);
-	value = op.substr(2);
-	
-	if (oper == "==") {
-		return(std::stod(value) == simvarvalue);
-	} else if(oper == "--") {
-		return(simvarvalue < std::stod(value));
-	} else if (oper == "++") {
-		return(simvarvalue > std::stod(value));
-	} else {
+	} else if (a.kind == X52Config::ButtonAction::Kind::Command) {
+		if (a.clienteventid == 0) {
+			CLOG(ERROR,"toconsole", "tofile") << "The command " << a.command << " was not mapped to a Client Event ID.";
+			return;
+		}
+		SimConnect_TransmitClientEvent(hSimConnect,
+			SIMCONNECT_OBJECT_ID_USER, // Invoke InputEvent on the user's aircraft
+			a.clienteventid, // Event_ID
+			static_cast<DWORD>(value), // dwData - Optional data for the InputEvent
+			SIMCONNECT_GROUP_PRIORITY_HIGHEST, // GroupID - special case, we're not using a group, but a priority and we specify the "GroupID is a Priority" flag below
+			SIMCONNECT_EVENT_FLAG_GROUPID_IS_PRIORITY
+			);
+		SimConnect_GetLastSentPacketID(hSimConnect, &lastsentpacket.pdwSendID);
+		lastsentpacket.message = "TransmitClientEvent: EventName=" + a.command + " Data=" + std::to_string(value);
+	} else if (a.kind == X52Config::ButtonAction::Kind::Dataref) {
+		SimConnect_ClearDataDefinition(hSimConnect, 10);
+		SimConnect_AddToDataDefinition(hSimConnect, 10, a.dataref.c_str(), a.unit.c_str(), SIMCONNECT_DATATYPE_FLOAT64);
+		SingleDataref datarefstruct;
+		datarefstruct.dataref[0] = value;
+		SimConnect_SetDataOnSimObject(hSimConnect,
+			10, // Definition ID
+			SIMCONNECT_OBJECT_ID_USER, // Set data on the user's aircraft
+			0, // Flags
+			0, // ArrayCount: Number of elements in the data array. A count of zero is interpreted as one element.
+			sizeof(datarefstruct), // size of each element in the data array in bytes
+			&datarefstruct );
+	} else if (a.kind == X52Config::ButtonAction::Kind::CalculatorCode) {
+		double fResult = 0.;
+		std::string sResult {};
+		if (wasimclient->executeCalculatorCode(a.command, WASimCommander::Enums::CalcResultType::Double, &fResult, &sResult) == S_OK) {
+			CLOG(DEBUG,"toconsole", "tofile") << "Calculator code \"" << a.command << "\" numerical result = " << fResult << ", string result = \"" << sResult << "\".";
+		}
+		else {
+			CLOG(DEBUG,"toconsole", "tofile") << "Calculator code \"" << a.command << "\" could not be executed. Numerical result = " << fResult << ", string result = \"" << sResult << "\".";
+		}
+	}
+}
+
+void X52::execute_button_press(size_t action) {
+	const X52Config::ButtonAction& a = config->buttonActions[action];
+	ButtonActionState& state = buttonActionStates[action];
+	if (state.pressed) {
+		return;
+	}
+	state.pressed = true;
+	switch (a.type) {
+	case X52Config::ButtonAction::Type::TriggerPos:
+	case X52Config::ButtonAction::Type::Hold:
+		send_button_action(action, a.on);
+		break;
+	case X52Config::ButtonAction::Type::Toggle:
+		state.toggled = !state.toggled;
+		send_button_action(action, state.toggled ? a.on : a.off);
+		break;
+	case X52Config::ButtonAction::Type::Repeater:
+		send_button_action(action, a.on);
+		state.repeatTimer = buttonTimers.start(buttonClock(), std::chrono::milliseconds(a.delay), std::chrono::milliseconds(a.interval), action);
+		break;
+	default:
+		// trigger_neg is executed on release
+		break;
+	}
+}
+
+void X52::execute_button_release(size_t action) {
+	const X52Config::ButtonAction& a = config->buttonActions[action];
+	ButtonActionState& state = buttonActionStates[action];
+	state.pressed = false;
+	switch (a.type) {
+	case X52Config::ButtonAction::Type::TriggerNeg:
+		send_button_action(action, a.on);
+		break;
+	case X52Config::ButtonAction::Type::Hold:
+		// Calculator code has nothing to undo the press with
+		if (a.kind != X52Config::ButtonAction::Kind::CalculatorCode) {
+			send_button_action(action, a.off);
+		}
+		break;
+	case X52Config::ButtonAction::Type::Repeater:
+		buttonTimers.cancel(state.repeatTimer);
+		state.repeatTimer = 0;
+		break;
+	default:
+		break;
+	}
+}
+
+void X52::run_button_timers() {
+	if (gestureTimers.size() > 0) {
+		for (size_t btn : gestureTimers.advance(buttonClock()))
+		{
+			gesture_timer_expired(static_cast<int>(btn));
+		}
+	}
+	if (buttonTimers.size() == 0) {
+		return;
+	}
+	for (size_t action : buttonTimers.advance(buttonClock()))
+	{
+		send_button_action(action, config->buttonActions[action].on);
+	}
+}
+
+bool X52::assignment_button_action(int btn, bool pressed, TimerWheel::Clock::time_point time) {
+	if (btn < 1 || btn > X52Config::BUTTON_COUNT) {
+		return false;
+	}
+	ButtonGesture& gesture = buttonGestures[btn - 1];
+	uint64_t bit = uint64_t(1) << (btn - 1);
+	if (pressed) {
+		if (pressedActions[btn - 1] >= 0 || (gesture.phase != GesturePhase::None && gesture.phase != GesturePhase::Double)) {
+			// A repeated press while the button is held
+			return true;
+		}
+		if (gesture.phase == GesturePhase::Double) {
+			// The second press of a double press is executed at once
+			gestureTimers.cancel(gesture.timer);
+			gesture.timer = 0;
+			gesture.phase = GesturePhase::None;
+			return press_button_action(btn, config->dispatch_action(btn, gesture.shiftState, X52Config::Gesture::Double));
+		}
+		gesture.pressTime = time;
+		gesture.shiftState = CUR_SHIFT_STATE;
+		if (config->chordButtons & bit) {
+			if (start_chord(btn)) {
+				return true;
+			}
+			if (chord_possible(btn)) {
+				gesture.phase = GesturePhase::Chord;
+				gesture.timer = gestureTimers.start(time, std::chrono::milliseconds(config->chordTime), std::chrono::milliseconds(0), btn);
+				return true;
+			}
+			// No chord of the button can start any more, so it does not wait chordTime
+		}
+		return start_gesture(btn);
+	}
+	switch (gesture.phase) {
+	case GesturePhase::Chord:
+	case GesturePhase::Long:
+	case GesturePhase::Tap:
+		gestureTimers.cancel(gesture.timer);
+		gesture.timer = 0;
+		return tap_button(btn, time);
+	case GesturePhase::InChord: {
+		// The first released button releases the chord
+		gesture.phase = GesturePhase::None;
+		int32_t& action = pressedChordActions[gesture.chord];
+		if (action >= 0) {
+			execute_button_release(action);
+			buttonActionStates[action].pressType = PressType::None;
+			action = -1;
+		}
+		return true;
+	}
+	default:
+		if (pressedActions[btn - 1] < 0) {
+			return false;
+		}
+		release_button_action(btn);
+		return true;
+	}
+}
+
+bool X52::press_button_action(int btn, int32_t action) {
+	if (action < 0) {
 		return false;
 	}
+	execute_button_press(action);
+	buttonActionStates[action].pressType = action == config->buttonTags[btn - 1] ? PressType::Normal : PressType::Shift;
+	pressedActions[btn - 1] = action;
+	return true;
 }
 
-void X52::execute_button_press(boost::property_tree::ptree &xmltree, int btn) {
-	std::string type = xmltree.get<std::string>("<xmlattr>.type","");
-	if (type == "trigger_pos" ||
-		type == "hold" ||
-		type == "") {
-		if ( xmltree.get<std::string>("<xmlattr>.pressed", "") != "true") {
-			if (xmltree.get<std::string>("<xmlattr>.custom_command", "") != "") {
+void X52::release_button_action(int btn) {
+	int32_t& action = pressedActions[btn - 1];
+	if (action < 0) {
+		return;
+	}
+	execute_button_release(action);
+	buttonActionStates[action].pressType = PressType::None;
+	action = -1;
+}
 
-			} else if (xmltree.get<std::string>("<xmlattr>.command", "") != "") {
-				int clienteventid =	xmltree.get<int>("<xmlattr>.clienteventid", 0);
-				if (clienteventid == 0)
-				{
-					xmltree.put<int>("<xmlattr>.clienteventid",++lastClientEventId);
-					clienteventid = lastClientEventId;
-					SimConnect_MapClientEventToSimEvent(hSimConnect, clienteventid, xmltree.get<std::string>("<xmlattr>.command").c_str());
-				}
-				SimConnect_TransmitClientEvent(hSimConnect,
-					SIMCONNECT_OBJECT_ID_USER, // Invoke InputEvent on the user's aircraft
-					clienteventid, // Event_ID
-					xmltree.get<DWORD>("<xmlattr>.on", 0), // dwData - Optional data for the InputEvent
-					SIMCONNECT_GROUP_PRIORITY_HIGHEST, // GroupID - special case, we're not using a group, but a priority and we specify the "GroupID is a Priority" flag below
-					SIMCONNECT_EVENT_FLAG_GROUPID_IS_PRIORITY
-					);
-				SimConnect_GetLastSentPacketID(hSimConnect, &lastsentpacket.pdwSendID);
-				lastsentpacket.message = "TransmitClientEvent: EventName=" + xmltree.get<std::string>("<xmlattr>.command") + " Data=" + std::to_string(xmltree.get<double>("<xmlattr>.on", 0));
-			} else if (xmltree.get<std::string>("<xmlattr>.dataref", "") != "") {
-				std::string attr = xmltree.get<std::string>("<xmlattr>.dataref");
-				size_t separatorpos = attr.find("%");
-				std::string dataref = attr.substr(0, separatorpos);
-				std::string unit = attr.substr(separatorpos + 1);
-				SimConnect_ClearDataDefinition(hSimConnect, 10);
-				SimConnect_AddToDataDefinition(hSimConnect, 10, dataref.c_str(), unit.c_str(), SIMCONNECT_DATATYPE_FLOAT64);
-				SingleDataref datarefstruct;
-				datarefstruct.dataref[0] = xmltree.get<double>("<xmlattr>.on");
-				SimConnect_SetDataOnSimObject(hSimConnect,
-					10, // Definition ID
-					SIMCONNECT_OBJECT_ID_USER, // Set data on the user's aircraft
-					0, // Flags
-					0, // ArrayCount: Number of elements in the data array. A count of zero is interpreted as one element.
-					sizeof(datarefstruct), // size of each element in the data array in bytes
-					&datarefstruct );
-			} else if (xmltree.get<std::string>("<xmlattr>.calculator_code", "") != "") {
-				std::string calc_code = xmltree.get<std::string>("<xmlattr>.calculator_code");
-				double fResult = 0.;
-				std::string sResult {};
-				if (wasimclient->executeCalculatorCode(calc_code, WASimCommander::Enums::CalcResultType::Double, &fResult, &sResult) == S_OK) {
-					CLOG(DEBUG,"toconsole", "tofile") << "Calculator code \"" << calc_code << "\" numerical result = " << fResult << ", string result = \"" << sResult << "\".";
-				}
-				else {
-					CLOG(DEBUG,"toconsole", "tofile") << "Calculator code \"" << calc_code << "\" could not be executed. Numerical result = " << fResult << ", string result = \"" << sResult << "\".";
-				}
+bool X52::start_gesture(int btn) {
+	ButtonGesture& gesture = buttonGestures[btn - 1];
+	uint64_t bit = uint64_t(1) << (btn - 1);
+	if (config->longPressButtons & bit) {
+		// Counted from the press, also if the button waited for a chord before
+		gesture.phase = GesturePhase::Long;
+		gesture.timer = gestureTimers.start(gesture.pressTime, std::chrono::milliseconds(config->longPressTime), std::chrono::milliseconds(0), btn);
+		return true;
+	}
+	if (config->doublePressButtons & bit) {
+		gesture.phase = GesturePhase::Tap;
+		return true;
+	}
+	// Without long or double press the action is executed at once, like before
+	gesture.phase = GesturePhase::None;
+	return press_button_action(btn, config->dispatch_action(btn, gesture.shiftState));
+}
+
+bool X52::tap_button(int btn, TimerWheel::Clock::time_point time) {
+	ButtonGesture& gesture = buttonGestures[btn - 1];
+	if (config->doublePressButtons & (uint64_t(1) << (btn - 1))) {
+		gesture.phase = GesturePhase::Double;
+		gesture.timer = gestureTimers.start(time, std::chrono::milliseconds(config->doublePressTime), std::chrono::milliseconds(0), btn);
+		return true;
+	}
+	// The short press is only known now, so it is pressed and released at once
+	gesture.phase = GesturePhase::None;
+	bool handled = press_button_action(btn, config->dispatch_action(btn, gesture.shiftState));
+	release_button_action(btn);
+	return handled;
+}
+
+bool X52::start_chord(int btn) {
+	uint64_t waiting = uint64_t(1) << (btn - 1);
+	for (int b = 1; b <= X52Config::BUTTON_COUNT; b++)
+	{
+		if (buttonGestures[b - 1].phase == GesturePhase::Chord) {
+			waiting |= uint64_t(1) << (b - 1);
+		}
+	}
+	for (size_t c = 0; c < config->chords.size(); c++)
+	{
+		uint64_t mask = config->chords[c];
+		if ((mask & waiting) != mask || !(mask & (uint64_t(1) << (btn - 1)))) {
+			continue;
+		}
+		for (int b = 1; b <= X52Config::BUTTON_COUNT; b++)
+		{
+			if (mask & (uint64_t(1) << (b - 1))) {
+				ButtonGesture& gesture = buttonGestures[b - 1];
+				gestureTimers.cancel(gesture.timer);
+				gesture.timer = 0;
+				gesture.phase = GesturePhase::InChord;
+				gesture.chord = c;
 			}
-			xmltree.put("<xmlattr>.pressed","true");
 		}
+		int32_t action = config->chord_action(c, buttonGestures[btn - 1].shiftState);
+		execute_button_press(action);
+		buttonActionStates[action].pressType = PressType::Normal;
+		pressedChordActions[c] = action;
+		return true;
 	}
+	return false;
+}
+
+bool X52::chord_possible(int btn) const {
+	uint64_t bit = uint64_t(1) << (btn - 1);
+	for (uint64_t mask : config->chords)
+	{
+		if (!(mask & bit)) {
+			continue;
+		}
+		bool blocked = false;
+		for (int b = 1; b <= X52Config::BUTTON_COUNT && !blocked; b++)
+		{
+			uint64_t other = uint64_t(1) << (b - 1);
+			if (b == btn || !(mask & other)) {
+				continue;
+			}
+			// A button held longer than chordTime cannot be part of a new chord
+			GesturePhase phase = buttonGestures[b - 1].phase;
+			bool held = (joyButtons & other) || pressedActions[b - 1] >= 0 || (phase != GesturePhase::None && phase != GesturePhase::Double);
+			blocked = held && phase != GesturePhase::Chord;
+		}
+		if (!blocked) {
+			return true;
+		}
+	}
+	return false;
 }
 
-void X52::execute_button_release(boost::property_tree::ptree& xmltree, int btn) const {
-	xmltree.put("<xmlattr>.press_time","");
-	xmltree.put("<xmlattr>.pressed","");
-	xmltree.put("<xmlattr>.in_repeat","");
+void X52::gesture_timer_expired(int btn) {
+	ButtonGesture& gesture = buttonGestures[btn - 1];
+	gesture.timer = 0;
+	switch (gesture.phase) {
+	case GesturePhase::Chord:
+		// No chord, the button is still held
+		start_gesture(btn);
+		break;
+	case GesturePhase::Long:
+		gesture.phase = GesturePhase::None;
+		press_button_action(btn, config->dispatch_action(btn, gesture.shiftState, X52Config::Gesture::Long));
+		break;
+	case GesturePhase::Double:
+		// No second press, so it was a short press
+		gesture.phase = GesturePhase::None;
+		press_button_action(btn, config->dispatch_action(btn, gesture.shiftState));
+		release_button_action(btn);
+		break;
+	default:
+		break;
+	}
 }
 
-bool X52::assignment_button_action(boost::property_tree::ptree &xmltree, int btn, std::string status) {
-	try
+
+void X52::evaluate_indicators(bool force) {
+	for (size_t i = 0; i < config->indicatorLeds.size(); i++)
 	{
-		for (boost::property_tree::ptree::value_type &v : xmltree)
+		evaluate_led(i, force);
+	}
+}
+
+void X52::index_indicator_requests() {
+	ledsForRequestId.assign(indicatorRequests->end_id(), {});
+	for (size_t l = 0; l < config->indicatorLeds.size(); l++)
+	{
+		const X52Config::IndicatorLed& led = config->indicatorLeds[l];
+		for (size_t i = led.firstState; i < led.firstState + led.stateCount; i++)
 		{
-			if (v.first == "button") // button tag (first level child of assignments)
+			const X52Config::IndicatorState& state = config->indicatorStates[i];
+			if (state.instructionCount > 0 && state.simresult == 0)
 			{
-				if (status == "released" && btn == v.second.get<int>("<xmlattr>.nr")) {
-					if (!assignment_button_action(v.second, btn, "released")) { // If there is no shifted_button tag under this button tag then do the release process for this button tag.
-						execute_button_release(v.second, btn);
-						v.second.put("<xmlattr>.press_type","");
-						return true;
-					}
-				}
-				else if(status == "pressed" && btn == v.second.get<int>("<xmlattr>.nr")) {
-					if (v.second.get<std::string>("<xmlattr>.press_type","") == "normal" ||
-						!assignment_button_action(v.second, btn, "pressed")) { // If there is no shifted_button tag under this button tag then execute the command in this button tag.
-						execute_button_press(v.second, btn);
-						v.second.put("<xmlattr>.press_type","normal");
-						return true;
+				// A condition reads the requests of its terms
+				for (size_t c = state.firstInstruction; c < state.firstInstruction + state.instructionCount; c++)
+				{
+					if (config->conditionCode[c].type == X52Config::ConditionInstruction::Type::Test)
+					{
+						add_led_for_request(config->conditionTerms[config->conditionCode[c].term].requestid, l);
 					}
 				}
+				continue;
+			}
+			add_led_for_request(state.requestid, l);
+		}
+	}
+}
+
+void X52::add_led_for_request(int requestid, size_t ledIndex) {
+	if (requestid <= 0 || static_cast<size_t>(requestid) >= ledsForRequestId.size()) {
+		// The state has no registered request
+		return;
+	}
+	std::vector<size_t>& leds = ledsForRequestId[requestid];
+	// A led can read the same request in several states, but it only needs to be evaluated once
+	if (std::find(leds.begin(), leds.end(), ledIndex) == leds.end())
+	{
+		leds.push_back(ledIndex);
+	}
+}
+
+bool X52::evaluate_condition(const X52Config::IndicatorState& state, std::chrono::steady_clock::time_point now) const {
+	bool stack[X52Config::MAX_CONDITION_DEPTH];
+	size_t top = 0;
+	for (size_t c = state.firstInstruction; c < state.firstInstruction + state.instructionCount; c++)
+	{
+		const X52Config::ConditionInstruction& instruction = config->conditionCode[c];
+		switch (instruction.type) {
+		case X52Config::ConditionInstruction::Type::Test: {
+			const X52Config::ConditionTerm& term = config->conditionTerms[instruction.term];
+			X52::DataForIndicators* data = indicatorRequests->find(term.requestid);
+			if (!data) {
+				stack[top++] = false;
+			} else if (term.op.is_trend()) {
+				stack[top++] = term.op.matches_trend(data->history, now, term.unitFactor);
+			} else {
+				stack[top++] = term.op.matches(data->value * term.unitFactor);
 			}
-			else if (v.first == "shifted_button") // shifted_button tag (child of button tag)
+			break;
+		}
+		case X52Config::ConditionInstruction::Type::And:
+			top--;
+			stack[top - 1] = stack[top - 1] && stack[top];
+			break;
+		case X52Config::ConditionInstruction::Type::Or:
+			top--;
+			stack[top - 1] = stack[top - 1] || stack[top];
+			break;
+		case X52Config::ConditionInstruction::Type::Not:
+			stack[top - 1] = !stack[top - 1];
+			break;
+		}
+	}
+	// The compiler has checked the depth and that exactly one value is left
+	return stack[0];
+}
+
+void X52::evaluate_led(size_t ledIndex, bool force) {
+	indicatorStatistics.ledEvaluations++;
+	const X52Config::IndicatorLed& led = config->indicatorLeds[ledIndex];
+	std::string& current_light = indicatorLedLight[ledIndex];
+	if (led.stateCount == 0) {
+		// No declared states for led, set to off
+		if (current_light != "off") {
+			update_led(led.id, "off", -1, "", force);
+			current_light = "off";
+		}
+		return;
+	}
+	int newState = led_state(ledIndex, force);
+	if (newState == KEEP_LED_STATE) {
+		return;
+	}
+	// The joystick is written without holding indicatorMutex, so the WASim callback does not wait for the HID writes
+	if (newState >= 0) {
+		const X52Config::IndicatorState& state = config->indicatorStates[newState];
+		update_led(led.id, state.light, state.sequence, current_light, force);
+		current_light = state.light;
+	} else {
+		update_led(led.id, "off", -1, current_light, force);
+		current_light = "off";
+	}
+}
+
+int X52::led_state(size_t ledIndex, bool force) {
+	std::lock_guard lock(indicatorMutex);
+	const X52Config::IndicatorLed& led = config->indicatorLeds[ledIndex];
+	int activeState = indicatorLedState[ledIndex];
+	int newState = -1; // No state evaluates to true, set led to off
+	bool keptByHysteresis = false;
+	auto now = indicatorClock();
+	if (indicatorLedAwaitingData[ledIndex]) {
+		if (!led_has_data(ledIndex) && now < awaitingDataUntil) {
+			return KEEP_LED_STATE;
+		}
+		indicatorLedAwaitingData[ledIndex] = false;
+		ledsAwaitingData--;
+	}
+	for (size_t i = led.firstState; i < led.firstState + led.stateCount; i++)
+	{
+		const X52Config::IndicatorState& state = config->indicatorStates[i];
+		if (state.instructionCount > 0 && state.simresult == 0) {
+			if (evaluate_condition(state, now)) {
+				// Innermost true state wins
+				newState = static_cast<int>(i);
+				break;
+			}
+			continue;
+		}
+		X52::DataForIndicators* data = indicatorRequests->find(state.requestid);
+		if (!data) {
+			continue;
+		}
+		if (state.op.is_trend() && state.simresult == 0) {
+			if (state.op.matches_trend(data->history, now, state.unitFactor)) {
+				newState = static_cast<int>(i);
+				break;
+			}
+			continue;
+		}
+		if (X52Config::state_matches(state, data->value)) {
+			// Innermost true state wins
+			newState = static_cast<int>(i);
+			break;
+		}
+		if (static_cast<int>(i) == activeState && state.hysteresis > 0 && state.op.matches(data->value * state.unitFactor, state.hysteresis)) {
+			// The active state is only false because the value is fluctuating around its threshold
+			newState = activeState;
+			keptByHysteresis = true;
+			break;
+		}
+	}
+	if (keptByHysteresis) {
+		indicatorStatistics.suppressedByHysteresis++;
+	}
+
+	if (newState != activeState && !force && now < indicatorLedDwellUntil[ledIndex]) {
+		// The active state has not been shown for its dwell time yet. Evaluate again when it expires.
+		indicatorStatistics.suppressedByDwell++;
+		if (!indicatorLedDwellPending[ledIndex]) {
+			indicatorLedDwellPending[ledIndex] = true;
+			dwellPendingCount++;
+		}
+		return KEEP_LED_STATE;
+	}
+	if (newState != activeState) {
+		indicatorLedState[ledIndex] = newState;
+		int dwell = newState >= 0 ? config->indicatorStates[newState].dwell : 0;
+		indicatorLedDwellUntil[ledIndex] = now + std::chrono::milliseconds(dwell);
+	}
+	return newState;
+}
+
+bool X52::led_has_data(size_t ledIndex) const {
+	auto received = [this](int requestid) {
+		const X52::DataForIndicators* data = indicatorRequests->find(requestid);
+		return !data || data->received;
+	};
+	const X52Config::IndicatorLed& led = config->indicatorLeds[ledIndex];
+	for (size_t i = led.firstState; i < led.firstState + led.stateCount; i++)
+	{
+		const X52Config::IndicatorState& state = config->indicatorStates[i];
+		if (state.instructionCount > 0 && state.simresult == 0) {
+			for (size_t c = state.firstInstruction; c < state.firstInstruction + state.instructionCount; c++)
 			{
-				if (status == "pressed" && (CUR_SHIFT_STATE == v.second.get<std::string>("<xmlattr>.shift_state","") || v.second.get<std::string>("<xmlattr>.press_type","") == "shift")) {
-					execute_button_press(v.second, btn);
-					v.second.put("<xmlattr>.press_type","shift");
-					return true;
-				}
-				else if(status == "released" && v.second.get<std::string>("<xmlattr>.press_type") == "shift") {
-					execute_button_release(v.second, btn);
-					v.second.put("<xmlattr>.press_type","");
-					return true;
+				if (config->conditionCode[c].type == X52Config::ConditionInstruction::Type::Test && !received(config->conditionTerms[config->conditionCode[c].term].requestid)) {
+					return false;
 				}
 			}
+		} else if (!received(state.requestid)) {
+			return false;
 		}
-		return false;
 	}
-	catch (const boost::property_tree::ptree_error& e)
+	return true;
+}
+
+void X52::evaluate_awaiting_leds() {
+	size_t count = ledsAwaitingData;
+	for (size_t i = 0; i < indicatorLedAwaitingData.size(); i++)
 	{
-		CLOG(ERROR, "toconsole", "tofile") << "Boost ptree had problems with XML processing. Button = " << btn << ", status = " << status << ". Error message : " << e.what() << ".";
-		return false;
+		if (indicatorLedAwaitingData[i]) {
+			evaluate_led(i, false);
+		}
 	}
+	CLOG(WARNING,"toconsole", "tofile") << count << " leds were set without the first values of all their data requests, which have not arrived in " << INITIAL_DATA_TIMEOUT.count() << " seconds. Check the SimVar names in the XML.";
 }
 
-
-std::string X52::dataref_ind_action(std::string_view tagname, boost::property_tree::ptree &xmltree, std::string const & led = "", std::string const & current_light = "", bool force) {
-	std::string r;
-	boost::property_tree::ptree empty_ptree;
-	try
+void X52::evaluate_dwelling_leds() {
+	if (dwellPendingCount == 0) {
+		return;
+	}
+	auto now = indicatorClock();
+	for (size_t i = 0; i < indicatorLedDwellPending.size(); i++)
 	{
-		for (boost::property_tree::ptree::value_type& v : xmltree)
+		bool expired = false;
 		{
-			if (v.first == "led") // a led tag which contains multiple state tags
-			{
-				if (v.second.count("state") != 0) // This led has a state declared
-				{
-					r = dataref_ind_action(v.first, v.second, v.second.get<std::string>("<xmlattr>.id"), v.second.get<std::string>("<xmlattr>.current_light",""), force);
-					if (r == "") { // No state evaluates to true, set led to off
-						update_led(v.second.get<std::string>("<xmlattr>.id"), "off", v.second.get<std::string>("<xmlattr>.current_light",""), v.second, force);
-						v.second.put("<xmlattr>.current_light", "off");
-					} else {
-						v.second.put("<xmlattr>.current_light", r);
-					}
-				} else {
-					// No declared states for led, set to off
-					if (v.second.get("<xmlattr>.current_light", "") != "off") {
-						update_led(v.second.get<std::string>("<xmlattr>.id"), "off", "", empty_ptree, force);
-						v.second.put("<xmlattr>.current_light", "off");
-					}
-				}
-			} else if (v.first == "state") { // a state tag below a led tag or below another state tag
-				r = dataref_ind_action(v.first, v.second, led, current_light, force);
-				if (r != "") { // Higher prio state was set, so reset this state's sequence timing and abort
-					return r;
-				}
+			std::lock_guard lock(indicatorMutex);
+			if (indicatorLedDwellPending[i] && now >= indicatorLedDwellUntil[i]) {
+				indicatorLedDwellPending[i] = false;
+				dwellPendingCount--;
+				expired = true;
 			}
 		}
-		// No subitems to loop into, we're at bottom (innermost state)
-		if (tagname == "state") {
-			if (evaluate_xml_op((*dataForIndicatorsMap).at(xmltree.get<int>("<xmlattr>.requestid")).value, xmltree.get<std::string>("<xmlattr>.op"))) {
-				update_led(led, xmltree.get<std::string>("<xmlattr>.light"), current_light, xmltree, force);
-				return xmltree.get<std::string>("<xmlattr>.light");
-			} else {
-				// Dataref doesn't evaluate
-				return "";
+		if (expired) {
+			evaluate_led(i, false);
+		}
+	}
+}
+
+void X52::evaluate_trend_leds() {
+	if (trendLeds.empty() || waitingForInitialData) {
+		return;
+	}
+	auto now = indicatorClock();
+	if (now - lastTrendEvaluation < TREND_EVALUATION_INTERVAL) {
+		return;
+	}
+	lastTrendEvaluation = now;
+	for (size_t ledIndex : trendLeds)
+	{
+		evaluate_led(ledIndex, false);
+	}
+}
+
+void X52::wait_for_initial_data(std::chrono::steady_clock::time_point since) {
+	initialDataSince = since;
+	initialDataMissing = indicatorRequests->size();
+	waitingForInitialData = true;
+}
+
+void X52::evaluate_dirty_leds() {
+	if (waitingForInitialData) {
+		auto now = indicatorClock();
+		if (initialDataMissing > 0 && now - initialDataSince < INITIAL_DATA_TIMEOUT) {
+			return;
+		}
+		waitingForInitialData = false;
+		if (initialDataMissing > 0) {
+			CLOG(WARNING,"toconsole", "tofile") << initialDataMissing << " indicator data requests have not sent a value in " << INITIAL_DATA_TIMEOUT.count() << " seconds. Check the SimVar names in the XML.";
+		}
+		{
+			std::lock_guard lock(dirtyMutex);
+			std::fill(indicatorLedDirty.begin(), indicatorLedDirty.end(), false);
+			indicatorsDirty = false;
+		}
+		evaluate_indicators(true);
+		CLOG(INFO,"toconsole", "tofile") << "All " << config->indicatorLeds.size() << " leds were set " << std::chrono::duration_cast<std::chrono::milliseconds>(now - initialDataSince).count()
+			<< " ms after connecting to WASim, with the first values of " << indicatorRequests->size() - initialDataMissing << " data requests.";
+		return;
+	}
+	if (ledsAwaitingData > 0 && indicatorClock() >= awaitingDataUntil) {
+		evaluate_awaiting_leds();
+	}
+	if (!indicatorsDirty) {
+		return;
+	}
+	{
+		std::lock_guard lock(dirtyMutex);
+		if (indicatorClock() - firstDirtyTime < coalesceWindow) {
+			// More data of the same burst may still arrive
+			return;
+		}
+		dirtyLeds.clear();
+		for (size_t i = 0; i < indicatorLedDirty.size(); i++)
+		{
+			if (indicatorLedDirty[i]) {
+				dirtyLeds.push_back(i);
+				indicatorLedDirty[i] = false;
 			}
 		}
+		indicatorsDirty = false;
 	}
-	catch (const boost::property_tree::ptree_error&)
+	for (size_t ledIndex : dirtyLeds)
 	{
-		return "";
+		evaluate_led(ledIndex, false);
 	}
-	return "";
+}
+
+void X52::log_indicator_statistics() const {
+	CLOG(INFO,"toconsole", "tofile") << "Indicator data received from MSFS " << indicatorStatistics.dataCallbacks << " times. " << indicatorStatistics.coalescedUpdates << " led evaluations were saved by coalescing bursts of data.";
+	CLOG(INFO,"toconsole", "tofile") << "Leds were evaluated " << indicatorStatistics.ledEvaluations << " times and led colors were sent to the joystick " << indicatorStatistics.ledWrites << " times.";
+	CLOG(INFO,"toconsole", "tofile") << "Led changes not sent to the joystick: " << indicatorStatistics.suppressedByHysteresis << " because of hysteresis, " << indicatorStatistics.suppressedByDwell << " because of dwell time.";
 }
 
 void X52::IndicatorDataCallback(const WASimCommander::Client::DataRequestRecord &dr)
 {
 	double dval;
 	dr.tryConvert(dval);
-	dataForIndicatorsMap->at(dr.requestId).value = dval;
+	indicatorStatistics.dataCallbacks++;
+	if (!store_indicator_value(static_cast<int>(dr.requestId), dval)) {
+		// The request was removed by a reload, but WASim had already sent its data
+		return;
+	}
 	CLOG(DEBUG,"toconsole", "tofile") << "MSFS says " << dr.nameOrCode << " is now " << dval << " (in unit " << dr.unitName << ").";
-	dataref_ind_action("", xml_file->get_child("indicators"), "", "", false);
-	return;
+}
+
+bool X52::store_indicator_value(int requestid, double value)
+{
+	std::shared_lock reloadLock(reloadMutex);
+	X52::DataForIndicators* data = indicatorRequests->find(requestid);
+	if (!data) {
+		return false;
+	}
+	auto now = indicatorClock();
+	{
+		// evaluate_led() reads the value on the main thread
+		std::lock_guard lock(indicatorMutex);
+		data->value = value;
+		if (!data->received) {
+			data->received = true;
+			if (waitingForInitialData) {
+				initialDataMissing--;
+			}
+		}
+		if (data->trend) {
+			data->history.push(now, value);
+		}
+	}
+	if (static_cast<size_t>(requestid) < ledsForRequestId.size() && !ledsForRequestId[requestid].empty()) {
+		// Leds are evaluated by the main loop, after the burst of data is over
+		std::lock_guard lock(dirtyMutex);
+		if (!indicatorsDirty) {
+			firstDirtyTime = now;
+		}
+		for (size_t ledIndex : ledsForRequestId[requestid])
+		{
+			if (indicatorLedDirty[ledIndex]) {
+				indicatorStatistics.coalescedUpdates++;
+			} else {
+				indicatorLedDirty[ledIndex] = true;
+			}
+		}
+		indicatorsDirty = true;
+	}
+	return true;
 }
 
 void X52::all_on(std::string id, bool on) {
 	if (on) { // On!
 		if (id == "led") {
-			dataref_ind_action("", xml_file->get_child("indicators"), "", "", true); // Force update for all defined leds
+			// Until all first values have arrived, evaluate_dirty_leds() does this
+			if (!waitingForInitialData) {
+				evaluate_indicators(true); // Force update for all defined leds
+			}
 		}
 		else
 		{
@@ -361,49 +973,36 @@ void X52::all_on(std::string id, bool on) {
 	}
 }
 
-bool X52::shift_state_active(const boost::property_tree::ptree xmltree) {
-	for (const boost::property_tree::ptree::value_type &v : xmltree) { // Read all children of shift_states tag
-		if (v.first == "shift_state") // only process shift_state tags
-		{
-			// If the button in this shift_state tag is pressed, check the nested shift_state tag.
-			if (joybuttonstates[std::stoi(v.second.get<std::string>("<xmlattr>.button"))-1]) {
-				if (!shift_state_active(v.second)) {
-					// nested shift button is not pressed, so this state is the current active
-					// Is this newly found state different from the current one?
-					if (CUR_SHIFT_STATE != v.second.get<std::string>("<xmlattr>.name")) {
-						CUR_SHIFT_STATE = v.second.get<std::string>("<xmlattr>.name");
-						CLOG(DEBUG,"toconsole", "tofile") << "New shift state: " + CUR_SHIFT_STATE;
-						if(mfd_on) {
-							// X52.activate_page(X52.ACTIVE_PAGE)
-						}
-						x52hid->setShift("on");
-					}
-				}
-				return true;
-			}
-		}
+void X52::shift_state_action() {
+	uint64_t buttons = joyButtons & config->shiftButtonMask;
+	if (shiftButtonsChecked && buttons == shiftButtons) {
+		return;
 	}
-	return false;
-}
-
-void X52::shift_state_action(const boost::property_tree::ptree& xmltree) {
-	try
+	shiftButtons = buttons;
+	shiftButtonsChecked = true;
+	int id = 0;
+	for (const X52Config::ShiftRule& rule : config->shiftRules)
 	{
-		if (!shift_state_active(xmltree.get_child("shift_states")) && !CUR_SHIFT_STATE.empty() )
-		{
-			x52hid->setShift("off");
-			CUR_SHIFT_STATE.clear();
-			CLOG(DEBUG,"toconsole", "tofile") << "Shift state was cleared.";
-			if (mfd_on) {
-				// X52.activate_page(X52.ACTIVE_PAGE)
-			}
+		if ((buttons & rule.mask) == rule.mask) {
+			id = rule.id;
+			break;
 		}
 	}
-	catch (const boost::property_tree::ptree_error& e)
-	{
-		CLOG(ERROR, "toconsole", "tofile") << "Boost ptree had problems with processing shift_states tags. Error message: " << e.what() << ".";
+	if (id == CUR_SHIFT_STATE) {
 		return;
 	}
+	CUR_SHIFT_STATE = id;
+	if (id > 0) {
+		CLOG(DEBUG,"toconsole", "tofile") << "New shift state: " + config->shiftStateNames[id - 1];
+		x52hid->setShift("on");
+	}
+	else {
+		x52hid->setShift("off");
+		CLOG(DEBUG,"toconsole", "tofile") << "Shift state was cleared.";
+	}
+	if (mfd_on) {
+		// X52.activate_page(X52.ACTIVE_PAGE)
+	}
 }
 
 X52::X52() {
@@ -17,6 +17,13 @@
 
 #include <boost/property_tree/ptree.hpp>
 #include <string>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
 #include <windows.h>
 #define WSMCMND_API_STATIC
 #include <client/WASimClient.h>
@@ -25,6 +32,9 @@
 
 #include "x52HID.h"
 #include "LedBlinker.h"
+#include "X52Config.h"
+#include "IndicatorRequests.h"
+#include "TimerWheel.h"
 #ifndef EASYLOGGINGPP_H
 #include "easylogging++.h"
 #endif
@@ -42,11 +52,24 @@ public:
 	int MAX_MFD_LEN; // Max num of chars written to one MFD row
 	std::string MFD_ON_JOY[3]; // The currently displayed 3 lines of text on the MFD
 	/// <summary>
-	/// Contains the name of the current active shift state as a string.
+	/// The id of the current active shift state, 0 if no shift state is active. See X52Config::ShiftState::id,
+	/// the name in config->shiftStateNames is only used for logging.
 	/// </summary>
-	std::string CUR_SHIFT_STATE;
+	int CUR_SHIFT_STATE = 0;
 	bool mfd_on, led_on;
-	bool joybuttonstates[39];
+	/// <summary>
+	/// The joystick buttons which are held, bit n-1 is set while button n is pressed.
+	/// </summary>
+	uint64_t joyButtons = 0;
+	/// <summary>
+	/// The clock of the button timers. Can be replaced to test the timing of repeater buttons.
+	/// </summary>
+	std::function<TimerWheel::Clock::time_point()> buttonClock = TimerWheel::Clock::now;
+	/// <summary>
+	/// The clock of the indicator evaluation: trend samples, dwell times, the coalescing window and the trend interval.
+	/// Can be replaced to test leds without waiting.
+	/// </summary>
+	std::function<std::chrono::steady_clock::time_point()> indicatorClock = std::chrono::steady_clock::now;
 	struct LastSentPacket {
 		DWORD pdwSendID;
 		std::string message;
@@ -57,13 +80,19 @@ public:
 		EVENT_JOYBUTTON_RELEASE = 300,
 		EVENT_CLIENTID = 10000, // First Client Event ID to send a single command/InputEvent
 	};
-	int lastClientEventId = EVENT_CLIENTID - 1;
-	struct DataForIndicators {
-		std::string dataref;
-		std::string unit;
-		uint8_t simvarindex;
-		DOUBLE value;
+	/// <summary>
+	/// Counters of led changes which were not sent to the joystick. Logged when x52msfsout quits.
+	/// </summary>
+	struct IndicatorStatistics {
+		std::atomic<unsigned long> dataCallbacks = 0;
+		std::atomic<unsigned long> coalescedUpdates = 0; // Data changes for leds which were already waiting for evaluation
+		std::atomic<unsigned long> ledEvaluations = 0;
+		std::atomic<unsigned long> ledWrites = 0;        // Led colors sent to the joystick
+		std::atomic<unsigned long> suppressedByHysteresis = 0;
+		std::atomic<unsigned long> suppressedByDwell = 0;
 	};
+	IndicatorStatistics indicatorStatistics;
+	using DataForIndicators = IndicatorRequests::Request;
 protected:
 	struct SingleDataref {
 		double  dataref[1];
@@ -72,9 +101,133 @@ protected:
 	WASimCommander::Client::WASimClient* wasimclient;
 	x52HID* x52hid;
 	LedBlinker* ledBlinker;
-	boost::property_tree::ptree* xml_file;
-	std::map<int, X52::DataForIndicators>* dataForIndicatorsMap;
+	const X52Config* config;
+	IndicatorRequests* indicatorRequests;
 	std::map<std::string, std::string> CURRENT_LED_COLOR;
+	/// <summary>
+	/// The light of each led in config->indicatorLeds, from the state which was active at the last evaluation.
+	/// </summary>
+	std::vector<std::string> indicatorLedLight;
+	/// <summary>
+	/// For each led in config->indicatorLeds, the index of its active state in config->indicatorStates, or -1 if no state is active.
+	/// </summary>
+	std::vector<int> indicatorLedState;
+	/// <summary>
+	/// For each led, the time until which the led must keep its active state because of the state's dwell attribute.
+	/// </summary>
+	std::vector<std::chrono::steady_clock::time_point> indicatorLedDwellUntil;
+	/// <summary>
+	/// For each led, true if a change was held back by the dwell time and the led must be evaluated again when it expires.
+	/// </summary>
+	std::vector<char> indicatorLedDwellPending;
+	std::atomic<int> dwellPendingCount = 0;
+	std::mutex indicatorMutex; // Guards the evaluation state of the leds above
+	/// <summary>
+	/// For each led, true if data it reads has changed since it was last evaluated.
+	/// Written by the WASim callback thread, read by the main thread, protected by dirtyMutex.
+	/// </summary>
+	std::vector<char> indicatorLedDirty;
+	std::vector<size_t> dirtyLeds; // Reused by evaluate_dirty_leds() to avoid allocations
+	std::atomic<bool> indicatorsDirty = false;
+	std::chrono::steady_clock::time_point firstDirtyTime; // When the first data change of the current burst arrived
+	std::chrono::milliseconds coalesceWindow{20};
+	std::mutex dirtyMutex;
+	/// <summary>
+	/// True from the registration of the indicator requests at startup until every request has sent its first value.
+	/// Meanwhile leds are not evaluated, so that they are set once, with complete data.
+	/// </summary>
+	std::atomic<bool> waitingForInitialData = false;
+	std::atomic<size_t> initialDataMissing = 0; // Requests which have not sent a value yet
+	std::chrono::steady_clock::time_point initialDataSince;
+	static constexpr std::chrono::seconds INITIAL_DATA_TIMEOUT{ 5 };
+	/// <summary>
+	/// For each led, true if swap_config() found a request of the led which has not sent a value yet. The led keeps its light
+	/// until all its requests have sent their first value, or until awaitingDataUntil, instead of showing the states of value 0.
+	/// Protected by indicatorMutex.
+	/// </summary>
+	std::vector<char> indicatorLedAwaitingData;
+	size_t ledsAwaitingData = 0;
+	std::chrono::steady_clock::time_point awaitingDataUntil;
+	/// <summary>
+	/// How the button of an action was pressed. Replaces the press_type attribute which X52LuaOut stored in the XML.
+	/// </summary>
+	enum class PressType : uint8_t {
+		None,
+		Normal, // The action of the button tag was executed
+		Shift,  // The action of a shifted_button tag was executed
+	};
+	/// <summary>
+	/// Runtime state of a button or shifted_button tag, the config itself is never changed.
+	/// </summary>
+	struct ButtonActionState {
+		bool pressed = false;  // The action was executed and the button was not released since
+		PressType pressType = PressType::None;
+		bool toggled = false;  // A toggle button's last press sent on, so the next one sends off
+		TimerWheel::TimerId repeatTimer = 0; // The timer of a held repeater button, 0 if it is not repeating
+	};
+	/// <summary>
+	/// Runtime state of each action in config->buttonActions.
+	/// </summary>
+	std::vector<ButtonActionState> buttonActionStates;
+	/// <summary>
+	/// For each joystick button the index in config->buttonActions of the action its last press executed, -1 once it is released.
+	/// The release always goes to the same action, even if the shift state changed meanwhile.
+	/// </summary>
+	std::array<int32_t, X52Config::BUTTON_COUNT> pressedActions;
+	/// <summary>
+	/// Runs the repeats of held repeater buttons. The key of a timer is the index of its action in config->buttonActions.
+	/// </summary>
+	TimerWheel buttonTimers;
+	/// <summary>
+	/// How far a joystick button is in telling a short press from a long press, a double press or a chord.
+	/// </summary>
+	enum class GesturePhase : uint8_t {
+		None,    // Not pressed, or pressed and its action is in pressedActions
+		Chord,   // Pressed, waiting chordTime for the other buttons of a chord
+		Long,    // Pressed, waiting longPressTime for a long press
+		Tap,     // Pressed, the button has a double press, so its short press waits for the release
+		Double,  // Released after a short press, waiting doublePressTime for a second press
+		InChord, // Pressed as one of the buttons of an executed chord
+	};
+	struct ButtonGesture {
+		GesturePhase phase = GesturePhase::None;
+		TimerWheel::Clock::time_point pressTime;
+		int shiftState = 0;             // CUR_SHIFT_STATE when the button was pressed
+		TimerWheel::TimerId timer = 0;  // The deadline of the phase, 0 if it has none
+		size_t chord = 0;               // Index in config->chords while the phase is InChord
+	};
+	std::array<ButtonGesture, X52Config::BUTTON_COUNT> buttonGestures;
+	/// <summary>
+	/// For each chord in config->chords the action its press executed, -1 once one of its buttons is released.
+	/// </summary>
+	std::vector<int32_t> pressedChordActions;
+	/// <summary>
+	/// The deadlines of the gesture phases. The key of a timer is the joystick button number.
+	/// </summary>
+	TimerWheel gestureTimers;
+	uint64_t shiftButtons = 0;        // The shift buttons in joyButtons when the shift state was last found
+	bool shiftButtonsChecked = false; // False until the shift state was found with the current config
+	/// <summary>
+	/// Indexes of the leds which have a state with a trend op. Trend ops can change without new data,
+	/// so these leds are also evaluated periodically.
+	/// </summary>
+	std::vector<size_t> trendLeds;
+	std::chrono::steady_clock::time_point lastTrendEvaluation;
+	static constexpr std::chrono::milliseconds TREND_EVALUATION_INTERVAL{ 100 };
+	/// <summary>
+	/// Returned by led_state() when the led must not be changed.
+	/// </summary>
+	static constexpr int KEEP_LED_STATE = -2;
+	/// <summary>
+	/// Reverse index from WASim RequestID to the indexes of the leds in config->indicatorLeds which have a state reading that request.
+	/// Indexed by RequestID like indicatorRequests.
+	/// </summary>
+	std::vector<std::vector<size_t>> ledsForRequestId;
+	/// <summary>
+	/// Held shared by the WASim callback thread, and exclusively by swap_config() while the configuration and
+	/// indicatorRequests are replaced.
+	/// </summary>
+	std::shared_mutex reloadMutex;
 
 // FUNCTIONS
 public:
@@ -83,12 +236,26 @@ public:
 	void set_wasimconnect_instance(WASimCommander::Client::WASimClient& client);
 	void set_x52HID(x52HID&);
 	void set_LedBlinker(LedBlinker&);
-	void set_xmlfile(boost::property_tree::ptree* xml_file);
-	void setDataForIndicatorsMap( std::map<int, X52::DataForIndicators>& );
 	/// <summary>
-    /// Validate that all sequence tags contain valid data.
-    /// </summary>
-	bool validateSequences();
+	/// Set the compiled configuration. Must be called after the configuration was compiled, and before indicators are evaluated.
+	/// </summary>
+	void set_config(const X52Config* config);
+	void setIndicatorRequests(IndicatorRequests&);
+	/// <summary>
+	/// Replaces the compiled configuration and the indicator requests while x52msfsout is running. Must be called from the main
+	/// thread, between two passes of the main loop. The WASim callback is blocked while the pointers are switched.
+	/// Leds with the same id keep their light, active state and dwell time, and button tags with the same button number and
+	/// shift state keep their pressed state. Leds which are no longer configured are switched off.
+	/// Values received for requests which exist in both registries are kept. Leds which read a request that has not sent
+	/// a value yet are not evaluated until it has, see indicatorLedAwaitingData.
+	/// </summary>
+	/// <param name="newConfig">The new configuration. The old one must stay alive until this returns, it can be the same.</param>
+	/// <param name="newRequests">The requests of the new configuration, with RequestIDs shared with the old requests.</param>
+	void swap_config(const X52Config& newConfig, IndicatorRequests& newRequests);
+	/// <summary>
+	/// Set how long to wait after the first data change of a burst before leds are evaluated.
+	/// </summary>
+	void set_coalesce_window(long ms);
 	void write_to_mfd(std::string& line1, std::string& line2, std::string& line3);
 	/// <summary>
     /// Maintain the led's current color in the CURRENT_LED_COLOR map. Sets a led to a given color, if it is not already that color, according to CURRENT_LED_COLOR.
@@ -102,60 +269,157 @@ public:
 	/// </summary>
 	/// <param name="led">The name of one of the 11 leds, for example, "t1".</param>
 	/// <param name="light">The name of a color, or "on" or "off", or a sequence.</param>
+	/// <param name="sequence">Index of the sequence in config->sequences if light is a sequence, otherwise -1.</param>
 	/// <param name="current_light">The name of the led's current color.</param>
-	/// <param name="state">Ptree of a state tag</param>
 	/// <param name="force">True to update the led's color even if it already has that color.</param>
-	void update_led(std::string led, std::string light, std::string current_light, boost::property_tree::ptree &state, bool force);
-	/// <summary>
-	/// Evaluates if the given simvarvalue matches the given operand.
-	/// </summary>
-	/// <param name="simvarvalue">A SimVar's value as a double.</param>
-	/// <param name="op">Four characters. The first two can be == for equality, -- for less than, and ++ for greater than. The last two are a two-digit number.</param>
-	/// <returns></returns>
-	bool evaluate_xml_op(double simvarvalue, std::string op);
-	void execute_button_press(boost::property_tree::ptree &xmltree, int btn);
-	void execute_button_release(boost::property_tree::ptree &xmltree, int btn) const;
-	/// <summary>This method is called recursively to process elements under the assignments tag.</summary>
-	/// <param name="xmltree">A Property Tree of EITHER all button tags under the assignments tag OR a button tag OR a shifted_button tag under a button tag.</param>
-	/// <param name="status">Contains the string pressed or released.</param>
-	/// https://learn.microsoft.com/en-us/cpp/build/reference/summary-visual-cpp?view=msvc-170
-	bool assignment_button_action(boost::property_tree::ptree &xmltree, int btn, std::string status);
-	/// <summary>
-	/// Goes through all led and state tags inside the indicators tag by recursively calling itself. Evaluates the op attribute of every state tag
-	/// using the simulator data stored in dataForIndicatorsMap and updates joystick leds.
-	/// Each led's current color is stored in the led tag's current_light attribute created during runtime. It stores the value of the light
-	/// attribute from the active state tag.
-	/// </summary>
-	/// <param name="tagname">Led or state. Initially an empty string.</param>
-	/// <param name="xmltree">Initially, immediate children (led tags) of the indicators tag. On recursive calls, a state tag below a led tag or below another state tag.</param>
-	/// <param name="led">std::string The led's name taken from the id attribute of the led tag</param>
-	/// <param name="current_light">Used during recursive calls: current color of the currently processed led.</param>
+	void update_led(const std::string& led, const std::string& light, int sequence, const std::string& current_light, bool force);
+	/// <summary>
+	/// Executes the action of a button or shifted_button tag as its type requires, unless the button was already pressed and not released since.
+	/// </summary>
+	/// <param name="action">Index of the action in config->buttonActions.</param>
+	void execute_button_press(size_t action);
+	void execute_button_release(size_t action);
+	/// <summary>
+	/// Sends the command, sets the dataref, or executes the calculator code of an action.
+	/// </summary>
+	/// <param name="action">Index of the action in config->buttonActions.</param>
+	/// <param name="value">The data of the command, or the value of the dataref. Not used by calculator code.</param>
+	void send_button_action(size_t action, double value);
+	/// <summary>
+	/// Executes the long presses, single presses and chord timeouts whose time has come, and repeats the actions of the
+	/// held repeater buttons whose interval has passed. Called from the main loop.
+	/// </summary>
+	void run_button_timers();
+	/// <summary>
+	/// Processes a press or release of a joystick button using the compiled button and chord tags of the assignments tag.
+	/// A button without long press, double press or chord executes its action at once. Otherwise the press waits until the
+	/// gesture is known, see GesturePhase.
+	/// </summary>
+	/// <param name="btn">Joystick button number.</param>
+	/// <param name="pressed">True if the button was pressed, false if it was released.</param>
+	/// <param name="time">When the HID report with the press or release arrived.</param>
+	/// <returns>True if a button or chord tag handled the press or release, or will handle it when the gesture is known.</returns>
+	bool assignment_button_action(int btn, bool pressed, TimerWheel::Clock::time_point time);
+	/// <summary>
+	/// Executes the press of an action for a button, and remembers it for the release.
+	/// </summary>
+	/// <param name="action">Index in config->buttonActions, -1 if the button has no action for the gesture.</param>
+	/// <returns>False if action is -1.</returns>
+	bool press_button_action(int btn, int32_t action);
+	void release_button_action(int btn);
+	/// <summary>
+	/// Starts telling a short press from a long press or double press, once the button is known not to be part of a chord.
+	/// </summary>
+	bool start_gesture(int btn);
+	/// <summary>
+	/// Handles the release of a button before it became a long press or a chord.
+	/// </summary>
+	bool tap_button(int btn, TimerWheel::Clock::time_point time);
+	/// <summary>
+	/// Executes the first chord whose buttons are all waiting in the Chord phase, together with btn which was just pressed.
+	/// </summary>
+	/// <returns>True if a chord was executed.</returns>
+	bool start_chord(int btn);
+	/// <summary>
+	/// Checks if a chord with btn can still be executed, because each of its other buttons is released or waiting in the Chord phase.
+	/// </summary>
+	/// <returns>False if every chord of btn has a button which is already held for its own action, so btn need not wait chordTime.</returns>
+	bool chord_possible(int btn) const;
+	/// <summary>
+	/// Called when the deadline of a button's gesture phase has passed.
+	/// </summary>
+	void gesture_timer_expired(int btn);
+	/// <summary>
+	/// Evaluates the states of all leds in the compiled configuration and updates joystick leds.
+	/// </summary>
 	/// <param name="force">Passed on to the update_led function. Force the update of the led's color even if it already has that color.</param>
-	/// <returns>The light attribute of the first state tag which is true when all state tags are evaluated from inside out.</returns>
-	std::string dataref_ind_action(std::string_view tagname, boost::property_tree::ptree &xmltree, std::string const & led, std::string const & current_light, bool force = false);
+	void evaluate_indicators(bool force = false);
+	/// <summary>
+	/// Builds ledsForRequestId from the RequestIDs stored in the compiled states. Must be called after
+	/// RequestIDs were assigned and before the data requests are sent to WASim.
+	/// </summary>
+	void index_indicator_requests();
+	/// <summary>
+	/// Adds a led to the leds of a RequestID in ledsForRequestId, unless it is already there.
+	/// </summary>
+	void add_led_for_request(int requestid, size_t ledIndex);
+	/// <summary>
+	/// Evaluates the compiled condition of a state on a fixed size stack, using the values of its terms in indicatorRequests.
+	/// </summary>
+	/// <returns>True if the condition is true.</returns>
+	bool evaluate_condition(const X52Config::IndicatorState& state, std::chrono::steady_clock::time_point now) const;
+	/// <summary>
+	/// Evaluates the states of one led using the simulator data stored in indicatorRequests and updates the joystick led.
+	/// States are checked in the order they were compiled, innermost first, and the first state which is true sets the led's light.
+	/// If no state is true, the led is set to off. The light is stored in indicatorLedLight.
+	/// A state with a condition is true if its condition is true.
+	/// The active state is kept while its op is true within the state's hysteresis, and for at least the state's dwell time.
+	/// indicatorMutex is only held while the state is found, not while the joystick is written.
+	/// </summary>
+	/// <param name="ledIndex">Index of the led in config->indicatorLeds.</param>
+	/// <param name="force">Passed on to the update_led function. Force the update of the led's color even if it already has that color.</param>
+	void evaluate_led(size_t ledIndex, bool force);
+	/// <summary>
+	/// The part of evaluate_led() which reads the simulator data, holding indicatorMutex: finds the new state of a led,
+	/// applying hysteresis and dwell time, and stores it in indicatorLedState.
+	/// </summary>
+	/// <returns>The index of the new state, -1 for off, or KEEP_LED_STATE if the dwell time holds back the change or the led waits for data.</returns>
+	int led_state(size_t ledIndex, bool force);
+	/// <summary>
+	/// Returns true if every request which the states of a led read has sent a value. indicatorMutex must be held.
+	/// </summary>
+	bool led_has_data(size_t ledIndex) const;
+	/// <summary>
+	/// Evaluates the leds which are still waiting for the first values of their requests once awaitingDataUntil has passed,
+	/// with the values they have. Called from evaluate_dirty_leds().
+	/// </summary>
+	void evaluate_awaiting_leds();
+	/// <summary>
+	/// Evaluates the leds whose change was held back by a dwell time which has expired since. Called from the main loop.
+	/// </summary>
+	void evaluate_dwelling_leds();
+	/// <summary>
+	/// Evaluates the leds with trend ops every TREND_EVALUATION_INTERVAL, because for example a rising value becomes steady
+	/// without any new data arriving. Called from the main loop.
+	/// </summary>
+	void evaluate_trend_leds();
+	/// <summary>
+	/// Holds back the evaluation of leds until every indicator request has sent its first value, or INITIAL_DATA_TIMEOUT has passed.
+	/// Then all leds are evaluated once by evaluate_dirty_leds(). Must be called before the requests are registered.
+	/// </summary>
+	/// <param name="since">When the connection to WASim was made, to log how long it took until the leds were set.</param>
+	void wait_for_initial_data(std::chrono::steady_clock::time_point since);
+	/// <summary>
+	/// Evaluates the leds whose data has changed, once the coalescing window of the current burst of changes has passed.
+	/// Called from the main loop, so several data changes arriving back to back only cause one evaluation per led.
+	/// </summary>
+	void evaluate_dirty_leds();
+	/// <summary>
+	/// Logs the indicator statistics.
+	/// </summary>
+	void log_indicator_statistics() const;
 	/// <summary>
 	/// Called by the WASimServer when a requested SimVar has changed in MSFS.
-	/// It stores the incoming value of the SimVar in dataForIndicatorsMap to be used later.
+	/// It stores the incoming value of the SimVar in indicatorRequests and marks the leds which read this SimVar for evaluation.
 	/// </summary>
 	void IndicatorDataCallback(const WASimCommander::Client::DataRequestRecord&);
 	/// <summary>
+	/// Stores a new value of a request in indicatorRequests, adds it to the request's trend history and marks the leds which
+	/// read the request for evaluation by evaluate_dirty_leds().
+	/// </summary>
+	/// <returns>False if there is no request with this RequestID, for example because a reload has removed it.</returns>
+	bool store_indicator_value(int requestid, double value);
+	/// <summary>
 	/// Handles switching a target on or off. For led on, it starts to operate leds according to XML configuration. For led off, it does nothing. For mfd on, it ???. For mfd off, it only clears the MFD text.
 	/// </summary>
 	/// <param name="id">The target's id. Can be "led" or "mfd".</param>
 	/// <param name="on">True of false.</param>
 	void all_on(std::string id, bool on);
 	/// <summary>
-	/// A recursively called function which, based on joybuttonstates[], finds out what is the currently active shift state.
-	/// If a shift state was found, its name is stored in CUR_SHIFT_STATE and the joystick's SHIFT indicator is switched on.
-	/// </summary>
-	/// <param name="xmltree">Initially, the whole XML configuration file. On recursive calls, only the nested shift_state tag.</param>
-	/// <returns>True if an active shift state was found. On recursive calls, true if the button in the nested shift_state tag is pressed.</returns>
-	bool shift_state_active(const boost::property_tree::ptree xmltree);
-	/// <summary>
-	/// Initiates the calling of the recursive shift_state_active function and handles the case when no active shift state was found.
+	/// Finds the active shift state in joyButtons with the compiled shift rules. Only done when a button used by a shift_state
+	/// tag has changed. If the shift state changed, CUR_SHIFT_STATE is updated and the joystick's SHIFT indicator is switched.
 	/// </summary>
-	/// <param name="xml_file">Pointer to the whole XML configuration file.</param>
-	void shift_state_action(const boost::property_tree::ptree& xml_file);
+	void shift_state_action();
 };
 
 #endif
\ No newline at end of file
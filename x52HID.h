@@ -45,6 +45,11 @@ public:
     /// <returns></returns>
     bool setLedColor(const std::string& targetLed, const std::string& color);
     /// <summary>
+    /// Number of HID packets setLedColor() sends to set the color of a led. Fire and throttle have one physical led, the others have a red and a green one.
+    /// </summary>
+    /// <param name="targetLed">The name of one of the 11 leds, for example, "t1".</param>
+    static int ledPacketCount(std::string_view targetLed) { return targetLed == "fire" || targetLed == "throttle" ? 1 : 2; }
+    /// <summary>
     /// Turns on or off the SHIFT indicator on the MFD
     /// </summary>
     /// <param name="shiftState">The string "on" or "off"</param>
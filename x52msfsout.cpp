@@ -21,9 +21,22 @@
 
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <chrono>
+#include <unordered_map>
 #include "easylogging++.h"
 #include "x52.h"
 #include "LedBlinker.h"
+#include "ConfigCache.h"
+#include "ConfigAnalyzer.h"
+#include "ConfigBenchmark.h"
 #include <cstdlib>
 
 #include <hidsdi.h>
@@ -48,9 +61,29 @@ INITIALIZE_EASYLOGGINGPP
 HANDLE  hSimConnect = NULL;
 X52 myx52;
 x52HID x52hid;
-boost::property_tree::ptree xml_file; // Create empty property tree object
+X52Config* x52config = nullptr; // Compiled form of the XML configuration file of the active profile
+/// <summary>
+/// A compiled XML configuration file. Without a profile directory, the xmlconfig file is the only profile.
+/// Activating a profile only switches x52config and indicatorRequests to its config and requests.
+/// </summary>
+struct Profile {
+	std::string filename;
+	std::unique_ptr<X52Config> config;
+	std::unique_ptr<IndicatorRequests> requests; // The data requests of config, assigned when it is loaded by AssignProfileRequests()
+	std::filesystem::file_time_type writeTime;   // For the watch option
+};
+std::vector<Profile> profiles;
+size_t activeProfile = 0;
+size_t defaultProfile = 0; // Used for aircraft which are not matched by any aircraft tag
+int pendingProfile = -1;   // The profile which becomes active in the main loop, set when the aircraft's title changes
+std::string aircraftTitle; // Title of the user's aircraft, empty if not known yet
+std::vector<int> masterTargetOn; // For each target in x52config->masterTargets: 1 if on, 0 if off, -1 if not known yet
+/// <summary>
+/// The Client Event ID of each command which was mapped in SimConnect. A mapping cannot be undone, so a command keeps its ID
+/// while x52msfsout runs, also when it is used by another profile or a reloaded XML file.
+/// </summary>
+std::unordered_map<std::string, int> clientEventIds;
 WASimCommander::Client::WASimClient* wasimclient;
-uint32_t lastIndicatorRequestID = 1;
 /// <summary>
 /// Exit the infinite processing while loop in main()
 /// </summary>
@@ -110,12 +143,18 @@ struct StructData {
 enum DATA_DEFINE_ID {
 	DEF_MASTER,
 	DEF_ABSTIME,
+	DEF_TITLE,
 	DEF_SINGLE_DATAREF = 10, // Definition used in X52 class to modify a single dataref/simvar
 };
 
 enum DATA_REQUEST_ID {
 	REQ_MASTER,
 	REQ_ABSTIME,
+	REQ_TITLE,
+};
+
+enum SYSTEM_EVENT_ID {
+	EVENT_AIRCRAFT_LOADED = 100, // Below the Client Event IDs used by the X52 class
 };
 
 struct LogitechDirectOutputService {
@@ -125,7 +164,37 @@ struct LogitechDirectOutputService {
 };
 LogitechDirectOutputService LogitechServiceResults;
 
-std::map<int, X52::DataForIndicators> dataForIndicatorsMap;
+IndicatorRequests* indicatorRequests = nullptr; // The data requests of the active profile, which are registered in WASim
+RequestIdDirectory requestIdDirectory;          // Gives identical requests of all profiles the same RequestID
+
+/// <summary>
+/// Returns the first profile which has an aircraft tag matching the title, or the default profile.
+/// </summary>
+size_t ProfileForAircraft(const std::string& title)
+{
+	for (size_t i = 0; i < profiles.size(); i++)
+	{
+		if (profiles[i].config->matches_aircraft(title))
+		{
+			return i;
+		}
+	}
+	return defaultProfile;
+}
+
+/// <summary>
+/// Asks MSFS to send the title of the user's aircraft now, and whenever it changes.
+/// </summary>
+void RequestAircraftTitle()
+{
+	SimConnect_RequestDataOnSimObject(hSimConnect,
+		REQ_TITLE,
+		DEF_TITLE,
+		SIMCONNECT_SIMOBJECT_TYPE_USER,
+		SIMCONNECT_PERIOD_VISUAL_FRAME,
+		SIMCONNECT_DATA_REQUEST_FLAG_CHANGED
+	);
+}
 
 void CALLBACK MyDispatchProcRD(SIMCONNECT_RECV* pData, DWORD cbData, void* pContext)
 {
@@ -148,54 +217,81 @@ void CALLBACK MyDispatchProcRD(SIMCONNECT_RECV* pData, DWORD cbData, void* pCont
 				// last value of the SimVars in the XML.
 				// Also, the second if-else block was merged into the first bigger if-else block.
 				int targetnumber = 0;
-
-				for (boost::property_tree::ptree::value_type &v : xml_file.get_child("master")) { // Read all children of master tag
-					if (v.first == "target") // only process target tags
+				for (size_t targetindex = 0; targetindex < x52config->masterTargets.size(); targetindex++)
+				{
+					if (targetnumber + 1 >= static_cast<int>(pObjData->dwDefineCount))
 					{
-						CLOG(DEBUG,"toconsole", "tofile") << fmt::format( "Simulator data for Master Target '{}' has changed. Switch data is now {:.2f} and brightness data is {:.2f}.", v.second.get<std::string>("<xmlattr>.id").c_str(), pS->dataarray[targetnumber], pS->dataarray[targetnumber + 1]);
-						// Check if SimVar value equals operator in XML
-						if (myx52.evaluate_xml_op(pS->dataarray[targetnumber], v.second.get<std::string>("<xmlattr>.op"))) {
-							if (v.second.get<std::string>("<xmlattr>.on", "") != "true") {
-								// If this target is not already on, switch it on.
-								myx52.all_on(v.second.get<std::string>("<xmlattr>.id"), true);
-								// Store in the XML that this target is currently on
-								v.second.put<std::string>("<xmlattr>.on", "true");
-								// Store the target's status in the x52 class.
-								if (v.second.get<std::string>("<xmlattr>.id") == "mfd") myx52.mfd_on = true;
-								if (v.second.get<std::string>("<xmlattr>.id") == "led") myx52.led_on = true;
-							}
-
-							CLOG(DEBUG,"toconsole", "tofile") << fmt::format( "Setting brightness of Master Target '{}' to {:.2f}.", v.second.get<std::string>("<xmlattr>.id").c_str(), (pS->dataarray[targetnumber+1] - std::stod(v.second.get<std::string>("<xmlattr>.min"))) / (std::stod(v.second.get<std::string>("<xmlattr>.max")) - std::stod(v.second.get<std::string>("<xmlattr>.min"))) * 128 * std::stod(v.second.get<std::string>("<xmlattr>.default")) / 100);
-							x52hid.setBrightness(v.second.get<std::string>("<xmlattr>.id"), (pS->dataarray[targetnumber+1] - std::stod(v.second.get<std::string>("<xmlattr>.min"))) / (std::stod(v.second.get<std::string>("<xmlattr>.max")) - std::stod(v.second.get<std::string>("<xmlattr>.min"))) * 128 * std::stod(v.second.get<std::string>("<xmlattr>.default")) / 100 );
+						// Data sent for the master tag before it was reloaded
+						break;
+					}
+					const X52Config::MasterTarget& target = x52config->masterTargets[targetindex];
+					CLOG(DEBUG,"toconsole", "tofile") << fmt::format( "Simulator data for Master Target '{}' has changed. Switch data is now {:.2f} and brightness data is {:.2f}.", target.id, pS->dataarray[targetnumber], pS->dataarray[targetnumber + 1]);
+					// Check if SimVar value equals operator in XML
+					if (target.op.matches(pS->dataarray[targetnumber])) {
+						if (masterTargetOn[targetindex] != 1) {
+							// If this target is not already on, switch it on.
+							myx52.all_on(target.id, true);
+							// Store that this target is currently on
+							masterTargetOn[targetindex] = 1;
+							// Store the target's status in the x52 class.
+							if (target.id == "mfd") myx52.mfd_on = true;
+							if (target.id == "led") myx52.led_on = true;
 						}
-						else
-						{
-							if (v.second.get<std::string>("<xmlattr>.on", "") != "false") {
-								// If this target is not already off, switch it off.
-								myx52.all_on(v.second.get<std::string>("<xmlattr>.id"), false);
-								// Set this target's brightness to 0.
-								CLOG(DEBUG,"toconsole", "tofile") << fmt::format( "Setting brightness of Master Target '{}' to zero.", v.second.get<std::string>("<xmlattr>.id").c_str());
-								x52hid.setBrightness( v.second.get<std::string>("<xmlattr>.id"), 0x0);
-								// Store in the XML that this target is currently off
-								v.second.put<std::string>("<xmlattr>.on", "false");
-								// Store the target's status in the x52 class.
-								if (v.second.get<std::string>("<xmlattr>.id") == "mfd") myx52.mfd_on = false;
-								if (v.second.get<std::string>("<xmlattr>.id") == "led") myx52.led_on = false;
-							}
+
+						double brightness = (pS->dataarray[targetnumber+1] - target.min) / (target.max - target.min) * 128 * target.defaultBrightness / 100;
+						CLOG(DEBUG,"toconsole", "tofile") << fmt::format( "Setting brightness of Master Target '{}' to {:.2f}.", target.id, brightness);
+						x52hid.setBrightness(target.id, brightness);
+					}
+					else
+					{
+						if (masterTargetOn[targetindex] != 0) {
+							// If this target is not already off, switch it off.
+							myx52.all_on(target.id, false);
+							// Set this target's brightness to 0.
+							CLOG(DEBUG,"toconsole", "tofile") << fmt::format( "Setting brightness of Master Target '{}' to zero.", target.id);
+							x52hid.setBrightness(target.id, 0x0);
+							// Store that this target is currently off
+							masterTargetOn[targetindex] = 0;
+							// Store the target's status in the x52 class.
+							if (target.id == "mfd") myx52.mfd_on = false;
+							if (target.id == "led") myx52.led_on = false;
 						}
-						targetnumber = targetnumber + 2;
 					}
+					targetnumber = targetnumber + 2;
 				}
 			}
 			break;
 		}
 
+		case REQ_TITLE:
+		{
+			// The data is a single SIMCONNECT_DATATYPE_STRING256
+			const char* title = reinterpret_cast<const char*>(&pObjData->dwData);
+			aircraftTitle.assign(title, strnlen(title, 256));
+			size_t profile = ProfileForAircraft(aircraftTitle);
+			CLOG(DEBUG,"toconsole", "tofile") << "Aircraft title is now \"" << aircraftTitle << "\", its profile is " << profiles[profile].filename << ".";
+			// The profile is switched by the main loop, after this message was processed
+			pendingProfile = profile != activeProfile ? static_cast<int>(profile) : -1;
+			break;
+		}
+
 		default:
 			CLOG(WARNING,"toconsole", "tofile") << "Dispatcher did nothing.";
 			break;
 		}
 		break;
 	}
+	case SIMCONNECT_RECV_ID_EVENT_FILENAME:
+	{
+		SIMCONNECT_RECV_EVENT_FILENAME* pEvent = (SIMCONNECT_RECV_EVENT_FILENAME*)pData;
+		if (pEvent->uEventID == EVENT_AIRCRAFT_LOADED)
+		{
+			CLOG(DEBUG,"toconsole", "tofile") << "Aircraft loaded: " << pEvent->szFileName;
+			// The title is sent again even if it has not changed
+			RequestAircraftTitle();
+		}
+		break;
+	}
 	case SIMCONNECT_RECV_ID_EXCEPTION:
 	{
 		SIMCONNECT_RECV_EXCEPTION* pObjData = (SIMCONNECT_RECV_EXCEPTION*)pData;
@@ -219,7 +315,9 @@ void CALLBACK MyDispatchProcRD(SIMCONNECT_RECV* pData, DWORD cbData, void* pCont
 void handleRawInputData(LPARAM lParam)
 {
 	UINT size = 0;
-	bool joybuttonstatesnew[39] = { false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false };
+	uint64_t joyButtonsNew = 0; // Bit n-1 is set while button n is pressed
+	// All edges of one report get the same timestamp, the time it arrived
+	auto reportTime = myx52.buttonClock();
 	GetRawInputData((HRAWINPUT)lParam, RID_INPUT, NULL, &size, sizeof(RAWINPUTHEADER));
 	RAWINPUT* input = (RAWINPUT*)malloc(size);
 	bool gotInput = GetRawInputData((HRAWINPUT)lParam, RID_INPUT, input, &size, sizeof(RAWINPUTHEADER)) > 0;
@@ -241,16 +339,19 @@ void handleRawInputData(LPARAM lParam)
 				USAGE* usages = (USAGE*)malloc(sizeof(USAGE) * usageCount);
 				HidP_GetUsages(HidP_Input, buttonCaps[i].UsagePage, 0, usages, &usageCount, data, (PCHAR)input->data.hid.bRawData, input->data.hid.dwSizeHid);
 				for (ULONG usageIndex = 0; usageIndex < usageCount; ++usageIndex) {
-					joybuttonstatesnew[usages[usageIndex] - 1] = true;
+					if (usages[usageIndex] >= 1 && usages[usageIndex] <= X52Config::BUTTON_COUNT) {
+						joyButtonsNew |= uint64_t(1) << (usages[usageIndex] - 1);
+					}
 				}
 
-				for (USHORT buttonIndex = 0; buttonIndex < 39; ++buttonIndex) {
+				for (USHORT buttonIndex = 0; buttonIndex < X52Config::BUTTON_COUNT; ++buttonIndex) {
+					uint64_t bit = uint64_t(1) << buttonIndex;
 					// Was the button not pressed before? The it has just been pressed.
-					if (myx52.joybuttonstates[buttonIndex] == false && joybuttonstatesnew[buttonIndex] == true) {
+					if (!(myx52.joyButtons & bit) && (joyButtonsNew & bit)) {
 						CLOG(TRACE,"toconsole", "tofile") << "Joy Button " << std::to_string(buttonIndex + 1) << " was pressed.";
 
 						// Carry out actions declared in the assignments tag for button press
-						myx52.assignment_button_action(xml_file.get_child("assignments"), buttonIndex + 1, "pressed");
+						myx52.assignment_button_action(buttonIndex + 1, true, reportTime);
 						try
 						{
 							// Carry out actions declared in the mfd tag for buttons
@@ -263,22 +364,21 @@ void handleRawInputData(LPARAM lParam)
 					}
 
 					// Button not pressed now. Was it pressed before? Then it has just been released.
-					if (myx52.joybuttonstates[buttonIndex] == true && joybuttonstatesnew[buttonIndex] == false) {
+					if ((myx52.joyButtons & bit) && !(joyButtonsNew & bit)) {
 						CLOG(TRACE,"toconsole", "tofile") << "Joy Button " << std::to_string(buttonIndex + 1) << " was released.";
 						// Carry out actions declared in the assignments tag for button release
-						myx52.assignment_button_action(xml_file.get_child("assignments"), buttonIndex + 1, "released");
+						myx52.assignment_button_action(buttonIndex + 1, false, reportTime);
 					}
-					
-					// Update our array with the current state of the button.
-					myx52.joybuttonstates[buttonIndex] = joybuttonstatesnew[buttonIndex];
 				}
+				// Update our word with the current state of the buttons.
+				myx52.joyButtons = joyButtonsNew;
 				free(usages);
 			}
 			free(buttonCaps);
 
 			// After the state of all X52 buttons were collected,
 			// check if the shift state was changed.
-			myx52.shift_state_action(xml_file);
+			myx52.shift_state_action();
 		}
 		free(data);
 	}
@@ -509,6 +609,7 @@ void cleanup() {
 	if(hSimConnect != nullptr) 
 	{
 		SimConnect_Close(hSimConnect);
+		myx52.log_indicator_statistics();
 	}
 	CLOG(INFO,"toconsole", "tofile") << "Starting Logitech DirectOutput service.";
 	LogitechServiceStart();
@@ -535,108 +636,710 @@ void handleTerminate() {
 }
 
 
-void DataRequestsForIndicators(std::string tagname, boost::property_tree::ptree &xmltree)
+/// <summary>
+/// Assigns a RequestID to every state, condition term and sim_evaluate led of config, and stores the data requests they need in requests.
+/// The RequestIDs come from directory, so a request which is identical to one of another profile or of a previous reload gets its RequestID,
+/// and does not have to be registered again when that configuration is replaced.
+/// </summary>
+void AssignIndicatorRequests(X52Config& config, IndicatorRequests& requests, RequestIdDirectory& directory)
 {
-	X52::DataForIndicators dataForIndicatorsStruct;
-	try
+	auto start = std::chrono::steady_clock::now();
+	requests.clear();
+	std::vector<int> newRequestIDs;
+	// If we already asked for the same dataref + unit + simvarindex then
+	// that is the same request. Don't request it again, just return its RequestID.
+	// A SimVar read in another unit of the same quantity, like percent and percent over 100, shares the request
+	// of the first state which reads it. Its ops stay as written, the value is converted with unitFactor instead.
+	struct UnitRequest {
+		int requestid;
+		double factor; // Converts the unit of the request to the canonical unit
+	};
+	// Like IndicatorRequests::find(), up to IndicatorRequests::LINEAR_SEARCH_LIMIT requests are compared one by one,
+	// and canonicalRequests is only built when there are more.
+	std::unordered_map<std::string, UnitRequest> canonicalRequests;
+	auto canonicalKey = [](const std::string& dataref, const std::string& canonical, uint8_t simvarindex) {
+		return fmt::format("{}\n{}\n{}", dataref, canonical, simvarindex);
+	};
+	auto findCanonical = [&](const std::string& dataref, const std::string& canonical, uint8_t simvarindex) -> std::optional<UnitRequest> {
+		if (requests.size() <= IndicatorRequests::LINEAR_SEARCH_LIMIT)
+		{
+			std::optional<UnitRequest> shared;
+			requests.for_each([&](int requestid, const X52::DataForIndicators& data) {
+				if (!shared && data.simvarindex == simvarindex && data.dataref == dataref)
+				{
+					std::string dataCanonical = data.unit;
+					double dataFactor = X52Config::to_canonical_unit(dataCanonical);
+					if (dataCanonical == canonical)
+					{
+						shared = UnitRequest{ requestid, dataFactor };
+					}
+				}
+			});
+			return shared;
+		}
+		if (canonicalRequests.empty())
+		{
+			requests.for_each([&](int requestid, const X52::DataForIndicators& data) {
+				std::string dataCanonical = data.unit;
+				double dataFactor = X52Config::to_canonical_unit(dataCanonical);
+				canonicalRequests.emplace(canonicalKey(data.dataref, dataCanonical, data.simvarindex), UnitRequest{ requestid, dataFactor });
+			});
+		}
+		auto it = canonicalRequests.find(canonicalKey(dataref, canonical, simvarindex));
+		return it == canonicalRequests.end() ? std::nullopt : std::optional<UnitRequest>(it->second);
+	};
+	size_t unitMerges = 0;
+	auto requestIdFor = [&](const std::string& dataref, const std::string& unit, uint8_t simvarindex, float delta, double& unitFactor) -> int {
+		unitFactor = 1.0;
+		int requestid = requests.find(dataref, unit, simvarindex);
+		if (requestid != 0)
+		{
+			return requestid;
+		}
+		std::string canonical = unit;
+		double factor = X52Config::to_canonical_unit(canonical);
+		std::optional<UnitRequest> shared = findCanonical(dataref, canonical, simvarindex);
+		if (shared)
+		{
+			unitMerges++;
+			unitFactor = shared->factor / factor;
+			return shared->requestid;
+		}
+		// Store the data for later when we react to data changes
+		X52::DataForIndicators data;
+		data.dataref = dataref;
+		data.unit = unit;
+		data.simvarindex = simvarindex;
+		data.delta = delta; // The delta of the first state which reads this data is used
+		requestid = requests.add(std::move(data));
+		newRequestIDs.push_back(requestid);
+		if (!canonicalRequests.empty())
+		{
+			canonicalRequests.emplace(canonicalKey(dataref, canonical, simvarindex), UnitRequest{ requestid, factor });
+		}
+		return requestid;
+	};
+	// First assign a RequestID to every state, so that the reverse index of
+	// leds can be built before the first value arrives from WASim.
+	for (X52Config::IndicatorState& state : config.indicatorStates)
 	{
-		// Discover all branches of the indicators tag
-		for (boost::property_tree::ptree::value_type& v : xmltree)
+		if (state.simresult > 0)
 		{
-			if (v.first == "led") // a led tag which contains multiple state tags
+			// The led of this state is evaluated in MSFS, it is requested below
+			continue;
+		}
+		if (state.instructionCount > 0)
+		{
+			// A condition reads the SimVars of its terms
+			for (size_t c = state.firstInstruction; c < state.firstInstruction + state.instructionCount; c++)
 			{
-				if (v.second.count("state") != 0) // This led has a state declared
+				if (config.conditionCode[c].type == X52Config::ConditionInstruction::Type::Test)
 				{
-					DataRequestsForIndicators(v.first, v.second);
+					X52Config::ConditionTerm& term = config.conditionTerms[config.conditionCode[c].term];
+					term.requestid = requestIdFor(term.dataref, term.unit, term.simvarindex, term.delta, term.unitFactor);
 				}
-			} else if (v.first == "state") { // a state tag below a led tag or below another state tag
-				DataRequestsForIndicators(v.first, v.second);
 			}
+			continue;
 		}
-		// No subitems to loop into, we're at bottom (innermost state)
-		if (tagname == "state") {
-			std::string attr;
-			std::string dataref;
-			std::string unit;
-			bool foundsamedataref = false;
-			uint8_t simvarindex = 0;
-			size_t separatorpos;
-			float delta;
-
-			attr = xmltree.get<std::string>("<xmlattr>.dataref");
-			// Separate SimVar name from unit of measurement
-			separatorpos = attr.find("%");
-			dataref = attr.substr(0, separatorpos);
-			unit = attr.substr(separatorpos + 1);
-			// If an index is given, read it from the XML
-			if (xmltree.get("<xmlattr>.index", "nil") != "nil")
-			{
-				simvarindex = xmltree.get<int>("<xmlattr>.index");
-			}
-			// If a delta is given, read it from the XML
-			if (xmltree.get("<xmlattr>.delta", "nil") != "nil")
+		// Store the request ID in the compiled state
+		state.requestid = requestIdFor(state.dataref, state.unit, state.simvarindex, state.delta, state.unitFactor);
+	}
+	if (unitMerges > 0)
+	{
+		CLOG(INFO,"toconsole", "tofile") << "Unit conversion eliminated " << unitMerges << " duplicate SimVar subscriptions, which read a SimVar in another unit of the same quantity.";
+	}
+
+	// Trend ops need the recent samples of their SimVar
+	for (const X52Config::IndicatorState& state : config.indicatorStates)
+	{
+		if (state.op.is_trend() && state.simresult == 0)
+		{
+			requests.find(state.requestid)->trend = true;
+		}
+	}
+	for (const X52Config::ConditionTerm& term : config.conditionTerms)
+	{
+		if (term.op.is_trend() && term.requestid != 0)
+		{
+			requests.find(term.requestid)->trend = true;
+		}
+	}
+
+	// Threshold buckets: instead of the SimVar's value, ask MSFS to evaluate
+	// all ops which read the SimVar and send us a bit mask of the results.
+	if (config.bucketRequests)
+	{
+		for (int requestid : newRequestIDs)
+		{
+			std::vector<X52Config::XmlOp> ops;
+			// Conditions need the SimVar's value
+			bool canBucket = std::none_of(config.conditionTerms.begin(), config.conditionTerms.end(), [requestid](const X52Config::ConditionTerm& term) {
+				return term.requestid == requestid;
+			});
+			for (const X52Config::IndicatorState& state : config.indicatorStates)
 			{
-				try {
-					delta = xmltree.get<float>("<xmlattr>.delta");
+				if (!canBucket || state.requestid != requestid)
+				{
+					continue;
 				}
-				catch (const boost::property_tree::ptree_bad_data& e) {
-					CLOG(ERROR, "toconsole", "tofile") << "For dataref " << dataref << ", unit " << unit << ", could not convert 'delta' " << e.data<std::string>() << " to a floating-point number. Check if the decimal separator is correct for your locale. Cannot request data from MSFS. Conversion error: " << e.what() << ".";
-					return;
+				if (state.hysteresis > 0 || state.unitFactor != 1.0)
+				{
+					// Hysteresis needs the SimVar's value, and the ops of a state in another unit are not in the unit of the request
+					canBucket = false;
+					break;
+				}
+				if (std::find(ops.begin(), ops.end(), state.op) == ops.end())
+				{
+					ops.push_back(state.op);
 				}
 			}
-			else
+			X52::DataForIndicators& data = *requests.find(requestid);
+			if (canBucket)
 			{
-				delta = 0.0f; // Only notify us when value has changed, no matter with how small amount
+				data.calculatorcode = X52Config::bucket_calculator_code(data.dataref, data.unit, data.simvarindex, ops);
 			}
-
-			// If we already asked for the same dataref + unit + simvarindex then
-			// that is the same request. Don't request it again, just store its RequestID.
-			for (auto it = dataForIndicatorsMap.begin(); it != dataForIndicatorsMap.end(); ++it)
+			if (data.calculatorcode.empty())
 			{
-				if (it->second.dataref == dataref &&
-					it->second.unit == unit &&
-					it->second.simvarindex == simvarindex)
+				CLOG(DEBUG,"toconsole", "tofile") << "Dataref " << data.dataref << " is requested by value, because its states cannot be evaluated in MSFS.";
+				continue;
+			}
+			for (X52Config::IndicatorState& state : config.indicatorStates)
+			{
+				if (state.requestid == requestid)
 				{
-					xmltree.put("<xmlattr>.requestid", it->first);
-					foundsamedataref = true;
-					break;
+					state.bucketbit = static_cast<int>(std::find(ops.begin(), ops.end(), state.op) - ops.begin());
 				}
 			}
+		}
+	}
+
+	// Leds evaluated in MSFS: one request per led which returns the winning state
+	for (const X52Config::IndicatorLed& led : config.indicatorLeds)
+	{
+		if (led.calculatorcode.empty())
+		{
+			continue;
+		}
+		X52::DataForIndicators data;
+		data.dataref = "LED " + led.id; // Only used in log messages, and unique because led ids are
+		data.calculatorcode = led.calculatorcode;
+		int requestid = requests.add(std::move(data));
+		for (size_t i = led.firstState; i < led.firstState + led.stateCount; i++)
+		{
+			config.indicatorStates[i].requestid = requestid;
+		}
+		newRequestIDs.push_back(requestid);
+	}
 
-			if(!foundsamedataref)
+	// Identical requests of all profiles and reloads share their RequestID
+	std::vector<int> renumbered = directory.assign(requests);
+	bool keepsIds = true;
+	for (size_t id = 0; id < renumbered.size(); id++)
+	{
+		keepsIds = keepsIds && (renumbered[id] == 0 || static_cast<size_t>(renumbered[id]) == id);
+	}
+	// Like the first profile at startup, which gets the RequestIDs in the order they were added
+	if (!keepsIds)
+	{
+		requests.renumber(renumbered);
+		auto renumber = [&renumbered](int& requestid) {
+			if (requestid > 0)
 			{
-				// Store the data for later when we react to data changes
-				dataForIndicatorsStruct.dataref = dataref;
-				dataForIndicatorsStruct.unit = unit;
-				dataForIndicatorsStruct.simvarindex = simvarindex;
-				dataForIndicatorsStruct.value = 0;
-				dataForIndicatorsMap.insert({ lastIndicatorRequestID, dataForIndicatorsStruct });
-
-				wasimclient->saveDataRequest(
-					WASimCommander::DataRequest(
-						lastIndicatorRequestID,
-						/* valueSize */			WASimCommander::DATA_TYPE_DOUBLE,
-						/* requestType */		WASimCommander::Enums::RequestType::Named,
-						/* calcResultType */	WASimCommander::Enums::CalcResultType::None,
-						/* period */			WASimCommander::Enums::UpdatePeriod::Millisecond,
-						/* nameOrCode */		dataref.c_str(),
-						/* unitName */			unit.c_str(),
-						/* varTypePrefix */		'A', //  'L' (local), 'A' (SimVar) and 'T' (Token, not an actual GaugeAPI prefix) are checked using respective GaugeAPI methods
-						/* deltaEpsilon */		delta,
-						/* interval */			50,   // Wait 50ms between checking value
-						/* simVarIndex */		simvarindex
-					)
-				);
-				// Store the request ID in the XML
-				xmltree.put("<xmlattr>.requestid", lastIndicatorRequestID);
-				CLOG(DEBUG,"toconsole", "tofile") << "Data requested via WASim for Dataref " << dataref << ", SimVarIndex " << std::to_string(simvarindex) << ", Unit: " << unit << " using RequestID " << lastIndicatorRequestID << ".";
-				lastIndicatorRequestID++;
+				requestid = renumbered[requestid];
 			}
+		};
+		for (X52Config::IndicatorState& state : config.indicatorStates)
+		{
+			renumber(state.requestid);
+		}
+		for (X52Config::ConditionTerm& term : config.conditionTerms)
+		{
+			renumber(term.requestid);
+		}
+	}
+	CLOG(DEBUG,"toconsole", "tofile") << "Assigned " << requests.size() << " data requests to " << config.indicatorStates.size() << " states and " << config.conditionTerms.size()
+		<< " condition terms in " << std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() << " us.";
+}
+
+/// <summary>
+/// Assigns the data requests of a profile once, when it is loaded, so that activating it does not assign anything.
+/// </summary>
+void AssignProfileRequests(Profile& profile)
+{
+	profile.requests = std::make_unique<IndicatorRequests>();
+	AssignIndicatorRequests(*profile.config, *profile.requests, requestIdDirectory);
+}
+
+/// <summary>
+/// Maps the commands of a configuration which were not mapped before to Client Event IDs in one batch, without waiting for
+/// SimConnect's answers, and stores the IDs in the configuration's button actions. So no button press has to map its command.
+/// </summary>
+/// <returns>The number of commands which were mapped now.</returns>
+size_t MapClientEvents(X52Config& config)
+{
+	size_t mapped = 0;
+	for (const std::string& command : config.clientEvents)
+	{
+		auto [it, inserted] = clientEventIds.try_emplace(command, X52::EVENT_CLIENTID + static_cast<int>(clientEventIds.size()));
+		if (inserted)
+		{
+			SimConnect_MapClientEventToSimEvent(hSimConnect, it->second, command.c_str());
+			mapped++;
+		}
+	}
+	for (X52Config::ButtonAction& action : config.buttonActions)
+	{
+		if (action.kind == X52Config::ButtonAction::Kind::Command)
+		{
+			action.clienteventid = clientEventIds[action.command];
 		}
 	}
-	catch (const boost::property_tree::ptree_error&)
+	return mapped;
+}
+
+/// <summary>
+/// Asks WASim to send us the data of a request whenever it changes. Returns without waiting for the server's answer,
+/// so many requests can be sent back to back.
+/// </summary>
+void SubmitIndicatorRequest(int requestid, const X52::DataForIndicators& data)
+{
+	if (!data.calculatorcode.empty())
 	{
-		CLOG(ERROR,"toconsole", "tofile") << "Error with registering WASim DataRequests for indicators.";
+		wasimclient->saveDataRequest(
+			WASimCommander::DataRequest(
+				requestid,
+				/* resultType */		WASimCommander::Enums::CalcResultType::Double,
+				/* calculatorCode */	data.calculatorcode.c_str(),
+				/* valueSize */			WASimCommander::DATA_TYPE_DOUBLE,
+				/* period */			WASimCommander::Enums::UpdatePeriod::Millisecond,
+				/* interval */			IndicatorRequests::INTERVAL_MS, // Wait between checking value
+				/* deltaEpsilon */		0.0f  // The result only changes when a threshold is crossed
+			),
+			true // async: do not wait for the server to acknowledge the request
+		);
+		CLOG(DEBUG,"toconsole", "tofile") << "Calculator code requested via WASim for " << data.dataref << " using RequestID " << requestid << ". Calculator code: " << data.calculatorcode;
+		return;
+	}
+	wasimclient->saveDataRequest(
+		WASimCommander::DataRequest(
+			requestid,
+			/* valueSize */			WASimCommander::DATA_TYPE_DOUBLE,
+			/* requestType */		WASimCommander::Enums::RequestType::Named,
+			/* calcResultType */	WASimCommander::Enums::CalcResultType::None,
+			/* period */			WASimCommander::Enums::UpdatePeriod::Millisecond,
+			/* nameOrCode */		data.dataref.c_str(),
+			/* unitName */			data.unit.c_str(),
+			/* varTypePrefix */		'A', //  'L' (local), 'A' (SimVar) and 'T' (Token, not an actual GaugeAPI prefix) are checked using respective GaugeAPI methods
+			/* deltaEpsilon */		data.delta,
+			/* interval */			IndicatorRequests::INTERVAL_MS, // Wait between checking value
+			/* simVarIndex */		data.simvarindex
+		),
+		true // async: do not wait for the server to acknowledge the request
+	);
+	CLOG(DEBUG,"toconsole", "tofile") << "Data requested via WASim for Dataref " << data.dataref << ", SimVarIndex " << std::to_string(data.simvarindex) << ", Unit: " << data.unit << " using RequestID " << requestid << ".";
+}
+
+/// <summary>
+/// Registers the data requests of the indicators in one batch. Updates are paused while the requests are sent,
+/// so the first values arrive together afterwards, and the leds are evaluated once when all of them have arrived.
+/// The requests of the active profile were already assigned when it was loaded.
+/// </summary>
+/// <param name="wasimConnected">When the connection to WASim was made, to log how long it took until the leds were set.</param>
+void DataRequestsForIndicators(std::chrono::steady_clock::time_point wasimConnected)
+{
+	myx52.index_indicator_requests();
+	myx52.wait_for_initial_data(wasimConnected);
+
+	// Then ask WASim to send us the data
+	auto start = std::chrono::steady_clock::now();
+	wasimclient->setDataRequestsPaused(true);
+	indicatorRequests->for_each(SubmitIndicatorRequest);
+	wasimclient->setDataRequestsPaused(false);
+	CLOG(DEBUG,"toconsole", "tofile") << "Sent " << indicatorRequests->size() << " data requests to WASim in " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count() << " ms.";
+}
+
+/// <summary>
+/// Requests MSFS to send us all data mentioned in the master tag at Dispatch.
+/// </summary>
+void RequestMasterData(const X52Config& config)
+{
+	HRESULT hr;
+	for (const X52Config::MasterTarget& target : config.masterTargets)
+	{
+		// For each target, request the value of switch_dataref and brightness_dataref.
+		if (!target.switchDataref.empty())
+		{
+			hr = SimConnect_AddToDataDefinition(hSimConnect, DEF_MASTER, target.switchDataref.c_str(), target.switchUnit.c_str());
+		}
+		else
+		{
+			CLOG(WARNING,"toconsole", "tofile") << "switch_dataref attribute for the " << target.id << " target is missing from the XML configuration! This might cause errors later!";
+		}
+		if (!target.brightnessDataref.empty())
+		{
+			hr = SimConnect_AddToDataDefinition(hSimConnect, DEF_MASTER, target.brightnessDataref.c_str(), target.brightnessUnit.c_str());
+		}
+		else
+		{
+			CLOG(WARNING,"toconsole", "tofile") << "brightness_dataref attribute for the " << target.id << " target is missing from the XML configuration! This might cause errors later!";
+		}
+	}
+	hr = SimConnect_RequestDataOnSimObject(hSimConnect,
+		REQ_MASTER,
+		DEF_MASTER,
+		SIMCONNECT_SIMOBJECT_TYPE_USER,
+		SIMCONNECT_PERIOD_VISUAL_FRAME,
+		SIMCONNECT_DATA_REQUEST_FLAG_CHANGED, // Only send data when it has changed
+		0, // origin: wait 0 frames before transmission starts
+		1, // interval: wait 1 frame (interval) before sending next data
+		0  // limit: 0 = send endlessly
+	);
+}
+
+/// <summary>
+/// Reads the XML file into a property tree and compiles that, like older versions did.
+/// </summary>
+/// <returns>False if the XML file cannot be compiled. The reason was logged.</returns>
+bool LoadXmlConfigWithPtree(const std::string& xmlconfig, X52Config& config)
+{
+	boost::property_tree::ptree xml_file;
+	try
+	{
+		boost::property_tree::read_xml(xmlconfig, xml_file, boost::property_tree::xml_parser::no_comments + boost::property_tree::xml_parser::trim_whitespace );
+	}
+	catch (const boost::property_tree::xml_parser_error&)
+	{
+		CLOG(FATAL,"toconsole", "tofile") << "Cannot open or parse XML file " << xmlconfig << ". Make sure it is well-formed XML.";
+		return false;
+	}
+	return config.compile(xml_file);
+}
+
+/// <summary>
+/// Loads the compiled configuration from the cache file, or compiles the XML file and writes the cache file.
+/// Safe to call from a background thread, it only touches config.
+/// </summary>
+/// <param name="loadedFromCache">Set to true if the cache file was used.</param>
+/// <returns>False if the XML file cannot be compiled. The reason was logged.</returns>
+bool LoadXmlConfig(const std::string& xmlconfig, bool nocache, X52Config& config, bool& loadedFromCache)
+{
+	ConfigCache configCache(xmlconfig);
+	loadedFromCache = false;
+	if (!nocache && configCache.load(config))
+	{
+		loadedFromCache = true;
+		return true;
+	}
+	if (!config.load(xmlconfig))
+	{
+		return false;
+	}
+	if (!nocache && configCache.save(config))
+	{
+		CLOG(DEBUG,"toconsole", "tofile") << "Wrote the compiled configuration to cache file " << configCache.get_cache_filename() << ".";
+	}
+	return true;
+}
+
+/// <summary>
+/// Returns the profile used for aircraft which are not matched by any aircraft tag: the xmlconfig file if it was given,
+/// otherwise the first profile without aircraft tags, otherwise the first profile.
+/// </summary>
+size_t SelectDefaultProfile(bool xmlconfigIsDefault)
+{
+	if (!xmlconfigIsDefault)
+	{
+		for (size_t i = 0; i < profiles.size(); i++)
+		{
+			if (profiles[i].config->aircraftTitles.empty())
+			{
+				return i;
+			}
+		}
+	}
+	return 0;
+}
+
+/// <summary>
+/// Compiles the XML files of all profiles in a background thread, so the leds and buttons keep working meanwhile.
+/// Unchanged files are read from their cache file. The result is applied by FinishReload() from the main loop.
+/// </summary>
+/// <returns>The new configuration of each profile, or nullptr if its XML file cannot be compiled.</returns>
+std::future<std::vector<std::unique_ptr<X52Config>>> StartReload(bool nocache)
+{
+	std::vector<std::string> filenames;
+	for (const Profile& profile : profiles)
+	{
+		filenames.push_back(profile.filename);
+	}
+	CLOG(INFO,"toconsole", "tofile") << "Reloading " << filenames.size() << " XML file(s).";
+	return std::async(std::launch::async, [filenames, nocache]() {
+		std::vector<std::unique_ptr<X52Config>> configs;
+		for (const std::string& filename : filenames)
+		{
+			auto config = std::make_unique<X52Config>();
+			bool loadedFromCache;
+			if (!LoadXmlConfig(filename, nocache, *config, loadedFromCache))
+			{
+				config.reset();
+			}
+			configs.push_back(std::move(config));
+		}
+		return configs;
+	});
+}
+
+/// <summary>
+/// Makes a configuration and its requests active. Only the WASim data requests which have changed are removed or
+/// registered, so requests which both configurations need stay registered.
+/// Must be called from the main loop, between the processing of two messages.
+/// </summary>
+/// <param name="newConfig">The new configuration, which must stay alive while it is active.</param>
+/// <param name="newRequests">The requests assigned to newConfig by AssignIndicatorRequests().</param>
+void ApplyConfig(X52Config& newConfig, IndicatorRequests& newRequests, const std::string& filename)
+{
+	auto start = std::chrono::steady_clock::now();
+	size_t removed = 0;
+	indicatorRequests->for_each([&newRequests, &removed](int requestid, const X52::DataForIndicators&) {
+		if (!newRequests.contains(requestid))
+		{
+			wasimclient->removeDataRequest(requestid);
+			removed++;
+		}
+	});
+	std::vector<int> added;
+	newRequests.for_each([&added](int requestid, const X52::DataForIndicators&) {
+		if (!indicatorRequests->contains(requestid))
+		{
+			added.push_back(requestid);
+		}
+	});
+	bool masterChanged = x52config->masterTargets.size() != newConfig.masterTargets.size() ||
+		!std::equal(x52config->masterTargets.begin(), x52config->masterTargets.end(), newConfig.masterTargets.begin(),
+			[](const X52Config::MasterTarget& a, const X52Config::MasterTarget& b) {
+				return a.id == b.id && a.op == b.op && a.switchDataref == b.switchDataref && a.switchUnit == b.switchUnit &&
+					a.brightnessDataref == b.brightnessDataref && a.brightnessUnit == b.brightnessUnit &&
+					a.min == b.min && a.max == b.max && a.defaultBrightness == b.defaultBrightness;
+			});
+
+	myx52.swap_config(newConfig, newRequests);
+	x52config = &newConfig;
+	indicatorRequests = &newRequests;
+
+	// Registered after the swap, because WASim calls the callback immediately and it needs the new requests
+	for (int requestid : added)
+	{
+		SubmitIndicatorRequest(requestid, *indicatorRequests->find(requestid));
+	}
+	if (masterChanged)
+	{
+		SimConnect_ClearDataDefinition(hSimConnect, DEF_MASTER);
+		masterTargetOn.assign(x52config->masterTargets.size(), -1);
+		RequestMasterData(*x52config);
+	}
+	// Leds which read an added request keep their light until its first value arrives, see X52::swap_config()
+	myx52.evaluate_indicators();
+	myx52.shift_state_action();
+	CLOG(INFO,"toconsole", "tofile") << "Activated the configuration of " << filename << " in " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count()
+		<< " ms. Data requests: " << indicatorRequests->size() - added.size() << " kept, " << added.size() << " added, " << removed << " removed."
+		<< (masterChanged ? " The master tag has changed and was requested again." : "");
+}
+
+/// <summary>
+/// Makes a profile active. Nothing is parsed, copied or assigned: the profile was compiled and its data requests
+/// were assigned when it was loaded.
+/// </summary>
+void ActivateProfile(size_t index)
+{
+	ApplyConfig(*profiles[index].config, *profiles[index].requests, profiles[index].filename);
+	activeProfile = index;
+	pendingProfile = -1;
+}
+
+/// <summary>
+/// Stores the configurations compiled by StartReload() in the profiles, and activates the profile of the current aircraft again.
+/// Profiles whose XML file could not be compiled keep their previous configuration.
+/// </summary>
+void FinishReload(std::vector<std::unique_ptr<X52Config>>& configs, bool xmlconfigIsDefault)
+{
+	// The active configuration is used until the new one is swapped in
+	std::vector<std::unique_ptr<X52Config>> replacedConfigs;
+	std::vector<std::unique_ptr<IndicatorRequests>> replacedRequests;
+	for (size_t i = 0; i < profiles.size() && i < configs.size(); i++)
+	{
+		if (configs[i])
+		{
+			replacedConfigs.push_back(std::move(profiles[i].config));
+			replacedRequests.push_back(std::move(profiles[i].requests));
+			profiles[i].config = std::move(configs[i]);
+			AssignProfileRequests(profiles[i]);
+			size_t mapped = MapClientEvents(*profiles[i].config);
+			if (mapped > 0)
+			{
+				CLOG(DEBUG,"toconsole", "tofile") << "Mapped " << mapped << " new commands of " << profiles[i].filename << " to Client Event IDs.";
+			}
+		}
+		else
+		{
+			CLOG(ERROR,"toconsole", "tofile") << "The XML file " << profiles[i].filename << " could not be reloaded. Its previous configuration is kept.";
+		}
+	}
+	defaultProfile = SelectDefaultProfile(xmlconfigIsDefault);
+	ActivateProfile(aircraftTitle.empty() ? activeProfile : ProfileForAircraft(aircraftTitle));
+}
+
+/// <summary>
+/// Compiles the xmlconfig file and the XML files in profiledir into profiles. Files in profiledir which have errors are skipped.
+/// </summary>
+/// <returns>False if the xmlconfig file has errors or no file could be loaded.</returns>
+bool LoadProfiles(const std::string& xmlconfig, const std::string& profiledir, bool ptreeloader, bool nocache)
+{
+	// Compile the tags which are processed on every data change. By default the compiled configuration is
+	// read from the cache file if the XML file has not changed since it was written. Otherwise the XML file
+	// is compiled while it is read, without building a property tree of the whole file first.
+	// All profiles are compiled now, so switching to another aircraft does not parse anything.
+	if (!xmlconfig.empty())
+	{
+		profiles.push_back({ xmlconfig });
+	}
+	if (!profiledir.empty())
+	{
+		std::error_code ec;
+		std::vector<std::string> filenames;
+		for (const auto& entry : std::filesystem::directory_iterator(profiledir, ec))
+		{
+			std::string extension = entry.path().extension().string();
+			std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+			if (entry.is_regular_file() && extension == ".xml" && (xmlconfig.empty() || !std::filesystem::equivalent(entry.path(), xmlconfig, ec)))
+			{
+				filenames.push_back(entry.path().string());
+			}
+		}
+		if (ec)
+		{
+			CLOG(FATAL,"toconsole", "tofile") << "Cannot read profile directory " << profiledir << ": " << ec.message();
+			return false;
+		}
+		std::sort(filenames.begin(), filenames.end());
+		for (const std::string& filename : filenames)
+		{
+			profiles.push_back({ filename });
+		}
+	}
+	for (size_t i = 0; i < profiles.size(); )
+	{
+		Profile& profile = profiles[i];
+		profile.config = std::make_unique<X52Config>();
+		auto loadStart = std::chrono::steady_clock::now();
+		bool loadedFromCache = false;
+		std::error_code ec;
+		profile.writeTime = std::filesystem::last_write_time(profile.filename, ec);
+		bool loaded = ptreeloader ? LoadXmlConfigWithPtree(profile.filename, *profile.config) : LoadXmlConfig(profile.filename, nocache, *profile.config, loadedFromCache);
+		if (!loaded)
+		{
+			if (profile.filename == xmlconfig)
+			{
+				return false;
+			}
+			// A broken profile of another aircraft does not stop x52msfsout
+			CLOG(ERROR,"toconsole", "tofile") << "Profile " << profile.filename << " is skipped because of errors.";
+			profiles.erase(profiles.begin() + i);
+			continue;
+		}
+		CLOG(DEBUG,"toconsole", "tofile") << "Loaded XML file " << profile.filename << (ptreeloader ? " through a property tree" : "") << (loadedFromCache ? " from its cache file" : "") << " in "
+			<< std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - loadStart).count() << " us.";
+		// Switching to this profile later only swaps pointers
+		AssignProfileRequests(profile);
+		i++;
+	}
+	if (profiles.empty())
+	{
+		CLOG(FATAL,"toconsole", "tofile") << "No XML configuration file found in profile directory " << profiledir << ".";
+		return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Opens the SimConnect connection and connects to the WASimCommander module in MSFS.
+/// </summary>
+/// <param name="wasimConnected">Receives the time when the connection to the WASimCommander server was made.</param>
+/// <returns>False if MSFS or the WASimCommander server cannot be reached.</returns>
+bool ConnectToSimulator(std::chrono::steady_clock::time_point& wasimConnected)
+{
+	HRESULT hr;
+	if (FAILED(SimConnect_Open(&hSimConnect, "x52 msfs out client", NULL, 0, 0, 0)))
+	{
+		hSimConnect = NULL;
+		CLOG(FATAL,"toconsole", "tofile") << "Cannot connect to Flight Simulator!";
+		return false;
+	}
+	CLOG(INFO,"toconsole", "tofile") << "Connected to Flight Simulator via SimConnect!";
+
+	// Connect to WASimCommander module within Simulator using default timeout period and network configuration (local Simulator)
+	if ((hr = wasimclient->connectSimulator()) != S_OK) {
+		CLOG(FATAL,"toconsole", "tofile") << "WASimClient cannot connect to Simulator, quitting. Error Code: " << hr;
+		return false;
+	}
+	// Ping the WASimCommander server to make sure it's running and get the server version number (returns zero if no response).
+	const uint32_t wasimversion = wasimclient->pingServer();
+	if (wasimversion == 0) {
+		CLOG(FATAL,"toconsole", "tofile") << "WASimClient server did not respond to ping, quitting.";
+		return false;
+	}
+	// Decode version number to dotted format and print it
+	CLOG(INFO,"toconsole", "tofile") << "Found WASimModule Server v" << (wasimversion >> 24) << '.' << ((wasimversion >> 16) & 0xFF) << '.' << ((wasimversion >> 8) & 0xFF) << '.' << (wasimversion & 0xFF);
+	// Try to connect to the server, using default timeout value.
+	if ((hr = wasimclient->connectServer()) != S_OK) {
+		CLOG(FATAL,"toconsole", "tofile") << "WASimClient Server connection failed, quitting. Error Code: " << hr;
+		return false;
+	}
+	wasimConnected = std::chrono::steady_clock::now();
+	return true;
+}
+
+/// <summary>
+/// When a stage of the startup ran, for the startup timing report.
+/// </summary>
+struct StartupStage {
+	std::string name;
+	std::chrono::steady_clock::time_point start;
+	std::chrono::steady_clock::time_point end;
+	bool succeeded = false;
+};
+
+/// <summary>
+/// Runs a stage of the startup in its own thread.
+/// </summary>
+/// <param name="stage">Returns false if x52msfsout cannot start. It logs its own errors.</param>
+std::future<StartupStage> StartStartupStage(const std::string& name, std::function<bool()> stage)
+{
+	return std::async(std::launch::async, [name, stage]() {
+		StartupStage result{ name, std::chrono::steady_clock::now() };
+		result.succeeded = stage();
+		result.end = std::chrono::steady_clock::now();
+		return result;
+	});
+}
+
+/// <summary>
+/// Logs when each stage of the startup started and how long it took, relative to startupStart.
+/// </summary>
+void LogStartupTimes(const std::vector<StartupStage>& stages, std::chrono::steady_clock::time_point startupStart)
+{
+	auto ms = [startupStart](std::chrono::steady_clock::time_point time) {
+		return std::chrono::duration_cast<std::chrono::milliseconds>(time - startupStart).count();
+	};
+	std::chrono::steady_clock::time_point end = startupStart;
+	for (const StartupStage& stage : stages)
+	{
+		end = std::max(end, stage.end);
+	}
+	CLOG(INFO,"toconsole", "tofile") << "Startup took " << ms(end) << " ms:";
+	for (const StartupStage& stage : stages)
+	{
+		CLOG(INFO,"toconsole", "tofile") << "  " << stage.name << ": " << ms(stage.end) - ms(stage.start) << " ms, from " << ms(stage.start) << " to " << ms(stage.end) << " ms"
+			<< (stage.succeeded ? "." : ", failed.");
 	}
 }
 
@@ -645,12 +1348,17 @@ int main(int argc, char *argv[])
 	char lastPressedKey = 'a';
 	// Command-line options
 	std::string xmlconfig;
+	std::string profiledir;
 	long mfddelayms = 0;
+	long coalescems = 20;
 	bool logtofile = false;
 	bool logdebug = false;
 	bool logtrace = false;
-
-	HRESULT hr;
+	bool ptreeloader = false;
+	bool nocache = false;
+	bool watch = false;
+	bool analyze = false;
+	bool benchmark = false;
 
 	// Register signal handler for CTRL+C
     std::signal(SIGINT, signalHandler);
@@ -665,11 +1373,18 @@ int main(int argc, char *argv[])
 		boost::program_options::options_description desc("Allowed options");
 		desc.add_options()
 			("help,h", "Display help message")
-			("xmlconfig,x", boost::program_options::value<std::string>(&xmlconfig)->required(), "XML configuration file")
+			("xmlconfig,x", boost::program_options::value<std::string>(&xmlconfig), "XML configuration file. With a profile directory, it is used for aircraft which are not matched by any profile.")
+			("profiles,p", boost::program_options::value<std::string>(&profiledir), "Directory of XML configuration files. The file whose aircraft tag matches the title of the aircraft is used.")
 			("mfddelayms,m", boost::program_options::value<long>(&mfddelayms)->default_value(0), "Delay in ms after sending each character-pair to MFD. Defaults to 0ms.")
+			("coalescems,c", boost::program_options::value<long>(&coalescems)->default_value(20), "Time in ms to collect data changes from MSFS before leds are updated. Defaults to 20ms.")
 			("logtofile,l", boost::program_options::bool_switch(&logtofile), "In addition to console, log to file with more details. File is never deleted, only appended.")
 			("logdebug,d", boost::program_options::bool_switch(&logdebug), "Debug infrequent events.")
 			("logtrace,t", boost::program_options::bool_switch(&logtrace), "Trace frequent events.")
+			("ptreeloader", boost::program_options::bool_switch(&ptreeloader), "Load the XML file into a boost property tree before compiling it, like older versions did. Only for comparing load times.")
+			("watch,w", boost::program_options::bool_switch(&watch), "Reload the XML file automatically when it is saved. Press r+Enter to reload it manually.")
+			("nocache", boost::program_options::bool_switch(&nocache), "Always compile the XML file, do not read or write the cache file next to it.")
+			("analyze,a", boost::program_options::bool_switch(&analyze), "Report the runtime cost of the XML files and quit. Needs neither MSFS nor the joystick.")
+			("benchmark,b", boost::program_options::bool_switch(&benchmark), "Measure loading, led evaluation, request assignment and notifications of the XML file given with --xmlconfig and of a generated configuration with 3300 states against the code of version 0.5.0, and quit. Needs neither MSFS nor the joystick.")
 		;
 		boost::program_options::variables_map vm;
 		auto parsed_options = boost::program_options::parse_command_line(argc, argv, desc);
@@ -679,6 +1394,9 @@ int main(int argc, char *argv[])
 			exit(EXIT_SUCCESS);
 		}
 		boost::program_options::notify(vm);
+		if (xmlconfig.empty() && profiledir.empty()) {
+			throw std::invalid_argument("the option '--xmlconfig' or '--profiles' is required");
+		}
 	}
 	catch (const std::exception& e)
 	{
@@ -695,190 +1413,234 @@ int main(int argc, char *argv[])
 	// Change easylogging++ configuration based on command-line parameters
 	AdjustEasyloggingConf(logtofile, logdebug, logtrace);
 
-	LogitechServiceStop(); // Puts its results into struct LogitechServiceResults
-	if (LogitechServiceResults.stopped == false) {
-        // Possible errors were already logged by LogitechServiceStop()
-		exit(EXIT_FAILURE);
+	if (benchmark)
+	{
+		if (xmlconfig.empty())
+		{
+			CLOG(FATAL,"toconsole", "tofile") << "--benchmark needs an XML file given with --xmlconfig.";
+			return EXIT_FAILURE;
+		}
+		ConfigBenchmark configBenchmark([](X52Config& config, IndicatorRequests& requests) {
+			RequestIdDirectory directory;
+			AssignIndicatorRequests(config, requests, directory);
+		});
+		return configBenchmark.run(xmlconfig) && configBenchmark.run_synthetic() ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	if (analyze)
+	{
+		// Compiled and assigned to requests like at runtime, but the service, the joystick and MSFS are not touched
+		if (!LoadProfiles(xmlconfig, profiledir, ptreeloader, nocache))
+		{
+			return EXIT_FAILURE;
+		}
+		for (const Profile& profile : profiles)
+		{
+			ConfigAnalyzer(*profile.config, *profile.requests).log_report(profile.filename);
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// The slow stages of the startup do not depend on each other, so they run in parallel. Stopping the service can
+	// wait several seconds, meanwhile the XML files are compiled, the joystick is found and MSFS is connected.
+	// Only talking to the joystick needs the service to be stopped, and registering data requests needs both
+	// the configuration and the connection, so these follow once all stages have finished.
+	auto startupStart = std::chrono::steady_clock::now();
+	// WASimClient switches the global locale while it is constructed, and the XML compiler
+	// reads numbers in the global locale, so it is constructed before the stages start.
+	std::locale::global(std::locale::classic());
+	auto tempclient = WASimCommander::Client::WASimClient(0x52C11E47);  // "x52CLIENT"
+	std::locale::global(std::locale(""));
+	wasimclient = &tempclient;
+	std::chrono::steady_clock::time_point wasimConnected;
+	std::future<StartupStage> serviceStage = StartStartupStage("Stop Logitech DirectOutput service", []() {
+		LogitechServiceStop(); // Puts its results into struct LogitechServiceResults
+		// Possible errors were already logged by LogitechServiceStop()
+		return LogitechServiceResults.stopped != false;
+	});
+	std::future<StartupStage> configStage = StartStartupStage("Load XML files", [&]() {
+		return LoadProfiles(xmlconfig, profiledir, ptreeloader, nocache);
+	});
+	std::future<StartupStage> hidStage = StartStartupStage("Find X52 Pro", []() {
+		if (x52hid.initialize() != 1)
+		{
+			CLOG(FATAL,"toconsole", "tofile") << "Cannot initialize HID communication. Is X52 Pro plugged in? Is the Saitek / Logitech driver installed?";
+			return false;
+		}
+		CLOG(DEBUG,"toconsole", "tofile") << "HID path found: " << x52hid.getHIDPath();
+		return true;
+	});
+	std::future<StartupStage> simStage = StartStartupStage("Connect to MSFS and WASim", [&wasimConnected]() {
+		return ConnectToSimulator(wasimConnected);
+	});
+	std::vector<StartupStage> startupStages;
+	startupStages.push_back(serviceStage.get());
+	startupStages.push_back(configStage.get());
+	startupStages.push_back(hidStage.get());
+	startupStages.push_back(simStage.get());
+	if (std::any_of(startupStages.begin(), startupStages.end(), [](const StartupStage& stage) { return !stage.succeeded; }))
+	{
+		LogStartupTimes(startupStages, startupStart);
+		if (!startupStages[0].succeeded)
+		{
+			// The service was not stopped, so it must not be started either
+			if (hSimConnect != NULL)
+			{
+				SimConnect_Close(hSimConnect);
+			}
+			return EXIT_FAILURE;
+		}
+		cleanup();
+		return EXIT_FAILURE;
 	}
 
-	CLOG(INFO,"toconsole", "tofile") << "Press q+Enter to quit!";
+	CLOG(INFO,"toconsole", "tofile") << "Press q+Enter to quit, r+Enter to reload the XML files!";
 
-	// Parse the XML into the property tree.
-	try
+	auto setupStart = std::chrono::steady_clock::now();
+	// The commands of all profiles are mapped now that both SimConnect and the profiles are ready, before any button is pressed
+	size_t mappedCommands = 0;
+	for (Profile& profile : profiles)
 	{
-		boost::property_tree::read_xml(xmlconfig, xml_file, boost::property_tree::xml_parser::no_comments + boost::property_tree::xml_parser::trim_whitespace );
+		mappedCommands += MapClientEvents(*profile.config);
 	}
-	catch (const boost::property_tree::xml_parser_error&)
+	CLOG(DEBUG,"toconsole", "tofile") << "Mapped " << mappedCommands << " commands to Client Event IDs in " << std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - setupStart).count() << " us.";
+	defaultProfile = SelectDefaultProfile(!xmlconfig.empty());
+	activeProfile = defaultProfile;
+	x52config = profiles[activeProfile].config.get();
+	indicatorRequests = profiles[activeProfile].requests.get();
+	if (profiles.size() > 1)
 	{
-		CLOG(FATAL,"toconsole", "tofile") << "Cannot open or parse XML file. Make sure it is well-formed XML.";
-		exit(EXIT_FAILURE);
+		CLOG(INFO,"toconsole", "tofile") << "Loaded " << profiles.size() << " profiles. Until the aircraft is known, " << profiles[activeProfile].filename << " is used.";
 	}
 
 	LedBlinker ledBlinker;
 	ledBlinker.set_x52(myx52);
 	myx52.set_LedBlinker(ledBlinker);
 
-	myx52.set_xmlfile(&xml_file);
-	if (!myx52.validateSequences())
-	{
-		exit(EXIT_FAILURE);
-	}
+	myx52.set_config(x52config);
+	myx52.set_coalesce_window(coalescems);
+	masterTargetOn.assign(x52config->masterTargets.size(), -1);
 
-	if (x52hid.initialize() == 1)
-	{
-		CLOG(DEBUG,"toconsole", "tofile") << "HID path found: " << x52hid.getHIDPath();
-		myx52.set_x52HID(x52hid);
-		if (mfddelayms != 0) {
-			x52hid.setMFDCharDelay(mfddelayms);
-		}
-	}
-	else
-	{
-		CLOG(FATAL,"toconsole", "tofile") << "Cannot initialize HID communication. Is X52 Pro plugged in? Is the Saitek / Logitech driver installed?";
-		cleanup();
-		return EXIT_FAILURE;
+	myx52.set_x52HID(x52hid);
+	if (mfddelayms != 0) {
+		x52hid.setMFDCharDelay(mfddelayms);
 	}
 
 	// Create a window to receive raw input
 	HWND hwnd = CreateWindowForRawInput();
 
-	// Connect to MSFS
-	if (SUCCEEDED(SimConnect_Open(&hSimConnect, "x52 msfs out client", NULL, 0, 0, 0)))
+	myx52.set_simconnect_handle(hSimConnect);
+	myx52.set_wasimconnect_instance(tempclient);
+
+	// The callback is also set without indicators, because a reload can add them
+	wasimclient->setDataCallback(&X52::IndicatorDataCallback, &myx52);
+	myx52.setIndicatorRequests(*indicatorRequests); // This should happen before registering DataRequests, because after registration the callback is immediately called and it needs to access the requests.
+	DataRequestsForIndicators(wasimConnected);
+
+	// Request MSFS to send us all data mentioned in the master tag at Dispatch
+	RequestMasterData(*x52config);
+
+	// With several profiles, watch for the aircraft to change
+	if (profiles.size() > 1)
 	{
-		CLOG(INFO,"toconsole", "tofile") << "Connected to Flight Simulator via SimConnect!";
-		myx52.set_simconnect_handle(hSimConnect);
+		SimConnect_AddToDataDefinition(hSimConnect, DEF_TITLE, "TITLE", NULL, SIMCONNECT_DATATYPE_STRING256);
+		SimConnect_SubscribeToSystemEvent(hSimConnect, EVENT_AIRCRAFT_LOADED, "AircraftLoaded");
+		RequestAircraftTitle();
+	}
 
-		// Connect to WASimCommander module within Simulator using default timeout period and network configuration (local Simulator)
-		std::locale::global(std::locale::classic());
-		auto tempclient = WASimCommander::Client::WASimClient(0x52C11E47);  // "x52CLIENT"
-		std::locale::global(std::locale(""));
-		wasimclient = &tempclient;
-		if ((hr = wasimclient->connectSimulator()) != S_OK) {
-			CLOG(FATAL,"toconsole", "tofile") << "WASimClient cannot connect to Simulator, quitting. Error Code: " + hr;
-			cleanup();
-			return EXIT_FAILURE;
-		}
-		// Ping the WASimCommander server to make sure it's running and get the server version number (returns zero if no response).
-		const uint32_t wasimversion = wasimclient->pingServer();
-		if (wasimversion == 0) {
-			CLOG(FATAL,"toconsole", "tofile") << "WASimClient server did not respond to ping, quitting.";
-			cleanup();
-			return EXIT_FAILURE;
-		}
-		// Decode version number to dotted format and print it
-		CLOG(INFO,"toconsole", "tofile") << "Found WASimModule Server v" << (wasimversion >> 24) << '.' << ((wasimversion >> 16) & 0xFF) << '.' << ((wasimversion >> 8) & 0xFF) << '.' << (wasimversion & 0xFF);
-		// Try to connect to the server, using default timeout value.
-		if ((hr = wasimclient->connectServer()) != S_OK) {
-			CLOG(FATAL,"toconsole", "tofile") << "WASimClient Server connection failed, quitting. Error Code: " << hr;
-			cleanup();
-			return EXIT_FAILURE;
-		}
-		myx52.set_wasimconnect_instance(tempclient);
+	// Initialize LEDs and MFD. Switch off LEDs which were set to a color
+	// in Windows' "USB Game Controllers" window.
+	myx52.all_on("led", false);
+	myx52.all_on("mfd", false);
+	startupStages.push_back({ "Set up joystick and data requests", setupStart, std::chrono::steady_clock::now(), true });
+	LogStartupTimes(startupStages, startupStart);
 
-		if (xml_file.count("indicators") != 0)
-		{
-			wasimclient->setDataCallback(&X52::IndicatorDataCallback, &myx52);
-			myx52.setDataForIndicatorsMap(dataForIndicatorsMap); // This should happen before registering DataRequests, because after registration the callback is immediately called and it needs to access the Map.
-			DataRequestsForIndicators("", xml_file.get_child("indicators"));
-		}
+	// The infinite MSFS processing loop
+	MSG msg;
+	std::future<std::vector<std::unique_ptr<X52Config>>> pendingReload;
+	bool reloadRequested = false;
+	auto lastWatchCheck = std::chrono::steady_clock::now();
 
-		// BEGIN Request MSFS to send us all data mentioned in the master tag at Dispatch
-		std::string attr, dataref, unit;
-		size_t separatorpos;
-		for (boost::property_tree::ptree::value_type &v : xml_file.get_child("master")) { // Read all children of master tag
-			if (v.first == "target") // only process target tags
+	try
+	{
+		while (!exitMainWhileLoop)
+		{
+			// BEGIN of setting the exit variable when q key press detected, and reloading when r key press detected
+			if (_kbhit())
 			{
-				// For each target, request the value of switch_dataref and brightness_dataref.
-				try
-				{
-					attr = v.second.get<std::string>("<xmlattr>.switch_dataref");
-					separatorpos = attr.find("%");
-					dataref = attr.substr(0, separatorpos);
-					unit = attr.substr(separatorpos + 1);
-					// We assume, switch_dataref is not empty, because it is a mandatory attribute.
-					hr = SimConnect_AddToDataDefinition(hSimConnect, DEF_MASTER, dataref.c_str(), unit.c_str() );
-				}
-				catch (const boost::property_tree::ptree_bad_path&)
-				{
-					CLOG(WARNING,"toconsole", "tofile") << "switch_dataref attribute for the " << v.second.get<std::string>("<xmlattr>.id") << " target is missing from the XML configuration! This might cause errors later!";
+				char ch = _getche(); // Read char and also print it to the console
+				if (ch == '\r') {  
+					if (lastPressedKey == 'q') {
+						CLOG(INFO,"toconsole", "tofile") << "Exit command received.";
+						exitMainWhileLoop = true;
+						break;
+					}
+					if (lastPressedKey == 'r') {
+						reloadRequested = true;
+					}
+					lastPressedKey = 0;
+				} else {
+					lastPressedKey = ch;
 				}
+			}
+			// END of setting the exit variable when q key press detected, and reloading when r key press detected
 
-				try
-				{
-					attr = v.second.get<std::string>("<xmlattr>.brightness_dataref");
-					separatorpos = attr.find("%");
-					dataref = attr.substr(0, separatorpos);
-					unit = attr.substr(separatorpos + 1);
-					// We assume, brightness_dataref is not empty, because it is a mandatory attribute.
-					hr = SimConnect_AddToDataDefinition(hSimConnect, DEF_MASTER, dataref.c_str(), unit.c_str());
-				}
-				catch (const boost::property_tree::ptree_bad_path&)
+			// Check once a second if an XML file was saved
+			if (watch && std::chrono::steady_clock::now() - lastWatchCheck >= std::chrono::seconds(1))
+			{
+				lastWatchCheck = std::chrono::steady_clock::now();
+				for (Profile& profile : profiles)
 				{
-					CLOG(WARNING,"toconsole", "tofile") << "brightness_dataref attribute for the " << v.second.get<std::string>("<xmlattr>.id") << " target is missing from the XML configuration! This might cause errors later!";
+					std::error_code ec;
+					auto writeTime = std::filesystem::last_write_time(profile.filename, ec);
+					if (!ec && writeTime != profile.writeTime)
+					{
+						profile.writeTime = writeTime;
+						reloadRequested = true;
+					}
 				}
 			}
-		}
-		hr = SimConnect_RequestDataOnSimObject(hSimConnect,
-			REQ_MASTER,
-			DEF_MASTER,
-			SIMCONNECT_SIMOBJECT_TYPE_USER,
-			SIMCONNECT_PERIOD_VISUAL_FRAME,
-			SIMCONNECT_DATA_REQUEST_FLAG_CHANGED, // Only send data when it has changed
-			0, // origin: wait 0 frames before transmission starts
-			1, // interval: wait 1 frame (interval) before sending next data
-			0  // limit: 0 = send endlessly
-		);
-		// END Request MSFS to send us all data mentioned in the master tag at Dispatch
+			// Only one reload at a time. If the file is saved again meanwhile, reload once more when it is done.
+			if (reloadRequested && !pendingReload.valid())
+			{
+				reloadRequested = false;
+				pendingReload = StartReload(nocache);
+			}
 
-		// Initialize LEDs and MFD. Switch off LEDs which were set to a color
-		// in Windows' "USB Game Controllers" window.
-		myx52.all_on("led", false);
-		myx52.all_on("mfd", false);
+			// Get WM_INPUT messages via the invisible window we opened above
+			if (PeekMessage(&msg, hwnd, WM_INPUT, WM_INPUT, PM_REMOVE | PM_QS_INPUT)) {
+				handleRawInputData(msg.lParam);
+			}
 
-		// The infinite MSFS processing loop
-		MSG msg;
+			SimConnect_CallDispatch(hSimConnect, MyDispatchProcRD, NULL);
 
-		try
-		{
-			while (!exitMainWhileLoop)
-			{
-				// BEGIN of setting the exit variable when q key press detected
-				if (_kbhit())
-				{
-					char ch = _getche(); // Read char and also print it to the console
-					if (ch == '\r') {  
-						if (lastPressedKey == 'q') {
-							CLOG(INFO,"toconsole", "tofile") << "Exit command received.";
-							exitMainWhileLoop = true;
-							break;
-						}
-						lastPressedKey = 0;
-					} else {
-						lastPressedKey = ch;
-					}
-				}
-				// END of setting the exit variable when q key press detected
+			// Repeat the held repeater buttons which are due
+			myx52.run_button_timers();
 
-				// Get WM_INPUT messages via the invisible window we opened above
-				if (PeekMessage(&msg, hwnd, WM_INPUT, WM_INPUT, PM_REMOVE | PM_QS_INPUT)) {
-					handleRawInputData(msg.lParam);
-				}
+			// Evaluate leds whose data has changed
+			myx52.evaluate_dirty_leds();
+			// Show led changes which were held back by a state's dwell time
+			myx52.evaluate_dwelling_leds();
+			// Trend ops change over time, even without new data
+			myx52.evaluate_trend_leds();
 
-				SimConnect_CallDispatch(hSimConnect, MyDispatchProcRD, NULL);
+			// Swap a reloaded configuration or another profile in between two passes of the loop, when nothing else uses it
+			if (pendingReload.valid() && pendingReload.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+			{
+				std::vector<std::unique_ptr<X52Config>> configs = pendingReload.get();
+				FinishReload(configs, !xmlconfig.empty());
+			}
+			if (pendingProfile >= 0)
+			{
+				CLOG(INFO,"toconsole", "tofile") << "Switching to profile " << profiles[pendingProfile].filename << " for aircraft \"" << aircraftTitle << "\".";
+				ActivateProfile(static_cast<size_t>(pendingProfile));
 			}
-		} catch (const std::exception& e) {
-			CLOG(FATAL,"toconsole", "tofile") << "Exception caught: " << e.what();
-			cleanup();
-		} catch (...) {
-			CLOG(FATAL,"toconsole", "tofile") << "Unknown exception caught!";
-			cleanup();
 		}
-	}
-	else {
-		CLOG(FATAL,"toconsole", "tofile") << "Cannot connect to Flight Simulator!";
+	} catch (const std::exception& e) {
+		CLOG(FATAL,"toconsole", "tofile") << "Exception caught: " << e.what();
+		cleanup();
+	} catch (...) {
+		CLOG(FATAL,"toconsole", "tofile") << "Unknown exception caught!";
 		cleanup();
-		return EXIT_FAILURE;
-
 	}
 
 	